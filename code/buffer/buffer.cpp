@@ -69,6 +69,7 @@ std::string Buffer::RetrieveAllToStr()
 {
   std::string str(Peek(), ReadableBytes());
   RetrieveAll();
+  return str;
 }
 
 // 写指针的位置
@@ -88,6 +89,12 @@ void Buffer::Append(const std::string &str)
   Append(str.c_str(), str.size());
 }
 
+void Buffer::Append(const char *str)
+{
+  assert(str);
+  Append(str, strlen(str));
+}
+
 void Buffer::Append(const char *str, size_t len)
 {
   assert(str);
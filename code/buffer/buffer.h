@@ -32,6 +32,7 @@ public:
   char *BeginWrite();
 
   void Append(const std::string &str);
+  void Append(const char *str); // 以 '\0' 结尾的字符串，字面量不再先构造临时 string
   void Append(const char *str, size_t len);
   void Append(const void *data, size_t len);
   void Append(const Buffer &buff);
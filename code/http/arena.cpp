@@ -0,0 +1,53 @@
+#include "arena.h"
+
+#include <new> // bad_alloc
+
+Arena::~Arena() {
+	while(blocks_) {
+		Block* next = blocks_->next;
+		free(blocks_);
+		blocks_ = next;
+	}
+}
+
+void* Arena::Grow_(size_t size, size_t align) {
+	size_t need = size + align;
+	size_t last = blocks_ ? blocks_->size : INLINE_BYTES;
+	size_t blockSize = last * 2 > need ? last * 2 : need; // 每次翻倍，块数按对数增长
+	Block* block = static_cast<Block*>(malloc(sizeof(Block) + blockSize));
+	if(!block) {
+		throw std::bad_alloc();
+	}
+	block->next = blocks_;
+	block->size = blockSize;
+	blocks_ = block;
+	ptr_ = block->Data();
+	end_ = ptr_ + blockSize;
+	return Allocate(size, align);
+}
+
+void Arena::Reset() {
+	// 只保留最大的一块（就是最新的一块），以后的请求从它开始分配，内联的部分不再使用
+	if(blocks_) {
+		Block* keep = blocks_;
+		Block* b = keep->next;
+		while(b) {
+			Block* next = b->next;
+			free(b);
+			b = next;
+		}
+		keep->next = nullptr;
+		if(keep->size > RETAIN_BYTES) {
+			free(keep);
+			blocks_ = nullptr;
+		}
+	}
+	if(blocks_) {
+		ptr_ = blocks_->Data();
+		end_ = ptr_ + blocks_->size;
+	} else {
+		ptr_ = inline_;
+		end_ = inline_ + INLINE_BYTES;
+	}
+	used_ = 0;
+}
@@ -0,0 +1,98 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <string>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h> // malloc, free
+
+/*按请求分配的线性内存池（bump allocator）。
+Allocate 只移动指针，释放是空操作，整个请求结束时 Reset 一次性回收。
+前 INLINE_BYTES 字节在对象内部，超过后向系统申请更大的块；Reset 保留最大的一块（不超过 RETAIN_BYTES），
+所以连接上的请求大小稳定之后不再调用 malloc。
+Reset 之后之前分配的内存全部失效，用到这块内存的容器必须在 Reset 之前销毁或清空到不持有内存。*/
+class Arena {
+public:
+	static const size_t INLINE_BYTES = 1024;
+	static const size_t RETAIN_BYTES = 64 * 1024; // Reset 后最多保留的块大小，更大的还给系统
+
+	Arena() = default;
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t size, size_t align = alignof(max_align_t));
+	void Reset();
+
+	size_t Used() const { return used_; } // 自上次 Reset 以来分配的字节数
+
+private:
+	struct Block {
+		Block* next;
+		size_t size; // 可用字节数，不含 Block 头
+		char* Data() { return reinterpret_cast<char*>(this + 1); }
+	};
+
+	void* Grow_(size_t size, size_t align); // 当前块不够：换到下一块或申请新块
+
+	alignas(max_align_t) char inline_[INLINE_BYTES];
+	char* ptr_ = inline_;
+	char* end_ = inline_ + INLINE_BYTES;
+	Block* blocks_ = nullptr; // 申请的块，最新的在前
+	size_t used_ = 0;
+};
+
+inline void* Arena::Allocate(size_t size, size_t align) {
+	uintptr_t p = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(uintptr_t)(align - 1);
+	if(p + size > reinterpret_cast<uintptr_t>(end_)) {
+		return Grow_(size, align);
+	}
+	ptr_ = reinterpret_cast<char*>(p + size);
+	used_ += size;
+	return reinterpret_cast<void*>(p);
+}
+
+// 标准库容器的分配器，同一个 Arena 的分配器相等
+template<class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {} // Reset 时统一回收
+
+	template<class U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena_; }
+	template<class U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena_; }
+
+private:
+	template<class U> friend class ArenaAllocator;
+	Arena* arena_;
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+// std::hash 只支持默认分配器的 string
+struct ArenaStringHash {
+	size_t operator()(const ArenaString& s) const {
+		size_t h = 14695981039346656037ull; // FNV-1a
+		for(unsigned char c : s) {
+			h = (h ^ c) * 1099511628211ull;
+		}
+		return h;
+	}
+};
+
+typedef std::unordered_map<ArenaString, ArenaString, ArenaStringHash, std::equal_to<ArenaString>,
+						   ArenaAllocator<std::pair<const ArenaString, ArenaString>>> ArenaStringMap;
+
+#endif // ARENA_H
@@ -0,0 +1,70 @@
+#include "bodysink.h"
+
+#include <errno.h>
+#include <stdlib.h> // mkstemp
+
+using namespace std;
+
+const char* SpoolSink::spoolDir = "/tmp";
+
+SpoolSink::~SpoolSink() {
+	if(fd_ >= 0) {
+		close(fd_);
+	}
+}
+
+void SpoolSink::Reset(size_t threshold) {
+	if(fd_ >= 0) {
+		close(fd_);
+		fd_ = -1;
+	}
+	data_.clear();
+	size_ = 0;
+	threshold_ = threshold;
+}
+
+bool SpoolSink::Write(const char* data, size_t len) {
+	size_ += len;
+	if(fd_ < 0 && size_ <= threshold_) {
+		data_.append(data, len);
+		return true;
+	}
+	if(fd_ < 0) {
+		// 第一次超过阈值：创建临时文件，先写入内存中已有的部分
+#ifdef O_TMPFILE
+		fd_ = open(spoolDir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+		if(fd_ < 0) { // 文件系统不支持 O_TMPFILE
+			string path = string(spoolDir) + "/webserver-body-XXXXXX";
+			fd_ = mkstemp(&path[0]);
+			if(fd_ >= 0) {
+				unlink(path.c_str());
+			}
+		}
+		if(fd_ < 0) {
+			LOG_ERROR("SpoolSink: create temp file in %s error: %d", spoolDir, errno);
+			return false;
+		}
+		if(!Spool_(data_.data(), data_.size())) {
+			return false;
+		}
+		string().swap(data_); // 释放内存
+	}
+	return Spool_(data, len);
+}
+
+bool SpoolSink::Spool_(const char* data, size_t len) {
+	while(len > 0) {
+		ssize_t n = write(fd_, data, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			LOG_ERROR("SpoolSink: write temp file error: %d", errno);
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef BODY_SINK_H
+#define BODY_SINK_H
+
+#include <string>
+#include <fcntl.h>	// open, O_TMPFILE
+#include <unistd.h>	// write, close
+
+#include "../log/log.h"
+
+/*请求体的接收者。
+请求体按到达的顺序分段交给 Write（数据指向读缓冲区，调用返回后就会被清除），收完后调用 Finish。
+Write/Finish 返回 false 表示无法接收，请求以 ErrorCode() 结束。*/
+class BodySink {
+public:
+	virtual ~BodySink() = default;
+	virtual bool Write(const char* data, size_t len) = 0;
+	virtual bool Finish() { return true; }
+
+	virtual int ErrorCode() const { return 500; } // Write/Finish 失败时回复的状态码
+	virtual size_t MaxBytes() const { return 0; } // 请求体上限，0 表示使用 HttpRequest::maxBodyBytes
+	// 按 Content-Length 接收时，可以把套接字中的请求体直接 splice 到这个文件，-1 表示不支持
+	virtual int SpliceFd() const { return -1; }
+	virtual void OnSpliced(size_t len) {} // 已经 splice 了 len 字节
+};
+
+/*默认的接收者：不超过 threshold 的请求体放在内存中，超过后全部写入临时文件（已 unlink，关闭即删除），
+一个请求占用的内存不超过 threshold。HttpRequest 在连接的各个请求之间复用同一个对象（Reset），内存中的缓冲区保留容量。*/
+class SpoolSink : public BodySink {
+public:
+	explicit SpoolSink(size_t threshold) : threshold_(threshold) {}
+	~SpoolSink() override;
+
+	bool Write(const char* data, size_t len) override;
+	void Reset(size_t threshold); // 关闭临时文件，清空内容，开始接收下一个请求体
+
+	bool IsSpooled() const { return fd_ >= 0; }
+	std::string& Data() { return data_; } // 没有写入文件时的内容
+	int Fd() const { return fd_; }		  // 临时文件，读之前需要 lseek 到开头
+	size_t Size() const { return size_; }
+
+	static const char* spoolDir; // 临时文件所在的目录
+
+private:
+	bool Spool_(const char* data, size_t len); // 写入临时文件
+
+	size_t threshold_;
+	std::string data_;
+	int fd_ = -1;
+	size_t size_ = 0;
+};
+
+#endif // BODY_SINK_H
@@ -0,0 +1,166 @@
+#include "eventstream.h"
+#include "httpconn.h"
+
+#include <algorithm> // find_if
+#include <assert.h>
+
+using namespace std;
+
+atomic<uint64_t> EventBroadcaster::nextKey_(0);
+
+EventStream::EventStream(HttpConn* conn, shared_ptr<EventStreamHandler> handler, const HttpRequest& request)
+	: conn_(conn), handler_(std::move(handler)), path_(request.path()),
+	  lastEventId_(request.Header(HeaderTable::LAST_EVENT_ID).str()), closed_(false), dropped_(0), opened_(false) {}
+
+EventStream::~EventStream() {
+	assert(subscriptions_.empty());
+}
+
+bool EventStream::Send(const Event& event, Policy policy, uint64_t key) {
+	if(closed_.load()) {
+		return false;
+	}
+	HttpConn::PushResult result = conn_->Push(event, policy == COALESCE ? HttpConn::PUSH_COALESCE : HttpConn::PUSH_DROP, key);
+	if(result == HttpConn::PUSH_DROPPED) {
+		dropped_++;
+	}
+	return result == HttpConn::PUSH_QUEUED || result == HttpConn::PUSH_COALESCED;
+}
+
+void EventStream::Close() {
+	if(!closed_.exchange(true)) {
+		conn_->Wake(); // 持有所有权的线程看到 Finished 后发完队列中的事件再断开
+	}
+}
+
+void EventStream::Open() {
+	opened_ = true;
+	handler_->OnOpen(*this);
+}
+
+bool EventStream::Parse(Buffer& buff) {
+	buff.RetrieveAll();
+	return true;
+}
+
+bool EventStream::Ping() {
+	static const Event PING_EVENT = make_shared<const string>(": ping\n\n");
+	conn_->Push(PING_EVENT, HttpConn::PUSH_DROP); // 队列中已经积压时不需要再探测
+	return false;
+}
+
+void EventStream::Closed() {
+	for(auto& sub : subscriptions_) {
+		sub.first->Remove_(sub.second, this);
+	}
+	subscriptions_.clear();
+	if(opened_) {
+		opened_ = false;
+		handler_->OnClose(*this);
+	}
+}
+
+// 字段值中不能有换行，event 和 id 在第一个换行处截断，避免注入别的字段
+static void AppendField_(string& out, const char* name, const string& value) {
+	out.append(name).append(value, 0, value.find_first_of("\r\n")).push_back('\n');
+}
+
+EventStream::Event EventStream::Format(const string& data, const string& event, const string& id) {
+	shared_ptr<string> out = make_shared<string>();
+	out->reserve(data.size() + event.size() + id.size() + 32);
+	if(!event.empty()) {
+		AppendField_(*out, "event: ", event);
+	}
+	if(!id.empty()) {
+		AppendField_(*out, "id: ", id);
+	}
+	// 每一行（\r\n、\r 或 \n 分隔）一个 data 字段，浏览器用 \n 连接起来
+	size_t begin = 0;
+	while(true) {
+		size_t end = data.find_first_of("\r\n", begin);
+		out->append("data: ").append(data, begin, end == string::npos ? string::npos : end - begin).push_back('\n');
+		if(end == string::npos) {
+			break;
+		}
+		begin = end + (data[end] == '\r' && end + 1 < data.size() && data[end + 1] == '\n' ? 2 : 1);
+	}
+	out->push_back('\n');
+	return out;
+}
+
+void EventBroadcaster::Subscribe(const string& topic, EventStream* stream, EventStream::Policy policy) {
+	{
+		lock_guard<mutex> locker(mtx_);
+		Topic& t = topics_[topic];
+		if(t.key == 0) {
+			t.key = ++nextKey_;
+		}
+		auto it = find_if(t.subscribers.begin(), t.subscribers.end(),
+						  [stream](const Subscriber& sub) { return sub.stream == stream; });
+		if(it != t.subscribers.end()) {
+			it->policy = policy;
+			return;
+		}
+		t.subscribers.push_back({stream, policy});
+	}
+	stream->subscriptions_.emplace_back(this, topic);
+}
+
+void EventBroadcaster::Unsubscribe(const string& topic, EventStream* stream) {
+	if(!Remove_(topic, stream)) {
+		return;
+	}
+	auto& subs = stream->subscriptions_;
+	for(auto it = subs.begin(); it != subs.end(); ++it) {
+		if(it->first == this && it->second == topic) {
+			subs.erase(it);
+			break;
+		}
+	}
+}
+
+bool EventBroadcaster::Remove_(const string& topic, EventStream* stream) {
+	lock_guard<mutex> locker(mtx_);
+	auto t = topics_.find(topic);
+	if(t == topics_.end()) {
+		return false;
+	}
+	vector<Subscriber>& subs = t->second.subscribers;
+	auto it = find_if(subs.begin(), subs.end(), [stream](const Subscriber& sub) { return sub.stream == stream; });
+	if(it == subs.end()) {
+		return false;
+	}
+	*it = subs.back(); // 顺序无关，和最后一个交换后删除
+	subs.pop_back();
+	if(subs.empty()) {
+		topics_.erase(t);
+	}
+	return true;
+}
+
+// 在锁内只把同一个 Event 的引用放进各个订阅者的发送队列，不编码、不写套接字
+size_t EventBroadcaster::Publish(const string& topic, const EventStream::Event& event) {
+	lock_guard<mutex> locker(mtx_);
+	auto t = topics_.find(topic);
+	if(t == topics_.end()) {
+		return 0;
+	}
+	size_t count = 0;
+	for(const Subscriber& sub : t->second.subscribers) {
+		count += sub.stream->Send(event, sub.policy, t->second.key);
+	}
+	return count;
+}
+
+size_t EventBroadcaster::Publish(const string& topic, const string& data, const string& event, const string& id) {
+	if(Subscribers(topic) == 0) {
+		return 0;
+	}
+	return Publish(topic, EventStream::Format(data, event, id));
+}
+
+size_t EventBroadcaster::Subscribers(const string& topic) {
+	lock_guard<mutex> locker(mtx_);
+	auto t = topics_.find(topic);
+	return t == topics_.end() ? 0 : t->second.subscribers.size();
+}
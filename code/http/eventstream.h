@@ -0,0 +1,117 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "streamsession.h"
+
+class HttpConn;
+class HttpRequest;
+class EventStreamHandler;
+class EventBroadcaster;
+
+/*Server-Sent Events（text/event-stream）：响应头发完后连接一直保持，之后不断追加事件，直到任何一方关闭。
+响应没有 Content-Length，以关闭连接结束；客户端不应再发来数据，收到的数据丢弃。
+事件编码成不可变、带引用计数的 Event 放入连接的发送队列，广播时所有订阅者共享同一个 Event。
+慢速的订阅者不会让内存增长：发送队列超过 HttpConn::lossyQueueBytes 之后新的事件被丢弃，
+或者（COALESCE）替换队列中还没发出的同一主题的事件，只保留最新的。*/
+class EventStream : public StreamSession {
+public:
+	typedef std::shared_ptr<const std::string> Event; // 编码好的事件，多个连接共享
+
+	// 积压时的处理方式
+	enum Policy {
+		DROP,     // 丢弃新的事件
+		COALESCE, // 同一主题还没发出的事件被新的替换，没有可替换的时丢弃
+	};
+
+	EventStream(HttpConn* conn, std::shared_ptr<EventStreamHandler> handler, const HttpRequest& request);
+	~EventStream() override;
+
+	// 任何线程都可以调用；连接已关闭、流已结束或事件被丢弃时返回 false。COALESCE 时 key 相同的事件互相替换
+	bool Send(const Event& event, Policy policy = DROP, uint64_t key = 0);
+	bool Send(const std::string& data, const std::string& event = "", const std::string& id = "") {
+		return Send(Format(data, event, id));
+	}
+	// 结束响应：已经放入队列的事件发完后断开；任何线程都可以调用
+	void Close();
+
+	HttpConn* Conn() const { return conn_; }
+	const std::string& Path() const { return path_; }
+	// 重连时浏览器带上的 Last-Event-ID，没有时为空；应用可以据此补发错过的事件
+	const std::string& LastEventId() const { return lastEventId_; }
+	uint64_t Dropped() const { return dropped_.load(); } // 因为积压被丢弃的事件数（不含被合并的）
+
+	// StreamSession
+	void Open() override;
+	bool Parse(Buffer& buff) override; // 丢弃客户端发来的数据
+	bool Finished() const override { return closed_.load(); }
+	bool Ping() override;              // 发出注释行 ": ping"，不需要回应，只为了让中间的代理不断开空闲连接
+	void Closed() override;
+
+	// 编码一个事件：可选的 "event:"、"id:"，data 中的每一行是一个 "data:" 字段，以空行结束
+	static Event Format(const std::string& data, const std::string& event = "", const std::string& id = "");
+
+private:
+	HttpConn* conn_;
+	std::shared_ptr<EventStreamHandler> handler_;
+	std::string path_;
+	std::string lastEventId_;
+	std::atomic<bool> closed_;
+	std::atomic<uint64_t> dropped_;
+	bool opened_;
+
+	// 订阅的主题，关闭时自动取消
+	std::vector<std::pair<EventBroadcaster*, std::string>> subscriptions_;
+
+	friend class EventBroadcaster;
+};
+
+// 应用的处理函数，注册在路由上（Router::AddEventStream），所有连接共用一个
+class EventStreamHandler {
+public:
+	virtual ~EventStreamHandler() = default;
+	// 响应头已发出；通常在这里订阅主题、补发 LastEventId 之后的事件
+	virtual void OnOpen(EventStream& stream) = 0;
+	virtual void OnClose(EventStream& stream) {}
+};
+
+/*按主题广播：每个事件只编码一次，每个订阅者的发送队列中只是多一个指向它的引用。
+Subscribe/Unsubscribe 在这个连接的回调中调用，连接关闭时自动取消；Publish 任何线程都可以调用。
+广播器要比订阅它的连接活得长（通常是处理函数的成员）。*/
+class EventBroadcaster {
+public:
+	void Subscribe(const std::string& topic, EventStream* stream, EventStream::Policy policy = EventStream::DROP);
+	void Unsubscribe(const std::string& topic, EventStream* stream);
+
+	// 返回接受了这个事件的订阅者数（包括合并了的），没有订阅者时不编码
+	size_t Publish(const std::string& topic, const std::string& data, const std::string& event = "", const std::string& id = "");
+	size_t Publish(const std::string& topic, const EventStream::Event& event);
+	size_t Subscribers(const std::string& topic);
+
+private:
+	struct Subscriber {
+		EventStream* stream;
+		EventStream::Policy policy;
+	};
+	struct Topic {
+		uint64_t key = 0; // 合并用的 key，所有广播器的所有主题各不相同（主题删除后重建也不同）
+		std::vector<Subscriber> subscribers;
+	};
+
+	bool Remove_(const std::string& topic, EventStream* stream);
+
+	std::mutex mtx_;
+	std::unordered_map<std::string, Topic> topics_; // 没有订阅者的主题被删除
+	static std::atomic<uint64_t> nextKey_;
+
+	friend class EventStream; // 关闭时调用 Remove_
+};
+
+#endif // EVENT_STREAM_H
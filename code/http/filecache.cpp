@@ -0,0 +1,138 @@
+#include "filecache.h"
+#include "httpresponse.h" // ContentType
+
+#include <fcntl.h>	   // open
+#include <unistd.h>	   // read, close
+#include <stdio.h>	   // snprintf
+#include <time.h>	   // gmtime_r, strftime
+
+using namespace std;
+
+FileCache* FileCache::Instance() {
+	static FileCache cache;
+	return &cache;
+}
+
+void FileCache::Init(size_t maxFileSize, size_t maxTotalSize, int revalidateMs, int maxAgeSec) {
+	lock_guard<mutex> locker(mtx_);
+	maxFileSize_ = maxFileSize;
+	maxTotalSize_ = maxTotalSize;
+	revalidate_ = chrono::milliseconds(revalidateMs);
+	maxAgeSec_ = maxAgeSec;
+	cache_.clear();
+	totalSize_ = 0;
+}
+
+FileCache::EntryPtr FileCache::Peek(const string& path) {
+	lock_guard<mutex> locker(mtx_);
+	auto it = cache_.find(path);
+	if(it == cache_.end() || LoopClock::Now() - it->second.checked > revalidate_) {
+		return nullptr;
+	}
+	return it->second.entry;
+}
+
+FileCache::EntryPtr FileCache::Get(const string& path, struct stat* result) {
+	auto now = LoopClock::Now();
+	EntryPtr old;
+	{
+		lock_guard<mutex> locker(mtx_);
+		auto it = cache_.find(path);
+		if(it != cache_.end()) {
+			if(now - it->second.checked <= revalidate_) {
+				return it->second.entry;
+			}
+			old = it->second.entry;
+		}
+	}
+	// 缓存过期或不存在：在锁外 stat，文件未变化时只刷新检查时间
+	struct stat st;
+	if(stat(path.data(), &st) < 0) {
+		st = {};
+	}
+	if(result) {
+		*result = st;
+	}
+	if(st.st_mode == 0 || S_ISDIR(st.st_mode) || !(st.st_mode & S_IROTH)
+	   || static_cast<size_t>(st.st_size) > maxFileSize_) {
+		if(old) {
+			lock_guard<mutex> locker(mtx_);
+			totalSize_ -= old->block.size();
+			cache_.erase(path);
+		}
+		return nullptr;
+	}
+	if(old && old->st.st_mtime == st.st_mtime && old->st.st_size == st.st_size
+	   && old->st.st_ino == st.st_ino) {
+		lock_guard<mutex> locker(mtx_);
+		cache_[path].checked = now;
+		return old;
+	}
+	EntryPtr entry = Load_(path, st);
+	if(!entry) {
+		return nullptr;
+	}
+	lock_guard<mutex> locker(mtx_);
+	auto it = cache_.find(path);
+	size_t oldSize = it != cache_.end() ? it->second.entry->block.size() : 0;
+	if(totalSize_ - oldSize + entry->block.size() > maxTotalSize_) {
+		// 缓存已满：不再缓存新文件，本次请求仍使用读入的内容
+		LOG_WARN("FileCache full, %s not cached", path.c_str());
+		return entry;
+	}
+	totalSize_ = totalSize_ - oldSize + entry->block.size();
+	cache_[path] = {entry, now};
+	return entry;
+}
+
+FileCache::EntryPtr FileCache::Load_(const string& path, const struct stat& st) {
+	int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return nullptr;
+	}
+	shared_ptr<Entry> entry = make_shared<Entry>();
+	entry->st = st;
+	BuildHeaders_(entry.get(), path, st.st_size);
+	entry->block.resize(entry->bodyOffset + st.st_size); // 文件内容直接读到响应头之后
+	size_t done = 0;
+	while(done < entry->BodySize()) {
+		ssize_t len = read(fd, &entry->block[entry->bodyOffset + done], entry->BodySize() - done);
+		if(len <= 0) {
+			break;
+		}
+		done += len;
+	}
+	close(fd);
+	if(done != entry->BodySize()) {
+		return nullptr; // 读取过程中文件被截断，下次再加载
+	}
+	LOG_DEBUG("FileCache load %s, %d bytes", path.c_str(), (int)done);
+	return entry;
+}
+
+void FileCache::BuildHeaders_(Entry* entry, const string& path, size_t size) const {
+	char buf[128];
+	snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (long)entry->st.st_ino, (long)entry->st.st_mtime, (long)size);
+	entry->etag = buf;
+	struct tm tm;
+	time_t mtime = entry->st.st_mtime;
+	gmtime_r(&mtime, &tm);
+	strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	entry->lastModified = buf;
+	if(maxAgeSec_ > 0) {
+		snprintf(buf, sizeof(buf), "Cache-Control: max-age=%d\r\n", maxAgeSec_);
+	} else {
+		snprintf(buf, sizeof(buf), "Cache-Control: no-cache\r\n");
+	}
+	string validators = "ETag: " + entry->etag + "\r\n"
+		+ "Last-Modified: " + entry->lastModified + "\r\n" + buf;
+
+	string& block = entry->block;
+	block = "HTTP/1.1 200 OK\r\n";
+	entry->statusLen = block.size();
+	block += "Content-type: " + HttpResponse::ContentType(path) + "\r\n";
+	block += "Content-length: " + to_string(size) + "\r\n";
+	block += validators + "\r\n";
+	entry->bodyOffset = block.size();
+	entry->notModified = validators + "\r\n";
+}
@@ -0,0 +1,70 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <sys/stat.h>  // stat
+
+#include "../log/log.h"
+#include "../timer/loopclock.h"
+
+/*小文件内存缓存。
+不超过 maxFileSize 的静态文件第一次访问时整个读入内存，之后的请求直接引用缓存内容，
+不再 stat/open/mmap。缓存项不可变，通过 shared_ptr 共享，响应写完之前一直有效。
+每个缓存项最多每 revalidateMs 毫秒 stat 一次检查文件是否被修改。
+加载时同时生成 200 和 304 响应中不随请求变化的部分，文件内容紧接在 200 的响应头之后，
+发送时只需要在状态行之后插入 Connection 等每个请求不同的响应头。*/
+class FileCache {
+public:
+	struct Entry {
+		// 200 响应：状态行 | 固定的响应头（类型、长度、校验器、缓存策略）、空行 | 文件内容，连续存放
+		std::string block;
+		size_t statusLen;		  // 状态行的长度，可变的响应头插在它之后
+		size_t bodyOffset;		  // 文件内容在 block 中的偏移
+		std::string notModified;  // 304 响应在可变的响应头之后的部分（校验器、缓存策略、空行）
+		std::string etag;		  // 带引号的强校验器，由大小、修改时间和 inode 生成
+		std::string lastModified; // 修改时间的 HTTP-date
+		struct stat st;			  // 加载时的文件状态
+
+		const char* Body() const { return block.data() + bodyOffset; }
+		size_t BodySize() const { return block.size() - bodyOffset; }
+	};
+	typedef std::shared_ptr<const Entry> EntryPtr;
+
+	static FileCache* Instance();
+
+	// maxAgeSec 为 0 时回复 Cache-Control: no-cache（浏览器每次用 ETag 确认），否则为 max-age
+	void Init(size_t maxFileSize = 64 * 1024, size_t maxTotalSize = 64 * 1024 * 1024, int revalidateMs = 1000, int maxAgeSec = 0);
+
+	// 查找并在需要时加载/重新验证，不可缓存（不存在、目录、不可读、过大）时返回 nullptr。
+	// 返回 nullptr 且 st 非空时，st 中是 stat 的结果（文件不存在时全部清零），调用者不需要再 stat 一次
+	EntryPtr Get(const std::string& path, struct stat* st = nullptr);
+	// 只查内存，不做任何文件 I/O；没有缓存或需要重新验证时返回 nullptr
+	EntryPtr Peek(const std::string& path);
+
+private:
+	FileCache() = default;
+
+	typedef std::chrono::steady_clock SteadyClock;
+	struct Node {
+		EntryPtr entry;
+		SteadyClock::time_point checked; // 上次确认文件未修改的时间
+	};
+
+	EntryPtr Load_(const std::string& path, const struct stat& st); // 把文件读入内存
+	void BuildHeaders_(Entry* entry, const std::string& path, size_t size) const; // 生成响应头模板
+
+	size_t maxFileSize_ = 64 * 1024;
+	size_t maxTotalSize_ = 64 * 1024 * 1024;
+	size_t totalSize_ = 0;
+	std::chrono::milliseconds revalidate_{1000};
+	int maxAgeSec_ = 0;
+
+	std::unordered_map<std::string, Node> cache_;
+	std::mutex mtx_;
+};
+
+#endif // FILE_CACHE_H
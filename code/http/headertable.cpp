@@ -0,0 +1,131 @@
+#include "headertable.h"
+
+#include <strings.h> // strncasecmp
+
+static constexpr const char* NAMES[HeaderTable::FIELD_COUNT] = {
+	"Host", "Connection", "Content-Length", "Content-Type", "Transfer-Encoding",
+	"Accept", "Accept-Encoding", "If-None-Match", "If-Modified-Since", "If-Range", "Range",
+	"Cookie", "User-Agent", "Referer", "Authorization", "Origin", "Expect",
+	"Upgrade", "Sec-WebSocket-Key", "Sec-WebSocket-Version", "Last-Event-ID",
+};
+
+/*完美哈希：只看长度、首字符和末字符（不区分大小写），32 个槽，常用的请求头互不冲突。
+槽表在编译期生成，增加请求头后如果冲突，编译时 static_assert 失败，需要调整系数。*/
+static const int SLOTS = 32;
+
+static constexpr char Lower_(char c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static constexpr size_t Length_(const char* s) {
+	size_t n = 0;
+	while(s[n]) {
+		n++;
+	}
+	return n;
+}
+
+static constexpr unsigned Hash_(const char* name, size_t len) {
+	return (len * 7 + Lower_(name[0]) * 28 + Lower_(name[len - 1])) & (SLOTS - 1);
+}
+
+struct SlotTable {
+	int8_t field[SLOTS];
+	uint8_t len[HeaderTable::FIELD_COUNT];
+	bool perfect;
+
+	constexpr SlotTable() : field(), len(), perfect(true) {
+		for(int i = 0; i < SLOTS; i++) {
+			field[i] = -1;
+		}
+		for(int f = 0; f < HeaderTable::FIELD_COUNT; f++) {
+			len[f] = Length_(NAMES[f]);
+			unsigned h = Hash_(NAMES[f], len[f]);
+			if(field[h] >= 0) {
+				perfect = false;
+			}
+			field[h] = f;
+		}
+	}
+};
+static constexpr SlotTable SLOT_TABLE;
+static_assert(SLOT_TABLE.perfect, "header name hash collision, adjust Hash_()");
+static_assert(HeaderTable::FIELD_COUNT <= 32, "present_ has 32 bits");
+
+bool HeaderTable::View::EqualsIgnoreCase(const char* s) const {
+	return data && strlen(s) == size && strncasecmp(data, s, size) == 0;
+}
+
+bool HeaderTable::View::StartsWithIgnoreCase(const char* s) const {
+	size_t n = strlen(s);
+	return data && n <= size && strncasecmp(data, s, n) == 0;
+}
+
+HeaderTable::Field HeaderTable::Lookup(const char* name, size_t len) {
+	if(len == 0) {
+		return UNKNOWN;
+	}
+	int f = SLOT_TABLE.field[Hash_(name, len)];
+	if(f >= 0 && SLOT_TABLE.len[f] == len && strncasecmp(NAMES[f], name, len) == 0) {
+		return static_cast<Field>(f);
+	}
+	return UNKNOWN;
+}
+
+const char* HeaderTable::Name(Field field) {
+	return field < FIELD_COUNT ? NAMES[field] : "";
+}
+
+void HeaderTable::Clear() {
+	block_.clear();
+	others_.clear();
+	present_ = 0;
+}
+
+HeaderTable::Span HeaderTable::Append_(const char* data, size_t len) {
+	Span span = {static_cast<uint32_t>(block_.size()), static_cast<uint32_t>(len)};
+	block_.append(data, len);
+	return span;
+}
+
+bool HeaderTable::Add(const char* name, size_t nameLen, const char* value, size_t valueLen) {
+	Field field = Lookup(name, nameLen);
+	if(field == UNKNOWN) {
+		Other other;
+		other.name = Append_(name, nameLen);
+		other.value = Append_(value, valueLen);
+		others_.push_back(other);
+		return true;
+	}
+	// 这几个请求头出现两次时，前后两级可能各取一个（请求走私、虚拟主机混淆）
+	if((present_ & (1u << field)) && (field == HOST || field == CONTENT_LENGTH || field == TRANSFER_ENCODING)) {
+		return false;
+	}
+	known_[field] = Append_(value, valueLen); // 其余的以最后一个为准
+	present_ |= 1u << field;
+	return true;
+}
+
+HeaderTable::View HeaderTable::Get(Field field) const {
+	if(field >= FIELD_COUNT || !(present_ & (1u << field))) {
+		return View();
+	}
+	return View_(known_[field]);
+}
+
+HeaderTable::View HeaderTable::Get(const char* name, size_t len) const {
+	Field field = Lookup(name, len);
+	if(field != UNKNOWN) {
+		return Get(field);
+	}
+	for(auto it = others_.rbegin(); it != others_.rend(); ++it) {
+		if(it->name.len == len && strncasecmp(block_.data() + it->name.offset, name, len) == 0) {
+			return View_(it->value);
+		}
+	}
+	return View();
+}
+
+size_t HeaderTable::Count() const {
+	return __builtin_popcount(present_) + others_.size();
+}
@@ -0,0 +1,85 @@
+#ifndef HEADER_TABLE_H
+#define HEADER_TABLE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+/*一个请求的请求头。
+常用的请求头在编译期生成的完美哈希表中查找（名称不区分大小写），值按枚举下标保存；其余的请求头放在一个小数组中。
+名称和值都追加到 block_ 中，表里只记偏移和长度。block_ 和数组在连接的各个请求之间复用，
+容量够用之后解析请求头不再分配内存。*/
+class HeaderTable {
+public:
+	// 常用的请求头，名称见 Name()
+	enum Field {
+		HOST,
+		CONNECTION,
+		CONTENT_LENGTH,
+		CONTENT_TYPE,
+		TRANSFER_ENCODING,
+		ACCEPT,
+		ACCEPT_ENCODING,
+		IF_NONE_MATCH,
+		IF_MODIFIED_SINCE,
+		IF_RANGE,
+		RANGE,
+		COOKIE,
+		USER_AGENT,
+		REFERER,
+		AUTHORIZATION,
+		ORIGIN,
+		EXPECT,
+		UPGRADE,
+		SEC_WEBSOCKET_KEY,
+		SEC_WEBSOCKET_VERSION,
+		LAST_EVENT_ID,
+		FIELD_COUNT,
+		UNKNOWN = FIELD_COUNT,
+	};
+
+	// 请求头的值，指向 block_，下一次 Add 之前有效
+	struct View {
+		const char* data = nullptr; // 为空表示没有这个请求头
+		size_t size = 0;
+
+		explicit operator bool() const { return data != nullptr; }
+		bool operator==(const char* s) const { return data && strlen(s) == size && memcmp(data, s, size) == 0; }
+		bool operator!=(const char* s) const { return !(*this == s); }
+		bool EqualsIgnoreCase(const char* s) const;
+		bool StartsWithIgnoreCase(const char* s) const;
+		std::string str() const { return data ? std::string(data, size) : std::string(); }
+	};
+
+	static Field Lookup(const char* name, size_t len); // 不是常用的请求头时返回 UNKNOWN
+	static const char* Name(Field field);
+
+	void Clear(); // 保留容量
+	// 添加一个请求头，返回 false 表示重复出现了不能重复的请求头（Host、Content-Length、Transfer-Encoding）
+	bool Add(const char* name, size_t nameLen, const char* value, size_t valueLen);
+
+	View Get(Field field) const;
+	View Get(const char* name, size_t len) const; // 任意名称，不区分大小写
+	size_t Count() const;
+
+private:
+	struct Span {
+		uint32_t offset;
+		uint32_t len;
+	};
+	struct Other {
+		Span name;
+		Span value;
+	};
+
+	Span Append_(const char* data, size_t len);
+	View View_(Span span) const { return View{block_.data() + span.offset, span.len}; }
+
+	std::string block_;			// 所有名称和值
+	uint32_t present_ = 0;		// 第 i 位表示 known_[i] 有效
+	Span known_[FIELD_COUNT];
+	std::vector<Other> others_; // 其余的请求头，按出现的顺序
+};
+
+#endif // HEADER_TABLE_H
@@ -1,14 +1,40 @@
 #include "httpconn.h"
+#include "websocket.h"
+#include "eventstream.h"
 using namespace std;
 
 const char* HttpConn::srcDir; // 源目录
 std::atomic<int> HttpConn::userCount; // 用户数量
 bool HttpConn::isET; // 是否使用ET模式	
+size_t HttpConn::ioBudget = 0; // 每一轮读写的字节配额，0 表示不限制
+int HttpConn::wakeFd = -1;
+size_t HttpConn::maxQueueBytes = 4 * 1024 * 1024; // 慢速的接收者最多积压 4MB
+size_t HttpConn::lossyQueueBytes = 256 * 1024; // 可以丢弃的事件最多积压 256KB，订阅者多时内存也有上限
+std::mutex HttpConn::wakeMtx_;
+std::vector<std::pair<HttpConn*, uint64_t>> HttpConn::woken_;
 
 HttpConn::HttpConn() {
 	fd_ = -1;
 	addr_ = {0};
 	isClose_ = true;
+	parseOk_ = false;
+	iovCnt_ = 0;
+	busy_ = false;
+	pending_ = false;
+	budgetHit_ = false;
+	turnBytes_ = 0;
+	spliceOff_ = false;
+	phase_ = IDLE;
+	phaseSince_ = 0;
+	streaming_ = false;
+	gen_ = 0;
+	pingSent_ = false;
+	opened_ = false;
+	started_ = false;
+	outBytes_ = 0;
+	outOpen_ = false;
+	wakePosted_ = false;
+	overflow_ = false;
 }
 
 HttpConn::~HttpConn() {
@@ -23,12 +49,47 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
 	writeBuff_.RetrieveAll(); // 清空写缓冲区
 	readBuff_.RetrieveAll(); // 清空读缓冲区
 	isClose_ = false; // 连接未关闭
+	iovCnt_ = 0; // 上一个连接可能没有写完
+	busy_ = false; // 新连接没有被任何线程处理
+	pending_ = false;
+	budgetHit_ = false;
+	turnBytes_ = 0;
+	spliceOff_ = false;
+	parseOk_ = false;
+	request_.Init(); // 上一个连接可能留下不完整的请求
+	request_.SetClient(addr); // 按客户端 IP 限流
+	session_.reset(); // 上一个连接已经离开所有组、取消了所有订阅，不会再被访问
+	streaming_ = false;
+	gen_++;
+	pingSent_ = false;
+	opened_ = false;
+	started_ = false;
+	sending_.clear();
+	{
+		lock_guard<mutex> locker(outMtx_);
+		out_.clear();
+		outBytes_ = 0;
+		outOpen_ = true;
+		wakePosted_ = false;
+		overflow_ = false;
+	}
+	SetPhase_(HEADERS); // 新连接应尽快发来第一个请求
 	LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
 	response_.UnmapFile(); // 关闭文件映射
 	if(isClose_ == false) {
+		{
+			lock_guard<mutex> locker(outMtx_);
+			outOpen_ = false; // 之后的 Push 失败，广播跳过这个连接
+			out_.clear();
+			outBytes_ = 0;
+		}
+		sending_.clear();
+		if(session_) {
+			session_->Closed(); // 离开所有组、取消订阅，调用 OnClose
+		}
 		isClose_ = true; // 连接关闭
 		userCount--; // 用户数量减1
 		close(fd_); // 关闭文件描述符
@@ -36,6 +97,12 @@ void HttpConn::Close() {
 	}
 }
 
+void HttpConn::SetPhase_(PHASE phase) {
+	phase_.store(phase);
+	phaseSince_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		LoopClock::Now().time_since_epoch()).count());
+}
+
 int HttpConn::GetFd() const {
 	return fd_;
 }
@@ -57,66 +124,402 @@ int HttpConn::GetPort() const {
  // 读取数据
 ssize_t HttpConn::read(int* saveErrno) {
 	ssize_t len = -1;
+	// 请求体是边收边交给接收者的，读缓冲区里已经有一个请求头加 READ_AHEAD 的数据时先解析，不再继续读。
+	// 没有解析的数据留在内核的接收缓冲区，TCP 窗口随之关闭，对端发送得比处理快时会被限速
+	size_t maxInput = HttpRequest::maxHeaderBytes + READ_AHEAD;
+	budgetHit_ = false;
+	if(readBuff_.ReadableBytes() >= maxInput) {
+		// 上次读到的（流水线上的）请求还没处理完：先不读，否则每次调用都再追加一段，读缓冲区无限增长
+		budgetHit_ = true;
+		*saveErrno = EAGAIN;
+		return -1;
+	}
 	do {
-		len = readBuff_.ReadFd(fd_, saveErrno); // 读取数据
+		// 按 Content-Length 接收的上传：读缓冲区中的数据都交出去之后，剩下的请求体不再经过用户态
+		size_t splice = readBuff_.ReadableBytes() == 0 && !spliceOff_ ? request_.SpliceableBytes() : 0;
+		len = splice > 0 ? Splice_(splice, saveErrno) : readBuff_.ReadFd(fd_, saveErrno); // 读取数据
 		if(len <= 0) {
 			break;
 		}
+		turnBytes_ += len;
+		if(TurnSpent()) { // 这一轮的配额用完，剩下的数据让给其他连接之后再读
+			budgetHit_ = true;
+			break;
+		}
+		if(readBuff_.ReadableBytes() >= maxInput) {
+			budgetHit_ = true;
+			break;
+		}
 	} while(isET); // 边缘触发模式 一次性全部读出
 	return len;
 }
 
+// 套接字 -> 管道 -> 文件，数据只在内核的页之间移动。管道每个线程一个，每次用完都是空的
+ssize_t HttpConn::Splice_(size_t want, int* saveErrno) {
+	static thread_local int pipeFd[2] = {-1, -1};
+	if(pipeFd[0] < 0 && pipe2(pipeFd, O_NONBLOCK | O_CLOEXEC) < 0) {
+		*saveErrno = errno;
+		return -1;
+	}
+	ssize_t len = splice(fd_, nullptr, pipeFd[1], nullptr, want < SPLICE_CHUNK ? want : SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if(len <= 0) {
+		*saveErrno = errno;
+		return len;
+	}
+	int fileFd = request_.Body()->SpliceFd();
+	ssize_t left = len;
+	while(left > 0) {
+		ssize_t n = splice(pipeFd[0], nullptr, fileFd, nullptr, left, SPLICE_F_MOVE);
+		if(n <= 0) {
+			// 文件系统不支持或写入出错：管道里的数据放回读缓冲区，按普通方式交给接收者（出错时由它回复错误）
+			LOG_WARN("Client[%d] splice to file error: %d, fall back to copying", fd_, errno);
+			spliceOff_ = true;
+			if(len > left) {
+				request_.OnSpliced(len - left);
+			}
+			int err = 0;
+			while(readBuff_.ReadFd(pipeFd[0], &err) > 0) {}
+			return len;
+		}
+		left -= n;
+	}
+	request_.OnSpliced(len);
+	return len;
+}
+
 // 写入数据 主要采用writev连续写函数
 ssize_t HttpConn::write(int* saveErrno) {
-	sseize_t len = -1; // 写入数据长度
+	ssize_t len = -1; // 写入数据长度
+	budgetHit_ = false;
 	do {
 		len = writev(fd_, iov_, iovCnt_); // 将iov的内容写到fd中
 		if(len <= 0) {
 			*saveErrno = errno; // 保存错误号
 			break;
 		}
-		if(iov_[0].iov_len + iov_[1].iov_len == 0) { // 读写缓冲区的长度为0，退出
-			break;
-			//static_cast 是 C++ 中的一种类型转换运算符，用于在编译时执行类型转换。它比 C 风格的类型转换更安全，因为它提供了更严格的类型检查。
-		} else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-			iov_[1].iov_base = (uint8_t*)iov_[1].iov_base + (len - iov_[0].iov_len); // 更新iov_[1]
-			iov_[1].iov_len -= (len - iov_[0].iov_len); // 更新iov_[1]的长度
-			if(iov_[0].iov_len) {
-				writeBuff_.RetrieveAll(); // 清空写缓冲区
-				iov_[0].iov_len = 0;
+		turnBytes_ += len;
+		// 按顺序消耗各个部分，写完的部分长度为 0
+		size_t left = len;
+		for(int i = 0; i < iovCnt_ && left > 0; i++) {
+			size_t n = left < iov_[i].iov_len ? left : iov_[i].iov_len;
+			iov_[i].iov_base = (uint8_t*)iov_[i].iov_base + n;
+			iov_[i].iov_len -= n;
+			left -= n;
+		}
+		if(ToWriteBytes() == 0) {
+			writeBuff_.RetrieveAll(); // 清空写缓冲区
+			if(!streaming_) {
+				SetPhase_(IDLE); // 响应发完，开始等待下一个请求
 			}
-		} else {
-			iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; // 更新iov_[0]
-			iov_[0].iov_len -= len; // 更新iov_[0]的长度
+			break;
+		}
+		if(TurnSpent()) { // 这一轮的配额用完，剩下的之后再写
+			budgetHit_ = true;
+			break;
 		}
 	}while(isET || ToWriteBytes() > 10240); // 边缘触发模式 或者 读写缓冲区的长度大于10240
 	return len;
 }
 // 处理请求
 bool HttpConn::process() {
-	request_.Init(); // 初始化请求
-	if(readBuff_.ReadableBytes() <= 0) { // 读缓冲区的长度小于等于0
+	if(!ParseRequest()) {
+		return false;
+	}
+	MakeResponse();
+	return true;
+}
+
+// 读缓冲区中是否为一个完整的 GET 请求（请求头以空行结束、没有请求体）
+bool HttpConn::IsReadOnlyRequest() const {
+	static const char METHOD[] = "GET ";
+	static const char END[] = "\r\n\r\n";
+	size_t len = readBuff_.ReadableBytes();
+	const char* begin = readBuff_.Peek();
+	if(len < sizeof(METHOD) - 1 || memcmp(begin, METHOD, sizeof(METHOD) - 1) != 0) {
 		return false;
 	}
-	if(request_.Parse(readBuff_)) { // 解析请求
+	return search(begin, begin + len, END, END + 4) != begin + len;
+}
+
+// 解析请求：请求可能分多次到达，解析状态保存在 request_ 中，直到请求完整或出错
+bool HttpConn::ParseRequest() {
+	if(request_.IsFinished() || request_.ErrorCode()) {
+		request_.Init(); // 上一个请求已处理完，开始解析新请求
+	}
+	// 读缓冲区的长度小于等于0；请求体是 splice 收下的时也要解析，以便结束请求体
+	if(readBuff_.ReadableBytes() <= 0 && request_.State() != HttpRequest::BODY) {
+		return false;
+	}
+	parseOk_ = request_.parse(readBuff_); // 解析请求
+	if(parseOk_ && !request_.IsFinished()) {
+		// 请求还不完整，等待更多数据；阶段改变时才重新计时，收到部分数据不延长截止时间
+		PHASE phase = request_.State() == HttpRequest::BODY ? BODY : HEADERS;
+		if(Phase() != phase) {
+			SetPhase_(phase);
+		}
+		return false;
+	}
+	SetPhase_(RESPONDING);
+	return true;
+}
+
+bool HttpConn::HasCachedResponse() {
+	if(!parseOk_ || !request_.IsFinished() || request_.HasHandler() || request_.IsWebSocket() || request_.IsEventStream()) {
+		return false;
+	}
+	cacheKey_.assign(srcDir).append(request_.path()); // 容量够用时不分配内存
+	return FileCache::Instance()->Peek(cacheKey_) != nullptr;
+}
+
+// 生成响应
+void HttpConn::MakeResponse() {
+	// 请求过大、被限流或请求体无法接收：回复预先生成的响应并关闭连接，不查找错误页面
+	size_t len = 0;
+	const char* fast = parseOk_ ? nullptr : HttpResponse::FastResponse(request_.ErrorCode(), &len);
+	if(fast) {
+		writeBuff_.RetrieveAll();
+		response_.UnmapFile();
+		HttpResponse::AddDate(writeBuff_);
+		size_t status = strstr(fast, "\r\n") + 2 - fast; // 状态行 | Date | 其余部分
+		iov_[0].iov_base = const_cast<char*>(fast); // 只用于 writev，不会被修改
+		iov_[0].iov_len = status;
+		iov_[1].iov_base = const_cast<char*>(writeBuff_.Peek());
+		iov_[1].iov_len = writeBuff_.ReadableBytes();
+		iov_[2].iov_base = const_cast<char*>(fast + status);
+		iov_[2].iov_len = len - status;
+		iovCnt_ = 3;
+		return;
+	}
+	if(parseOk_ && request_.IsWebSocket() && WebSocket::IsUpgradeRequest(request_)) {
+		// 握手：101 响应发完后 WebServer 调用 StartStream，之后的数据都是帧
+		HeaderTable::View key = request_.Header(HeaderTable::SEC_WEBSOCKET_KEY);
+		string accept = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+		accept.append(WebSocket::AcceptKey(key.data, key.size)).append("\r\n");
+		MakeStreamHead_(accept.c_str());
+		session_.reset(new WebSocket(this, request_.Route().route->ws));
+		LOG_DEBUG("Client[%d] upgrade to websocket: %s", fd_, request_.path().c_str());
+		return;
+	}
+	if(parseOk_ && request_.IsEventStream()) {
+		// 事件流：响应没有长度，以关闭连接结束；响应头发完后由处理函数追加事件
+		MakeStreamHead_("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+						"Connection: close\r\nX-Accel-Buffering: no\r\n");
+		session_.reset(new EventStream(this, request_.Route().route->events, request_));
+		LOG_DEBUG("Client[%d] event stream: %s", fd_, request_.path().c_str());
+		return;
+	}
+	if(parseOk_ && !request_.IsWebSocket()) {
 		LOG_DEBUG("%s", request_.path().c_str());
-		response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200); // 初始化响应
+		int code = 200;
+		if(request_.HasHandler()) { // 路由的处理函数，可能修改要返回的文件
+			const Router::Match& route = request_.Route();
+			int ret = route.route->handler(request_, route.params);
+			code = ret == -1 ? code : ret;
+		}
+		response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), code); // 初始化响应
+		response_.SetConditional(request_.Header(HeaderTable::IF_NONE_MATCH), request_.Header(HeaderTable::IF_MODIFIED_SINCE));
 	} else {
-		response_.Init(srcDir, request_.path(), false, 400); // 初始化响应
+		// 请求有错误（400/405 等，以及 WebSocket 路由上不合法的升级请求），回复预先加载的错误页面并关闭连接
+		int code = request_.ErrorCode() ? request_.ErrorCode() : 400;
+		response_.Init(srcDir, request_.path(), false, code); // 初始化响应
+		response_.SetAllowed(request_.Allowed());
 	}
 
+	response_.SetHeadOnly(request_.method() == "HEAD"); // 响应头与 GET 相同，不发送内容
+	writeBuff_.RetrieveAll(); // 清掉上一个响应残留的数据
 	response_.MakeResponse(writeBuff_); // 生成响应
-	// 响应头
-	iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek()); // 读写缓冲区的头
-	iov_[0].iov_len = writeBuff_.ReadableBytes(); // 读写缓冲区的长度
-	iovCnt_ = 1; // 读写缓冲区的数量
-
-	// 文件
-	if(response_.FileLen() > 0 && response_.File()) { // 文件长度大于0 并且 文件存在
-		iov_[1].iov_base = response_.File(); // 读写缓冲区的第二部分
-		iov_[1].iov_len = response_.FileLen(); // 读写缓冲区的第二部分的长度
-		iovCnt_ = 2; // 读写缓冲区的数量
+	// 缓存的文件：模板的状态行 | 可变的响应头 | 模板的其余响应头和文件内容，一次 writev 发出；
+	// 其余情况：响应头 | 映射的文件
+	size_t len0 = 0, len2 = 0;
+	const char* head = response_.Head(&len0);
+	const char* tail = response_.Tail(&len2);
+	iovCnt_ = 0;
+	if(len0 > 0) {
+		iov_[iovCnt_].iov_base = const_cast<char*>(head); // 只用于 writev，不会被修改
+		iov_[iovCnt_++].iov_len = len0;
+	}
+	iov_[iovCnt_].iov_base = const_cast<char*>(writeBuff_.Peek()); // 读写缓冲区的头
+	iov_[iovCnt_++].iov_len = writeBuff_.ReadableBytes(); // 读写缓冲区的长度
+	if(len2 > 0) {
+		iov_[iovCnt_].iov_base = const_cast<char*>(tail);
+		iov_[iovCnt_++].iov_len = len2;
 	}
 	LOG_DEBUG("filesize:%d, %d to %d", response_.FileLen(), iovCnt_, ToWriteBytes());
+}
+
+void HttpConn::MakeStreamHead_(const char* head) {
+	writeBuff_.RetrieveAll();
+	response_.UnmapFile();
+	writeBuff_.Append(head);
+	HttpResponse::AddDate(writeBuff_);
+	writeBuff_.Append("\r\n");
+	iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
+	iov_[0].iov_len = writeBuff_.ReadableBytes();
+	iovCnt_ = 1;
+}
+
+void HttpConn::StartStream() {
+	assert(session_ && ToWriteBytes() == 0);
+	iovCnt_ = 0;
+	pingSent_ = false;
+	SetPhase_(STREAMING);
+	started_ = true;
+	streaming_ = true;
+	Wake();
+}
+
+HttpConn::PushResult HttpConn::Push(const Slice& slice, PushMode mode, uint64_t key) {
+	PushResult result = PUSH_QUEUED;
+	{
+		lock_guard<mutex> locker(outMtx_);
+		if(!outOpen_ || overflow_) {
+			return PUSH_CLOSED;
+		}
+		if(mode == PUSH_COALESCE && key != 0) {
+			// 还没发出的同一个 key 的段换成新的：积压的订阅者只收到最新的状态。
+			// 队列的字节数有上限，段的个数也就有限，从新往旧找
+			for(auto it = out_.rbegin(); it != out_.rend(); ++it) {
+				if(it->key == key) {
+					outBytes_ = outBytes_ - it->slice->size() + slice->size();
+					it->slice = slice;
+					return PUSH_COALESCED; // 这个连接已经在等待处理，不需要唤醒
+				}
+			}
+		}
+		if(mode == PUSH_CLOSE && outBytes_ + slice->size() > maxQueueBytes) {
+			// 接收得太慢：不再积压，唤醒连接让它断开
+			overflow_ = true;
+			result = PUSH_CLOSED;
+			LOG_WARN("Client[%d] send queue overflow (%d bytes), closing", fd_, (int)outBytes_);
+		} else if(mode != PUSH_CLOSE && outBytes_ + slice->size() > lossyQueueBytes) {
+			return PUSH_DROPPED; // 已经积压，丢弃新的一段，连接照常发送队列中的数据
+		} else {
+			out_.push_back({slice, mode == PUSH_COALESCE ? key : 0});
+			outBytes_ += slice->size();
+		}
+		if(wakePosted_) {
+			return result; // 同一个连接在被处理之前只唤醒一次
+		}
+		wakePosted_ = true;
+	}
+	WakePost_();
+	return result;
+}
+
+void HttpConn::Wake() {
+	{
+		lock_guard<mutex> locker(outMtx_);
+		if(wakePosted_) {
+			return;
+		}
+		wakePosted_ = true;
+	}
+	WakePost_();
+}
+
+// 反应堆线程处理之前的多次唤醒只写一次 eventfd，广播给大量连接时不会每个连接一次系统调用
+void HttpConn::WakePost_() {
+	bool first;
+	{
+		lock_guard<mutex> locker(wakeMtx_);
+		first = woken_.empty();
+		woken_.emplace_back(this, gen_.load());
+	}
+	uint64_t one = 1;
+	if(first && wakeFd >= 0 && ::write(wakeFd, &one, sizeof(one)) < 0) {
+		LOG_WARN("write wake fd error: %d", errno);
+	}
+}
+
+void HttpConn::TakeWoken(vector<pair<HttpConn*, uint64_t>>* woken) {
+	woken->clear();
+	lock_guard<mutex> locker(wakeMtx_);
+	woken->swap(woken_);
+}
+
+bool HttpConn::HasOutput() {
+	if(ToWriteBytes() > 0) {
+		return true;
+	}
+	lock_guard<mutex> locker(outMtx_);
+	return !out_.empty();
+}
+
+// 一次 writev 发出队列前面的若干段，段本身不复制
+void HttpConn::FillIov_() {
+	sending_.clear();
+	iovCnt_ = 0;
+	lock_guard<mutex> locker(outMtx_);
+	while(!out_.empty() && iovCnt_ < MAX_IOV) {
+		Slice& slice = out_.front().slice;
+		outBytes_ -= slice->size();
+		iov_[iovCnt_].iov_base = const_cast<char*>(slice->data()); // 只用于 writev，不会被修改
+		iov_[iovCnt_++].iov_len = slice->size();
+		sending_.push_back(std::move(slice)); // 放入 iov_ 之后不再参与合并
+		out_.pop_front();
+	}
+}
+
+bool HttpConn::Stream() {
+	assert(session_ && streaming_);
+	BeginTurn(); // 每次调用是一轮
+	if(!opened_) {
+		opened_ = true;
+		session_->Open();
+	}
+	{
+		lock_guard<mutex> locker(outMtx_);
+		wakePosted_ = false; // 从这里开始新放入的数据会再次唤醒
+		if(overflow_) {
+			return false;
+		}
+	}
+	int readErrno = 0;
+	ssize_t len = read(&readErrno);
+	bool eof = len == 0 || (len < 0 && readErrno != EAGAIN);
+	bool readHit = budgetHit_;
+	bool open = true;
+	if(readBuff_.ReadableBytes() > 0) {
+		SetPhase_(STREAMING); // 对方还在：空闲时间从现在重新计算
+		pingSent_ = false;
+		open = session_->Parse(readBuff_);
+	}
+	if(eof) {
+		return false;
+	}
+	// 发送队列：每轮（连同上面读到的）最多 ioBudget 字节，其余留给下一轮，避免一个连接独占工作线程
+	bool writeHit = false;
+	while(true) {
+		if(ToWriteBytes() == 0) {
+			FillIov_();
+		}
+		if(ToWriteBytes() == 0) {
+			break;
+		}
+		int writeErrno = 0;
+		len = write(&writeErrno);
+		if(len < 0 && writeErrno != EAGAIN) {
+			return false;
+		}
+		if(ToWriteBytes() > 0) {
+			writeHit = budgetHit_;
+			break; // 套接字写满，等待可写
+		}
+		if(TurnSpent()) {
+			writeHit = HasOutput();
+			break;
+		}
+	}
+	budgetHit_ = readHit || writeHit;
+	// 会话结束（关闭握手完成、协议错误、事件流被关闭）且队列中的数据已发出：断开
+	return (open && !session_->Finished()) || HasOutput();
+}
+
+bool HttpConn::Heartbeat() {
+	if(pingSent_) {
+		return false;
+	}
+	pingSent_ = session_->Ping(); // 事件流的探测不需要回应，之后照常每个空闲超时探测一次
+	SetPhase_(STREAMING); // 等待回应的时间也是一个空闲超时
 	return true;
 }
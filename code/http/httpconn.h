@@ -3,32 +3,113 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <fcntl.h>       // splice
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
 
 #include "../log/log.h"
 #include "../buffer/buffer.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "filecache.h"
+#include "streamsession.h"
+#include "../timer/loopclock.h"
 /*
 进行读写数据并调用httprequest 来解析数据以及httpresponse来生成响应
 */
 class HttpConn {
+public:
+	// 连接所处的阶段，决定适用哪个超时：
+	// HEADERS/BODY 从阶段开始计时、收到数据也不延长（防止慢速攻击），RESPONDING/IDLE 在有进展时延长
+	enum PHASE {
+		IDLE,       // 长连接上一个响应已发完，等待下一个请求
+		HEADERS,    // 正在接收请求行和请求头
+		BODY,       // 正在接收请求体
+		RESPONDING, // 请求已完整，正在生成或发送响应
+		STREAMING,  // 已升级为 WebSocket 或正在发送事件流：一直保持，从最近一次收到数据（或探测）开始计算空闲时间
+	};
+
+	typedef std::shared_ptr<const std::string> Slice; // 发送队列中的一段数据，可以被多个连接共享
+
+	// 发送队列积压时如何处理新的一段
+	enum PushMode {
+		PUSH_CLOSE,    // 超过 maxQueueBytes 时断开连接（WebSocket：消息不能丢）
+		PUSH_DROP,     // 超过 lossyQueueBytes 时丢弃这一段
+		PUSH_COALESCE, // 替换队列中还没发出的 key 相同的一段，没有时按 PUSH_DROP
+	};
+	// Push 的结果
+	enum PushResult {
+		PUSH_QUEUED,
+		PUSH_COALESCED,
+		PUSH_DROPPED,
+		PUSH_CLOSED, // 连接已关闭，或者因为积压将要断开
+	};
+
 private:
 	int fd_; // socket文件描述符
 	struct sockaddr_in addr_; // 客户端地址
 
 	bool isClose_; // 是否关闭连接
 
+	static const int MAX_IOV = 16; // 流式发送时一次 writev 最多的段数
+
 	int iovCnt_; // 读写缓冲区的数量
-	struct iovec iov_[2]; // 读写缓冲区
+	struct iovec iov_[MAX_IOV]; // 响应的 Head()、写缓冲区、Tail()，长度为 0 的部分不放入；流式发送时是队列中的各段
 
 	Buffer readBuff_; // 读缓冲区
 	Buffer writeBuff_; // 写缓冲区
 
 	HttpRequest request_; // 请求
 	HttpResponse response_; // 响应
+	std::string cacheKey_; // HasCachedResponse 查缓存用的完整路径，复用容量
+	bool parseOk_; // 最近一次解析是否成功
+
+	// 连接的所有权，只在事件持久注册（不使用 EPOLLONESHOT）时使用
+	std::atomic<bool> busy_; // 是否有线程正在处理这个连接
+	std::atomic<bool> pending_; // 处理期间是否又来了事件
+
+	bool budgetHit_; // 最近一次 read/write 因为字节配额用完而提前返回（还有数据没读/写完）
+	size_t turnBytes_; // 这一轮（一个线程从拿到连接到重新排队）已读写的字节数，和 ioBudget 比较
+
+	bool spliceOff_; // splice 写文件失败过，这个连接之后的请求体都复制到读缓冲区
+	ssize_t Splice_(size_t want, int* saveErrno); // 请求体从套接字直接 splice 到接收者的文件
+
+	std::atomic<int> phase_; // PHASE，工作线程写、反应堆线程（定时器）读
+	std::atomic<int64_t> phaseSince_; // 进入当前阶段（或响应最近一次有进展）的时间，steady_clock 纳秒
+	void SetPhase_(PHASE phase);
+
+	// 升级后的流式连接。发送队列可以被任何线程追加（Push），只由持有所有权的线程取出发送
+	std::unique_ptr<StreamSession> session_; // WebSocket 或 EventStream
+	std::atomic<bool> streaming_; // 反应堆线程据此把事件交给 DealEvent_ 的所有权判断
+	std::atomic<uint64_t> gen_;   // 每次 init 加 1，唤醒时据此忽略已经换了连接的 fd
+	bool pingSent_;               // 已发出 ping，还没有收到数据
+	bool opened_;                 // 已调用 OnOpen
+	std::atomic<bool> started_;   // StartStream 之后反应堆线程还没有设置流式连接的定时器
+
+	std::mutex outMtx_;
+	struct Pending {
+		Slice slice;
+		uint64_t key; // PUSH_COALESCE 的 key，0 表示不参与合并
+	};
+	std::deque<Pending> out_; // 待发送的段
+	size_t outBytes_;         // out_ 中的字节数
+	bool outOpen_;            // 是否接受 Push，连接关闭后为 false
+	bool wakePosted_;         // 已经请求反应堆线程处理这个连接，还没有开始处理
+	bool overflow_;           // 发送队列超过上限，连接要断开
+	std::vector<Slice> sending_; // 已放入 iov_ 的段，发完之前保持引用
+
+	void FillIov_(); // 从 out_ 取出若干段放入 iov_
+	void MakeStreamHead_(const char* head); // 流式响应的响应头：head | Date | 空行
+	void WakePost_(); // 记入唤醒列表，列表从空变为非空时写 wakeFd
+
+	static std::mutex wakeMtx_;
+	static std::vector<std::pair<HttpConn*, uint64_t>> woken_; // 需要处理发送队列的连接
 public:
 	HttpConn();
 	~HttpConn();
@@ -41,19 +122,104 @@ public:
 	int GetPort() const; // 获取端口
 	const char* GetIP() const; // 获取IP地址
 	sockaddr_in GetAddr() const; // 获取地址
-	bool process(); // 处理请求
+	bool process(); // 处理请求：解析并生成响应
+
+	// 以下把 process 拆成两步，供反应堆线程的快速路径使用
+	bool HasInput() const { return readBuff_.ReadableBytes() > 0; } // 读缓冲区中是否有未处理的数据
+	bool IsReadOnlyRequest() const; // 读缓冲区中是完整的 GET 请求（不会访问数据库）
+	bool ParseRequest(); // 解析请求，没有数据或请求还不完整时返回 false
+	bool HasCachedResponse(); // 解析出的资源是否已在内存缓存中（不做文件 I/O）
+	void MakeResponse(); // 生成响应并设置 iov
+
+	// 以下用于升级后的流式连接（WebSocket）
+	bool IsStreamPending() const { return session_ && !streaming_.load(); } // 101（或事件流的响应头）已生成，发完后调用 StartStream
+	bool IsStreaming() const { return streaming_.load(); }
+	uint64_t Generation() const { return gen_.load(); }
+	// 进入 STREAMING 阶段并唤醒反应堆线程，由它设置定时器、把连接交给线程池；调用者随后放弃所有权
+	void StartStream();
+	// 反应堆线程调用：StartStream 之后第一次返回 true
+	bool TakeStarted() { return started_.exchange(false); }
+	// 读取并处理到达的帧，发送队列中的数据；返回 false 表示连接应关闭。第一次调用时调用处理函数的 OnOpen
+	bool Stream();
+	bool HasOutput(); // 还有没发完的数据，需要等待可写
+	// 追加一段要发送的数据，任何线程都可以调用；积压时按 mode 处理
+	PushResult Push(const Slice& slice, PushMode mode = PUSH_CLOSE, uint64_t key = 0);
+	// 请求反应堆线程处理这个连接（例如会话已结束），任何线程都可以调用；处理之前的多次唤醒合并为一次
+	void Wake();
+	// 空闲超时：还没有等待回应的探测时发出探测（WebSocket 的 ping、事件流的注释行）并返回 true，否则（对方没有回应）返回 false
+	bool Heartbeat();
+	// 反应堆线程取出被 Push 唤醒的连接，eventfd 可读时调用
+	static void TakeWoken(std::vector<std::pair<HttpConn*, uint64_t>>* woken);
 
 	// 写的总长度
 	int ToWriteBytes() {
-		return iov_[0].iov_len + iov_[1].iov_len; // 读写缓冲区的长度
+		size_t len = 0;
+		for(int i = 0; i < iovCnt_; i++) {
+			len += iov_[i].iov_len; // 读写缓冲区的长度
+		}
+		return len;
+	}
+	// 收到事件时调用：返回 true 表示由调用者处理；false 表示已有线程在处理，事件已记下
+	bool Acquire() {
+		pending_.store(true);
+		if(busy_.exchange(true)) {
+			return false;
+		}
+		pending_.store(false);
+		return true;
+	}
+	// 处理结束时调用：返回 true 表示已放弃所有权；false 表示处理期间来了新事件，调用者仍持有所有权，需要接着处理
+	bool Release() {
+		busy_.store(false);
+		if(pending_.load() && !busy_.exchange(true)) {
+			pending_.store(false);
+			return false;
+		}
+		return true;
+	}
+
+	// 最近一次 read/write 是否因为配额提前返回，调用者需要把连接重新排队
+	bool IoBudgetHit() const {
+		return budgetHit_;
+	}
+	// 线程拿到连接时调用：读、解析、写出响应、再读下一个请求，整轮共用 ioBudget 字节的配额
+	void BeginTurn() {
+		turnBytes_ = 0;
+	}
+	// 这一轮的配额是否已经用完
+	bool TurnSpent() const {
+		return ioBudget > 0 && turnBytes_ >= ioBudget;
+	}
+
+	bool IsClose() const {
+		return isClose_; // 连接是否已关闭
 	}
 	bool IsKeepAlive() const {
-		return request_.IsKeepAlive(); // 检查连接是否保持活动状态
+		return parseOk_ && request_.IsKeepAlive(); // 检查连接是否保持活动状态，请求有错误时不保持
+	}
+
+	PHASE Phase() const {
+		return static_cast<PHASE>(phase_.load());
+	}
+	LoopClock::TimePoint PhaseSince() const {
+		return LoopClock::TimePoint(std::chrono::nanoseconds(phaseSince_.load()));
+	}
+	// 响应有进展时调用：RESPONDING 阶段从现在重新计时
+	void Touch() {
+		if(Phase() == RESPONDING) {
+			SetPhase_(RESPONDING);
+		}
 	}
 
+	static const size_t READ_AHEAD = 64 * 1024; // 请求头之外最多预读的字节数
+	static const size_t SPLICE_CHUNK = 64 * 1024; // 每次 splice 的字节数，不超过管道的默认容量
 	static bool isET; // 是否使用ET模式
+	static size_t ioBudget; // 每一轮最多读写的字节数，0 表示不限制（读到/写到 EAGAIN）
 	static const char* srcDir; // 源目录
 	static std::atomic<int> userCount; // 用户数量 原子操作
+	static int wakeFd; // eventfd，Push 写入后反应堆线程处理被唤醒的连接；-1 表示没有（测试中）
+	static size_t maxQueueBytes; // 每个流式连接的发送队列上限（PUSH_CLOSE）
+	static size_t lossyQueueBytes; // 超过时 PUSH_DROP/PUSH_COALESCE 的新数据被丢弃
 };
 
 #endif // HTTP_CONN_H
\ No newline at end of file
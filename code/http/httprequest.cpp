@@ -1,246 +1,416 @@
 #include "httprequest.h"
 using namespace std;
 
-// 网页名称，和一般的前端跳转不同，这里需要将请求信息放到后端来验证一遍再上传
-/*定义并初始化了 HttpRequest 类的一个静态常量成员 DEFAULT_HTML。
-DEFAULT_HTML 是一个 unordered_set<string> 类型的集合，包含了一些默认的 HTML 路径。*/
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-    "/index",
-    "/register",
-    "/login",
-    "/welcome",
-    "/video",
-    "/picture",
-};
-
-// 登录/注册
-// 定义并初始化了 HttpRequest 类的一个静态常量成员 DEFAULT_HTML_TAG。
-const unordered_map<string &> HttpRequest::DEFAULT_HTML_TAG{
-    {"/login.html", 1}, {"/register.html", 0}};
+size_t HttpRequest::maxHeaderBytes = 8 * 1024;
+size_t HttpRequest::maxHeaderCount = 64;
+size_t HttpRequest::maxBodyBytes = 1024 * 1024;
+size_t HttpRequest::spoolThreshold = 64 * 1024;
 
 // 初始化操作，一些清零操作
 void HttpRequest::Init()
 {
     state_ = REQUEST_LINE;                   // 初始状态
     method_ = path_ = version_ = body_ = ""; // 初始化 method_、path_、version_ 和 body_ 为空字符串。
-    header_.clear();                         // 清空 header_。
-    post_.clear();                           // 清空 post_。
+    header_.Clear();                         // 清空 header_，保留容量
+    route_ = Router::Match();                // 清空路由
+    // 先让 post_ 放下 arena_ 中的节点和桶，再回收 arena_；上一个请求的表单到此失效
+    post_ = ArenaStringMap(ArenaAllocator<char>(&arena_));
+    arena_.Reset();
+    headerBytes_ = headerCount_ = contentLength_ = 0;
+    bodyState_ = BODY_DATA;
+    bodyRemaining_ = bodyBytes_ = bodyLimit_ = 0;
+    sink_ = nullptr;
+    routeSink_.reset();           // 关闭上一个请求的文件
+    spool_.Reset(spoolThreshold); // 关闭上一个请求的临时文件
+    errorCode_ = 0;
+    allowed_ = 0;
+}
+
+bool HttpRequest::Fail_(int code)
+{
+    errorCode_ = code;
+    LOG_WARN("Request error %d: header %d bytes, %d fields, body %d/%d bytes",
+             code, (int)headerBytes_, (int)headerCount_, (int)bodyBytes_, (int)contentLength_);
+    return false;
 }
 
 // 解析处理
-bool HttpRequest::parse_(Buffer &buff)
+bool HttpRequest::parse(Buffer &buff)
 {
-    const char END[] = "\r\n";     // 定义了一个字符串 END，内容为 "\r\n"。
-    if (buff.ReadableBytes() == 0) // 如果 buff 中没有可读的字节，返回 false。
+    if (errorCode_)
+    {
         return false;
-    // 读取数据开始
-    while (buff.ReadableBytes() && state_ != FINISH)
+    }
+    while (state_ != FINISH)
     {
-        // 从 buff 中的读指针开始到读指针结束，这块区域是未读取的数据并去除 "\r\n"，返回有效数据的行末指针。
-        const char *lineend = search(buff.Peek(), buff.BeginWriteConst(), END, END + 2); // 查找 buff 中的 "\r\n"。
-        string line(buff.Peek(), lineend);                                               // 从 buff 中读取数据到 line 中。构造函数 string 将从 buff.Peek() 指向的位置开始，直到 lineend 指向的位置为止，创建一个新的字符串对象。
-        switch (state_)
+        if (state_ == BODY)
         {
-        case REQUEST_LINE:
-            // 解析错误
-            if (!ParseRequestLine_(line))
-            { // 调用 ParseRequestLine_ 方法解析请求行，如果解析失败，返回 false。
+            // 请求体到达多少交给接收者多少，读缓冲区中不会积累整个请求体
+            if (!ParseBody_(buff))
+            {
                 return false;
             }
-            ParsePath_(); // 解析路径
             break;
-        case HEADERS:
-            ParseHeader_(line); // 调用 ParseHeader_ 方法解析请求头。
-            if (buff.ReadableBytes() <= 2)
-            {                    // 如果 buff 中的可读字节数小于等于 2，说明是 GET 请求，后面为 "\r\n"。
-                state_ = FINISH; // 状态转换为 FINISH。
+        }
+        // 从读指针开始查找 "\r\n"，没有找到说明这一行还没有收完，等待更多数据
+        const char *lineend = HttpScan::FindCrlf(buff.Peek(), buff.BeginWriteConst());
+        if (lineend == buff.BeginWriteConst())
+        {
+            if (headerBytes_ + buff.ReadableBytes() > maxHeaderBytes)
+            {
+                return Fail_(431); // 不完整的一行已经超过上限，不再等待
             }
             break;
-        case BODY:
-            ParseBody_(line); // 调用 ParseBody_ 方法解析请求体。
-            break;
-        default:
-            break;
         }
-        if (linnend == buff.BeginWrite())
-        {                       // 如果 lineend 指向 buff 的 BeginWrite()，说明读完了。
-            buff.RetrieveAll(); // 重置 buff。
-            break;
+        headerBytes_ += lineend + 2 - buff.Peek();
+        if (headerBytes_ > maxHeaderBytes)
+        {
+            return Fail_(431);
+        }
+        const char *line = buff.Peek(); // 一行（不含 "\r\n"），解析完再从 buff 中取走
+        bool ok = true;
+        if (state_ == REQUEST_LINE)
+        {
+            // 请求之前的空行忽略（RFC 7230 3.5）
+            if (line != lineend)
+            {
+                ok = (ParseRequestLine_(line, lineend) || Fail_(400)) && ParsePath_(); // 解析路径
+            }
+        }
+        else
+        {
+            ok = ParseHeader_(line, lineend);
         }
         buff.RetrieveUntil(lineend + 2); // 跳过回车换行。
+        if (!ok)
+        {
+            return false;
+        }
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
     return true;
 }
 
-// 解析请求行
-bool HttpRequest::ParseRequestLine_(const string &line)
+// 路径中是否有 ".." 段：有的话可以访问资源目录之外的文件（上传目录、源代码等）
+static bool HasDotDot_(const char *begin, const char *end)
 {
-    /*正则表达式 ^([^ ]*) ([^ ]*) HTTP/([^ ]*)$ 可以分解为以下几个部分：
-    ^：表示匹配字符串的开始。
+    for (const char *p = begin; p < end;)
+    {
+        const char *slash = HttpScan::FindChar(p, end, '/');
+        if (slash - p == 2 && p[0] == '.' && p[1] == '.')
+        {
+            return true;
+        }
+        if (slash == end)
+        {
+            break;
+        }
+        p = slash + 1;
+    }
+    return false;
+}
 
-    ( 和 )：圆括号用于定义一个捕获组。捕获组会保存匹配的子字符串，以便后续引用或处理。
-    [^ ]：方括号内的 ^ 表示取反，[^ ] 表示匹配任何不是空格的字符。
-    *：星号表示匹配前面的模式零次或多次。因此，[^ ]* 表示匹配零个或多个非空格字符。
+// 解析请求行："方法 路径 HTTP/版本"，各部分之间只有一个空格
+bool HttpRequest::ParseRequestLine_(const char *begin, const char *end)
+{
+    const char *sp1 = HttpScan::SkipToken(begin, end); // 方法是 token
+    if (sp1 == begin || sp1 == end || *sp1 != ' ')
+    {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    const char *target = sp1 + 1;
+    const char *sp2 = HttpScan::FindChar(target, end, ' ');
+    static const char HTTP[] = "HTTP/";
+    const size_t HTTP_LEN = sizeof(HTTP) - 1;
+    if (sp2 == target || end - sp2 - 1 < (ptrdiff_t)HTTP_LEN || memcmp(sp2 + 1, HTTP, HTTP_LEN) != 0)
+    {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    const char *version = sp2 + 1 + HTTP_LEN;
+    if (HttpScan::FindChar(version, end, ' ') != end || HttpScan::FindCtl(target, end) != end || HasDotDot_(target, sp2))
+    {
+        LOG_ERROR("RequestLine Error");
+        return false;
+    }
+    method_.assign(begin, sp1);
+    path_.assign(target, sp2);
+    version_.assign(version, end);
+    state_ = HEADERS; // 状态转换为 HEADERS。
+    return true;
+}
 
-    ([^ ]*)：第一个捕获组，匹配一个或多个非空格字符。这通常对应于 HTTP 请求方法（例如，GET、POST 等）。
-    ([^ ]*)：匹配一个空格，后跟第二个捕获组，匹配一个或多个非空格字符。这通常对应于请求的路径（例如，/index.html）。
-    HTTP/：匹配字符串 HTTP/，这是 HTTP 请求行的固定部分。
-    ([^ ]*)：第三个捕获组，匹配一个或多个非空格字符。这通常对应于 HTTP 版本（例如，1.1、2.0 等）。
-    $：表示匹配字符串的结束。
-    通过这个正则表达式，我们可以解析出 HTTP 请求行中的三个主要部分：请求方法、请求路径和 HTTP 版本。*/
-    regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); // 定义了一个正则表达式 pattern ，用于匹配请求行。
-    // smatch 是标准库 <regex> 中定义的一个类型，用于存储正则表达式匹配结果。
-    smatch Match; // 定义了一个 smatch 对象 Match，用于存储匹配结果。
-    if (regex_match(line, Match, pattern))
-    {                        // 如果 line 匹配正则表达式 pattern ，将匹配结果存储到 Match 中。
-        method_ = Match[1];  // 将 Match 中第一个括号中的内容存储到 method_ 中。
-        path_ = Match[2];    // 将 Match 中第二个括号中的内容存储到 path_ 中。
-        version_ = Match[3]; // 将 Match 中第三个括号中的内容存储到 version_ 中。
-        state_ = HEADERS;    // 状态转换为 HEADERS。
+// 查找路由：静态路由把路径改为对应的文件（例如 "/" -> "/index.html"），处理函数在请求完整后由 HttpConn 调用。
+// 没有路由时按路径返回文件，只接受 GET/HEAD 和提交表单的 POST（见 ParsePost_），
+// 其他方法回复 405，Allow 中列出这些方法和路径上注册了路由的方法
+bool HttpRequest::ParsePath_()
+{
+    static const unsigned FILE_METHODS =
+        1u << Router::METHOD_GET | 1u << Router::METHOD_HEAD | 1u << Router::METHOD_POST;
+    Router *router = Router::Instance();
+    if (router->Lookup(method_, path_, &route_))
+    {
+        if (!route_.route->target.empty())
+        {
+            path_ = route_.route->target;
+        }
         return true;
     }
-    LOG_ERROR("RequestLine Error"); // 如果匹配失败，打印错误日志。
-    return false;
+    Router::Method method = Router::ParseMethod(method_);
+    if (method != Router::METHOD_COUNT && (FILE_METHODS & 1u << method))
+    {
+        return true;
+    }
+    allowed_ = router->Allowed(path_) | FILE_METHODS;
+    LOG_DEBUG("Method %s not allowed: %s", method_.c_str(), path_.c_str());
+    return Fail_(405);
 }
 
-// 解析路径，统一一下 path 名称，方便后面解析资源
-void HttpRequest::ParsePath_()
+// 解析请求头
+bool HttpRequest::ParseHeader_(const char *begin, const char *end)
 {
-    if (path_ == "/")
-    { // 如果 path_ 为 "/"，将 path_ 设置为 "/index.html"。
-        path_ = "/index.html";
+    if (begin == end)
+    {
+        // 空行：请求头结束
+        return StartBody_();
     }
-    else
-    { // 否则，如果 path_ 在 DEFAULT_HTML 中，将 path_ 后面添加 ".html"。
-        if (DEFAULT_HTML.find(path_) != DEFAULT_HTML.end())
+    if (++headerCount_ > maxHeaderCount)
+    {
+        return Fail_(431);
+    }
+    // "名称: 值"：名称是 token，冒号前不能有空白；值去掉前后的空白（OWS），不能含控制字符
+    const char *colon = HttpScan::SkipToken(begin, end);
+    if (colon != begin && colon != end && *colon == ':')
+    {
+        const char *value = colon + 1, *valueEnd = end;
+        while (value < valueEnd && (*value == ' ' || *value == '\t'))
         {
-            path_ += ".html";
+            value++;
+        }
+        while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+        {
+            valueEnd--;
+        }
+        if (HttpScan::FindCtl(value, valueEnd) == valueEnd)
+        {
+            return header_.Add(begin, colon - begin, value, valueEnd - value) || Fail_(400); // 重复的 Host/Content-Length 等
         }
     }
+    return Fail_(400); // 不是空行也不是 "key: value"
 }
 
-// 解析请求头
-void HttpRequest::ParseHeader_(const string &line)
+bool HttpRequest::Admit_() const
 {
-    /*正则表达式 ^([^:]*): ?(.*)$ 可以分解为以下几个部分：
-    ^：表示匹配字符串的开始。
+    return RateLimiter::Instance()->Allow(client_, route_.route ? route_.route->limit : RateLimiter::ROUTE_STATIC);
+}
 
-    ( 和 )：圆括号用于定义一个捕获组。捕获组会保存匹配的子字符串，以便后续引用或处理。
-    [^:]*：方括号内的 ^ 表示取反，[^:]* 表示匹配任何不是冒号的字符，* 表示匹配前面的模式零次或多次。
-    :：匹配一个冒号。
-    ?：匹配前面的模式零次或一次。
-    (.*)：匹配任意字符零次或多次。这通常对应于冒号后面的值。
-    $：表示匹配字符串的结束。
-    通过这个正则表达式，我们可以解析出 HTTP 请求头中的键值对。*/
-    regex pattern("^([^:]*): ?(.*)$"); // 定义了一个正则表达式 pattern ，用于匹配请求头。
-    smatch Match;                      // 定义了一个 smatch 对象 Match，用于存储匹配结果。
-    if (regex_match(line, Match, pattern))
-    {                                 // 如果 line 匹配正则表达式 pattern ，将匹配结果存储到 Match 中。
-        header_[Match[1]] = Match[2]; // 将 Match 中第一个括号中的内容作为键，第二个括号中的内容作为值，存储到 header_ 中。
+// 请求头结束：按 Transfer-Encoding/Content-Length 决定请求体的长度
+bool HttpRequest::StartBody_()
+{
+    bool chunked = false;
+    HeaderTable::View te = header_.Get(HeaderTable::TRANSFER_ENCODING);
+    HeaderTable::View cl = header_.Get(HeaderTable::CONTENT_LENGTH);
+    if (te)
+    {
+        // 只支持 chunked；同时带 Content-Length 的请求可能被前后两级按不同的长度理解（请求走私），直接拒绝
+        if (!te.EqualsIgnoreCase("chunked") || cl)
+        {
+            return Fail_(400);
+        }
+        chunked = true;
     }
-    else
-    {                  // 如果匹配失败，说明首部行匹配完了，状态变化。
-        state_ = BODY; // 状态转换为 BODY。
+    else if (cl)
+    {
+        // 只允许十进制数字，超过 2^60 的长度肯定超过上限，不再累加以免溢出
+        if (cl.size == 0)
+        {
+            return Fail_(400);
+        }
+        for (size_t i = 0; i < cl.size; i++)
+        {
+            if (cl.data[i] < '0' || cl.data[i] > '9')
+            {
+                return Fail_(400);
+            }
+            contentLength_ = std::min<size_t>(contentLength_ * 10 + (cl.data[i] - '0'), size_t(1) << 60);
+        }
+    }
+    // 请求头收完就限流，被拒绝的登录/注册不会接收请求体，更不会访问数据库
+    if (!Admit_())
+    {
+        return Fail_(429);
+    }
+    if (!chunked && contentLength_ == 0)
+    {
+        state_ = FINISH;
+        return true;
     }
+    // 路由可以提供自己的接收者（例如直接写文件的上传），否则放在内存中，过大时写入临时文件
+    const Router::Route *route = route_.route;
+    if (route && route->sink)
+    {
+        routeSink_ = route->sink(*this, route_.params);
+    }
+    sink_ = routeSink_ ? routeSink_.get() : &spool_;
+    bodyLimit_ = sink_->MaxBytes() ? sink_->MaxBytes() : maxBodyBytes;
+    if (contentLength_ > bodyLimit_)
+    {
+        return Fail_(413); // 在接收请求体之前拒绝
+    }
+    bodyState_ = chunked ? CHUNK_SIZE : BODY_DATA;
+    bodyRemaining_ = contentLength_;
+    state_ = BODY;
+    return true;
 }
 
 // 解析请求体
-void HttpRequest::ParseBody_(const string &line)
+bool HttpRequest::ParseBody_(Buffer &buff)
+{
+    while (state_ == BODY)
+    {
+        if (bodyState_ == BODY_DATA || bodyState_ == CHUNK_DATA)
+        {
+            size_t n = std::min(buff.ReadableBytes(), bodyRemaining_);
+            if (n > 0 && !sink_->Write(buff.Peek(), n))
+            {
+                return Fail_(sink_->ErrorCode());
+            }
+            buff.Retrieve(n);
+            bodyRemaining_ -= n;
+            bodyBytes_ += n;
+            if (bodyRemaining_ > 0)
+            {
+                return true; // 等待更多数据
+            }
+            if (bodyState_ == BODY_DATA)
+            {
+                return FinishBody_();
+            }
+            bodyState_ = CHUNK_DATA_END;
+            continue;
+        }
+        // 其余状态都按行处理
+        const char *lineend = HttpScan::FindCrlf(buff.Peek(), buff.BeginWriteConst());
+        if (lineend == buff.BeginWriteConst())
+        {
+            if (headerBytes_ + buff.ReadableBytes() > maxHeaderBytes)
+            {
+                return Fail_(bodyState_ == CHUNK_TRAILER ? 431 : 400); // 块大小行或尾部字段过长
+            }
+            return true;
+        }
+        const char *line = buff.Peek();
+        size_t lineLen = lineend - line;
+        if (bodyState_ == CHUNK_DATA_END)
+        {
+            if (lineLen != 0)
+            {
+                return Fail_(400);
+            }
+            bodyState_ = CHUNK_SIZE;
+        }
+        else if (bodyState_ == CHUNK_SIZE)
+        {
+            // 块大小是十六进制，后面可以有 ";扩展"
+            const char *p = line;
+            size_t size = 0;
+            for (int digit; p < lineend && (digit = HttpScan::Hex(*p)) >= 0; p++)
+            {
+                size = std::min<size_t>(size * 16 + digit, size_t(1) << 60);
+            }
+            if (p == line || (p != lineend && *p != ';' && *p != ' '))
+            {
+                return Fail_(400);
+            }
+            if (size > bodyLimit_ - bodyBytes_)
+            {
+                return Fail_(413);
+            }
+            bodyRemaining_ = size;
+            bodyState_ = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+        }
+        else
+        {
+            // 尾部字段计入请求头的大小限制，内容忽略
+            headerBytes_ += lineLen + 2;
+            if (headerBytes_ > maxHeaderBytes)
+            {
+                return Fail_(431);
+            }
+            if (lineLen == 0)
+            {
+                buff.RetrieveUntil(lineend + 2);
+                return FinishBody_();
+            }
+        }
+        buff.RetrieveUntil(lineend + 2);
+    }
+    return true;
+}
+
+size_t HttpRequest::SpliceableBytes() const
 {
-    body_ = line;                                            // 将 line 存储到 body_ 中。
-    ParsePost_();                                            // 调用 ParsePost_ 方法解析 POST 请求体。
-    state_ = FINISH;                                         // 状态转换为 FINISH。
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size()); // 打印日志。
+    if (state_ != BODY || bodyState_ != BODY_DATA || sink_->SpliceFd() < 0)
+    {
+        return 0;
+    }
+    return bodyRemaining_;
 }
 
-// 16 进制转换为 10 进制
-int HttpRequest::ConverHex(char ch)
+void HttpRequest::OnSpliced(size_t len)
 {
-    if (ch >= 'A' && ch <= 'F') // 如果 ch 大于等于 'A' 并且小于等于 'F'，返回 ch - 'A' + 10。
-        return ch - 'A' + 10;
-    if (ch >= 'a' && ch <= 'f') // 如果 ch 大于等于 'a' 并且小于等于 'f'，返回 ch - 'a' + 10。
-        return ch - 'a' + 10;
-    return ch; // 否则，返回 ch。
+    assert(len <= bodyRemaining_);
+    sink_->OnSpliced(len);
+    bodyRemaining_ -= len;
+    bodyBytes_ += len;
 }
 
-// 处理 POST 请求
+// 请求体收完：默认接收者放在内存中的请求体移到 body_，解析表单
+bool HttpRequest::FinishBody_()
+{
+    if (!sink_->Finish())
+    {
+        return Fail_(sink_->ErrorCode());
+    }
+    if (sink_ == &spool_ && !spool_.IsSpooled())
+    {
+        body_.swap(spool_.Data()); // 两个缓冲区来回交换，各自保留容量
+        ParsePost_(); // 调用 ParsePost_ 方法解析 POST 请求体。
+    }
+    state_ = FINISH; // 状态转换为 FINISH。
+    LOG_DEBUG("Body len:%d", (int)bodyBytes_);
+    return true;
+}
+
+// 处理 POST 请求：解析表单，具体的处理（例如登录/注册）由路由的处理函数完成
 void HttpRequest::ParsePost_()
 {
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded")
+    if (method_ == "POST" && IsFormPost())
     {                           // 如果 method_ 为 "POST" 并且 Content-Type 为 "application/x-www-form-urlencoded"。
         ParseFromUrlencoded_(); // 调用 ParseFromUrlencoded_ 方法解析 POST 请求体。
-        if (DEFAULT_HTML_TAG.count(path_))
-        {                                                   // 如果 path_ 在 DEFAULT_HTML_TAG 中。
-            int tag = DEFAULT_HTML_TAG.find(path_)->second; // 获取 path_ 对应的值。
-            LOG_DEBUG("Tag:%d", tag);                       // 打印日志。
-            if (tag == 0 || tag == 1)
-            {                              // 如果 tag 为 0 或 1。
-                bool isLogin = (tag == 1); // 如果 tag 为 1，isLogin 为 true；否则，isLogin 为 false。
-                if (UserVerify(post_["username"], post_["password"], isLogin))
-                {                            // 调用 UserVerify 方法验证用户名和密码。
-                    path_ = "/welcome.html"; // 如果验证成功，将 path_ 设置为 "/welcome.html"。
-                }
-                else
-                { // 否则，将 path_ 设置为 "/error.html"。
-                    path_ = "/error.html";
-                }
-            }
-        }
     }
 }
 
-// 从 URL 中解析编码
-// 这里还需要继续看一下，在写完之后对这里跑一下
+// 解析表单：复制到 form_ 中原地解码，body_ 保持原样，同名的键以最后一个为准
 void HttpRequest::ParseFromUrlencoded_()
 {
-    if (body_.size() == 0)
-    { // 如果 body_ 为空，返回。
+    if (body_.empty())
+    {
         return;
     }
-
-    string key, value;    // 定义 key 和 value。
-    int num = 0;          // 定义 num。
-    int n = body_.size(); // 获取 body_ 的大小。
-    int i = 0, j = 0;     // 定义 i 和 j。
-
-    for (; i < n; i++)
-    {                       // 遍历 body_。
-        char ch = body_[i]; // 获取 body_ 中的字符。
-        switch (ch)         // switch 判断。
-        {
-        case '=':                         // 如果 ch 为 '='。
-            key = body_.substr(j, i - j); // 获取 key。
-            j = i + 1;                    // j 设置为 i + 1。
-            break;
-        case '+':           // 如果 ch 为 '+'。
-            body_[i] = ' '; // 将 body_ 中的 '+' 替换为 ' '。
-            break;
-        case '%':                                                         // 如果 ch 为 '%'。
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]); // 将 body_ 中的 16 进制转换为 10 进制。
-            body_[i + 2] = num % 10 + '0';                                // 将 num 的个位数转换为字符。
-            body_[i + 1] = num / 10 + '0';                                // 将 num 的十位数转换为字符。
-            i += 2;                                                       // i 加 2。
-            break;
-        case '&':                                             // 如果 ch 为 '&'。
-            value = body_.substr(j, i - j);                   // 获取 value。
-            j = i + 1;                                        // j 设置为 i + 1。
-            post_[key] = value;                               // 将 key 和 value 存储到 post_ 中。
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str()); // 打印日志。
-            break;
-        default: // 默认情况。
-            break;
-        }
-    }
-    assert(j <= i); // 断言 j 小于等于 i。
-    if (post_.count(key) == 0 && j < i)
-    {                                   // 如果 post_ 中没有 key 并且 j 小于 i。
-        value = body_.substr(j, i - j); // 获取 value。
-        post_[key] = value;             // 将 key 和 value 存储到 post_ 中。
-    }
+    form_.assign(body_); // form_ 在连接的各个请求之间复用，容量足够时不分配内存
+    HttpScan::ParseForm(&form_[0], form_.size(),
+                        [this](const char *key, size_t keyLen, const char *value, size_t valueLen)
+                        {
+                            ArenaAllocator<char> alloc = post_.get_allocator();
+                            auto it = post_.emplace(ArenaString(key, keyLen, alloc), ArenaString(alloc)).first;
+                            it->second.assign(value, valueLen);
+                            LOG_DEBUG("%.*s = %.*s", (int)keyLen, key, (int)valueLen, value);
+                        });
 }
 
-// 用户验证
+// 用户验证，具体的存储后端（MySQL 或嵌入式）由启动时安装的 UserStore 决定
 bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin)
 {
     if (name == "" || pwd == "")
@@ -248,93 +418,14 @@ bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin
         return false;
     } // 如果 name 或 pwd 为空，返回 false。
     LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL *sql;                                 // 定义 MYSQL 对象 sql。
-    SqlConnRAII(&sql, SqlConnPool::Instance()); // 创建 SqlConnRAII 对象，获取数据库连接。
-    assert(sql);
-
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = {0}; // 定义 order 数组，大小为 256。
-    /*MYSQL_FIELD 是 MySQL C API 中的一个结构体类型，用于描述结果集中字段（列）的元数据。它包含字段的名称、类型、长度等信息。*/
-    MYSQL_FIELD *fields = nullptr; // 定义 MYSQL_FIELD 对象 fields。
-    // MYSQL_RES 是 MySQL C API 中的一个结构体类型，用于表示查询结果集。当你执行一个查询（例如 SELECT 语句）时，MySQL 会返回一个 MYSQL_RES 对象，包含查询的结果。
-    MYSQL_RES *res = nullptr; // 定义 MYSQL_RES 对象 res。
-
-    if (!isLogin)
+    UserStore *store = UserStore::Instance();
+    if (!store)
     {
-        flag = true;
-    } // 如果不是登录，flag 设置为 true。
-    /* 查询用户及密码 */
-    /*snprintf是一个C语言中的函数，用于将格式化的数据写入字符串中。它类似于printf函数，但是不是将结果打印到标准输出，而是将结果写入指定的字符串缓冲区。
-
-    snprintf函数的原型如下：
-
-    参数说明：
-
-    str：指向要写入的字符串缓冲区的指针。
-    size：要写入的最大字符数（包括终止符）。
-    format：格式化字符串，指定要写入的数据的格式。
-    ...：可变参数，根据format字符串中的格式指定要写入的数据。
-    snprintf函数会根据指定的格式将数据写入字符串缓冲区，并返回写入的字符数（不包括终止符）。如果写入的字符数超过了指定的最大字符数，那么多余的字符将被截断。*/
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if (mysql_query(sql, order))
-    { // 执行 SQL 查询。
-        /*已使用 /explain (重新运行而不使用)
-        根据你提供的代码片段，mysql_free_result 是一个函数调用。它是用于释放 MySQL 查询结果的函数。
-
-        在使用 MySQL 进行数据库查询时，通常会使用 mysql_query 函数执行查询，并通过 mysql_store_result 函数获取查询结果。当你完成了对查询结果的处理后，需要使用 mysql_free_result 函数来释放内存资源，以避免内存泄漏。
-
-        这个函数的作用是释放 mysql_store_result 函数返回的结果集对象所占用的内存。通过调用 mysql_free_result 函数，你可以确保在不再需要查询结果时，释放相关的内存资源。*/
-        mysql_free_result(res); // 释放结果集。
+        LOG_ERROR("UserVerify: no user store installed");
         return false;
     }
-    res = mysql_store_result(sql);    // 存储结果。
-    j = mysql_num_fields(res);        // 获取结果集中的字段数。
-    fields = mysql_fetch_fields(res); // 获取结果集中的字段。
-
-    while (MYSQL_ROW row = mysql_fetch_row(res))
-    { // 遍历结果集。
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]); // 获取密码。
-        /* 注册行为 且 用户名未被使用*/
-        if (isLogin)
-        {
-            if (pwd == password)
-            {
-                flag = true;
-            } // 如果密码正确，flag 设置为 true。
-            else
-            {
-                flag = false;
-                LOG_INFO("pwd error!");
-            }
-        }
-        else
-        {
-            flag = false;
-            LOG_INFO("user used!");
-        }
-    }
-    mysql_free_result(res);
-
-    /* 注册行为 且 用户名未被使用*/
-    if (!isLogin && flag == true)
-    {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256); // 将 order 数组清零。
-        snprintf(order, 256, "INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG("%s", order);
-        if (mysql_query(sql, order))
-        {
-            LOG_DEBUG("Insert error!");
-            flag = false;
-        }
-        flag = true;
-    }
-    // SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG("UserVerify success!!");
+    bool flag = isLogin ? store->Login(name, pwd) : store->Register(name, pwd);
+    LOG_DEBUG("UserVerify %s!!", flag ? "success" : "failed");
     return flag;
 }
 
@@ -366,30 +457,37 @@ std::string HttpRequest::version() const
 std::string HttpRequest::GetPost(const std::string &key) const
 {
     assert(key != "");
-    if (post_.count(key) == 1)
-    {                                   // 如果 post_ 中有 key。
-        return post_.find(key)->second; // 返回 key 对应的值。
-    }
-    return "";
+    return GetPost(key.c_str());
 }
 
-// 用于获取请求的路径、方法、版本和 POST 数据。
+// 用于获取请求的路径、方法、版本和 POST 数据。查找用的键也分配在 arena_ 中
 std::string HttpRequest::GetPost(const char *key) const
 {
     assert(key != nullptr);
-    if (post_.count(key) == 1)
-    {
-        return post_.find(key)->second;
+    auto it = post_.find(ArenaString(key, post_.get_allocator()));
+    if (it != post_.end())
+    { // 如果 post_ 中有 key。
+        return std::string(it->second.data(), it->second.size()); // 返回 key 对应的值。
     }
     return "";
 }
 
+std::string HttpRequest::GetHeader(const std::string &key) const
+{
+    return header_.Get(key.data(), key.size()).str();
+}
+
+// 媒体类型不区分大小写，后面可以有 "; charset=..." 等参数
+bool HttpRequest::IsFormPost() const
+{
+    static const char FORM[] = "application/x-www-form-urlencoded";
+    HeaderTable::View type = Header(HeaderTable::CONTENT_TYPE);
+    return type.StartsWithIgnoreCase(FORM) &&
+           (type.size == sizeof(FORM) - 1 || type.data[sizeof(FORM) - 1] == ';' || type.data[sizeof(FORM) - 1] == ' ');
+}
+
 // 检查连接是否保持活动状态。
 bool HttpRequest::IsKeepAlive() const
 {
-    if (header_.count("Connection") == 1)
-    {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
-    }
-    return false;
+    return header_.Get(HeaderTable::CONNECTION).EqualsIgnoreCase("keep-alive") && version_ == "1.1";
 }
\ No newline at end of file
@@ -4,35 +4,21 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex> // 正则表达式
 #include <errno.h>
-#include <mysql.h> //mysql
+#include <stdlib.h> // strtoull
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
-#include "../pool/sqlconnpool.h"
+#include "../store/userstore.h"
+#include "ratelimiter.h"
+#include "router.h"
+#include "bodysink.h"
+#include "httpscan.h"
+#include "headertable.h"
+#include "arena.h"
 
 class HttpRequest
 {
-private:
-    bool ParseRequestLine_(const std::string &line); // 处理请求行
-    void ParseHeader_(const std::string &line);      // 处理请求头
-    void ParseBody_(const std::string &line);        // 处理请求体
-
-    void ParsePath_();           // 处理请求路径
-    void ParsePost_();           // 处理Post事件
-    void ParseFromUrlencoded_(); // 从url中解析编码
-
-    static bool UserVerify(conse std::string &name, const std::string &pwd, bool isLogin); // 用户验证
-
-    PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
-
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
-    static int ConverHex(char ch); // 16进制转换为10进制
 public:
     // 定义 PARSE_STATE 枚举，表示解析状态，包括请求行、请求头、请求体和完成。
     enum PARSE_STATE
@@ -43,19 +29,98 @@ public:
         FINISH,
     };
 
-    HttpRequest() { Init(); } // 构造函数调用 Init 方法初始化对象。
+    // 请求体的接收状态
+    enum BODY_STATE
+    {
+        BODY_DATA,      // 按 Content-Length 接收
+        CHUNK_SIZE,     // 分块编码：块大小行
+        CHUNK_DATA,     // 块数据
+        CHUNK_DATA_END, // 块数据后的 "\r\n"
+        CHUNK_TRAILER,  // 最后一块之后的尾部字段，空行结束
+    };
+
+private:
+    bool ParseRequestLine_(const char *begin, const char *end); // 处理请求行
+    bool ParseHeader_(const char *begin, const char *end);      // 处理请求头，空行表示请求头结束
+    bool Fail_(int code);                            // 记录错误码，返回 false
+    bool Admit_() const;                             // 按客户端 IP 和路由类别限流
+    bool StartBody_();                               // 请求头收完：确定请求体长度或分块编码，创建接收者
+    bool ParseBody_(Buffer &buff);                   // 把已到达的请求体交给接收者，收完时状态变为 FINISH
+    bool FinishBody_();                              // 请求体收完
+
+    bool ParsePath_();           // 查找路由，方法不被允许时回复 405
+    void ParsePost_();           // 处理Post事件
+    void ParseFromUrlencoded_(); // 解析 application/x-www-form-urlencoded 表单
+
+    PARSE_STATE state_;
+    size_t headerBytes_;    // 已消费的请求行和请求头字节数
+    size_t headerCount_;    // 已解析的请求头个数
+    size_t contentLength_;  // 请求体长度（Content-Length）
+    BODY_STATE bodyState_;
+    size_t bodyRemaining_;  // 当前（块）还没收到的字节数
+    size_t bodyBytes_;      // 已收到的请求体字节数
+    size_t bodyLimit_;      // 请求体上限：接收者的 MaxBytes()，或者 maxBodyBytes
+    BodySink *sink_;        // 请求体的接收者：spool_ 或 routeSink_，没有请求体时为空
+    std::unique_ptr<BodySink> routeSink_; // 路由创建的接收者
+    SpoolSink spool_;       // 默认的接收者，在连接的各个请求之间复用
+    int errorCode_;         // 解析失败时应回复的状态码，0 表示没有错误
+    unsigned allowed_;      // 回复 405 时路径允许的方法（第 i 位对应 Router::Method i）
+    sockaddr_in client_;    // 客户端地址，用于限流，Init 不清除
+    Router::Match route_;   // 请求行解析后查找到的路由
+    // 不放在 arena_ 中：Init 只清空不释放，容量在连接的各个请求之间复用，稳定状态下本身不分配；
+    // path_ 会被路由和处理函数改写（path()），body_ 与 spool_ 的缓冲区交换，都需要独立拥有内存
+    std::string method_, path_, version_, body_;
+    HeaderTable header_;
+    Arena arena_;           // 请求内的临时分配，Init 时整体回收；必须在使用它的容器之前构造
+    ArenaStringMap post_;
+    std::string form_; // 解码表单用的缓冲区，Init 不清除
+
+public:
+    HttpRequest() : spool_(spoolThreshold), client_(), post_(ArenaAllocator<char>(&arena_)) { Init(); } // 构造函数调用 Init 方法初始化对象。
     ~HttpRequest() = default; // 析构函数使用默认实现。
 
     void Init();              // Init 方法初始化对象。
-    bool parse(Buffer &buff); // parse 方法解析缓冲区中的数据。
+    // 解析缓冲区中的数据，可以分多次调用：只消费完整的行，请求体到达多少就交给接收者多少。
+    // 返回 false 表示请求有错误（见 ErrorCode），返回 true 时需要检查 IsFinished 判断请求是否完整
+    bool parse(Buffer &buff);
+
+    PARSE_STATE State() const { return state_; }
+    bool IsFinished() const { return state_ == FINISH; }
+    int ErrorCode() const { return errorCode_; } // 400/403/405/413/429/431/500，0 表示没有错误
+    unsigned Allowed() const { return allowed_; } // ErrorCode 为 405 时 Allow 中的方法
+
+    // 请求体可以从套接字直接 splice 到接收者的文件时，返回还需要的字节数，否则返回 0
+    size_t SpliceableBytes() const;
+    // 已经 splice 了 len 字节；收完时下一次 parse 结束请求体
+    void OnSpliced(size_t len);
+    void SetClient(const sockaddr_in &addr) { client_ = addr; } // 连接建立时设置
+
+    // 请求大小限制，超过时不再继续接收：请求行加请求头的字节数和个数（431），请求体长度（413）
+    static size_t maxHeaderBytes;
+    static size_t maxHeaderCount;
+    static size_t maxBodyBytes;
+    // 默认接收者在内存中最多保存的请求体字节数，超过后写入临时文件
+    static size_t spoolThreshold;
 
     // 用于获取请求的路径、方法、版本和 POST 数据。
     std::string path() const;
     std::string &path();
     std::string method() const;
     std::string version() const;
+    // 返回副本：值是 arena_ 中的 ArenaString，类型不同，不能以 const std::string& 返回；只在登录/注册时调用，短值不分配
     std::string GetPost(const std::string &key) const;
     std::string GetPost(const char *key) const;
+    std::string GetHeader(const std::string &key) const;                                  // 任意请求头，不区分大小写
+    HeaderTable::View Header(HeaderTable::Field field) const { return header_.Get(field); } // 常用的请求头，不复制
+    bool IsFormPost() const; // Content-Type 是否为 application/x-www-form-urlencoded
+    const std::string &body() const { return body_; } // 放在内存中的请求体
+    BodySink *Body() const { return sink_; }           // 请求体的接收者，没有请求体时为空
+    const Router::Match &Route() const { return route_; }
+    bool HasHandler() const { return route_.route && route_.route->handler; } // 是否需要调用路由的处理函数
+    bool IsWebSocket() const { return route_.route && route_.route->ws; }      // 路由要求升级为 WebSocket
+    bool IsEventStream() const { return route_.route && route_.route->events; } // 路由回复事件流
+
+    static bool UserVerify(const std::string &name, const std::string &pwd, bool isLogin); // 用户验证
 
     bool IsKeepAlive() const; // 检查连接是否保持活动状态。
 };
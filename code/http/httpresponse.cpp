@@ -1,4 +1,7 @@
 #include "httpresponse.h"
+#include "router.h" // MethodName
+
+#include <algorithm> // search
 
 using namespace std;
 
@@ -28,9 +31,16 @@ const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
 // 状态码对应状态信息   将状态码映射到相应的状态信息
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
 	{ 200, "OK" },
+	{ 304, "Not Modified" },
 	{ 400, "Bad Request" },
 	{ 403, "Forbidden" },
 	{ 404, "Not Found" },
+	{ 405, "Method Not Allowed" },
+	{ 408, "Request Timeout" },
+	{ 413, "Payload Too Large" },
+	{ 429, "Too Many Requests" },
+	{ 431, "Request Header Fields Too Large" },
+	{ 500, "Internal Server Error" },
 };
 
 // 状态码对应路径信息   将状态码映射到相应的路径
@@ -38,8 +48,49 @@ const unordered_map<int, string> HttpResponse::CODE_PATH = {
 	{ 400, "/400.html" },
 	{ 403, "/403.html" },
 	{ 404, "/404.html" },
+	{ 405, "/405.html" },
 };
 
+unordered_map<int, HttpResponse::ErrorPage> HttpResponse::errorPages_;
+
+// 缓存项的 304 响应：状态行之后是可变的响应头（Date、Connection），再之后是缓存项中的校验器
+static const char NOT_MODIFIED[] = "HTTP/1.1 304 Not Modified\r\n";
+
+// 超时、请求过大、被限流或请求体无法接收时的响应：连接随后关闭，没有必要查找错误页面。
+// 发送时在状态行之后插入 Date
+static const char REQUEST_TIMEOUT[] =
+	"HTTP/1.1 408 Request Timeout\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+static const char PAYLOAD_TOO_LARGE[] =
+	"HTTP/1.1 413 Payload Too Large\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+static const char TOO_MANY_REQUESTS[] =
+	"HTTP/1.1 429 Too Many Requests\r\n"
+	"Retry-After: 1\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+static const char HEADER_TOO_LARGE[] =
+	"HTTP/1.1 431 Request Header Fields Too Large\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+static const char INTERNAL_ERROR[] =
+	"HTTP/1.1 500 Internal Server Error\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+
+const char* HttpResponse::FastResponse(int code, size_t* len) {
+	switch(code) {
+	case 408: *len = sizeof(REQUEST_TIMEOUT) - 1; return REQUEST_TIMEOUT;
+	case 413: *len = sizeof(PAYLOAD_TOO_LARGE) - 1; return PAYLOAD_TOO_LARGE;
+	case 429: *len = sizeof(TOO_MANY_REQUESTS) - 1; return TOO_MANY_REQUESTS;
+	case 431: *len = sizeof(HEADER_TOO_LARGE) - 1; return HEADER_TOO_LARGE;
+	case 500: *len = sizeof(INTERNAL_ERROR) - 1; return INTERNAL_ERROR;
+	default: return nullptr;
+	}
+}
+
 // 构造函数
 HttpResponse::HttpResponse() {
 	code_ = -1; // 状态码
@@ -47,6 +98,10 @@ HttpResponse::HttpResponse() {
 	isKeepAlive_ = false; // 是否保持连接
 	mmFile_ = nullptr; // 文件映射地址
 	mmFileStat_ = { 0 }; // 文件状态
+	templated_ = false;
+	headOnly_ = false;
+	page_ = nullptr;
+	allowed_ = 0;
 }
 
 // 析构函数
@@ -64,6 +119,17 @@ void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, in
 	srcDir_ = srcDir; // 源目录
 	mmFile_ = nullptr; // 文件映射地址
 	mmFileStat_ = { 0 }; // 文件状态
+	cached_.reset(); // 释放上一个响应引用的缓存
+	templated_ = false;
+	headOnly_ = false;
+	page_ = nullptr;
+	allowed_ = 0;
+	ifNoneMatch_ = ifModifiedSince_ = HeaderTable::View();
+}
+
+void HttpResponse::SetConditional(HeaderTable::View ifNoneMatch, HeaderTable::View ifModifiedSince) {
+	ifNoneMatch_ = ifNoneMatch;
+	ifModifiedSince_ = ifModifiedSince;
 }
 
 // 响应
@@ -78,18 +144,40 @@ void HttpResponse::MakeResponse(Buffer& buff) {
 	st_size：文件大小（以字节为单位）。
 	st_mode：文件的模式（包括文件类型和权限）。
 	st_mtime：文件的最后修改时间。*/
-	if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
+	// 调用者已经确定是错误（例如处理函数返回 4xx/5xx）时不再检查请求的资源，直接返回错误页面
+	bool isError = code_ >= 400;
+	file_.assign(srcDir_).append(path_); // 容量够用时不分配内存
+	// 小文件优先从内存缓存取，命中时不需要 stat/open/mmap；没有命中时 Get 已经 stat 过，结果在 mmFileStat_ 中
+	if(!isError && (cached_ = FileCache::Instance()->Get(file_, &mmFileStat_))) {
+		mmFileStat_ = cached_->st;
+		if(code_ == -1) {
+			code_ = 200;
+		}
+	}
+	else if(!isError && (mmFileStat_.st_mode == 0 || S_ISDIR(mmFileStat_.st_mode))) {
 		code_ = 404; // 未找到
 	}
 	// 如果请求的资源文件不可读，则状态码为403
 	// S_IROTH 是一个宏定义，用于表示文件的“其他用户”读权限（即非所有者和非组成员的读权限）
-	else if(!(mmFileStat_.st_mode & S_IROTH)) {
+	else if(!isError && !(mmFileStat_.st_mode & S_IROTH)) {
 		code_ = 403; // 禁止访问
 	}
 	else if(code_ == -1) {
 		code_ = 200; // 成功
 	}
-	ErrorHtml_(); // 错误页面
+	if(code_ >= 400) {
+		ErrorPage_(buff);
+		return;
+	}
+	// 缓存的文件：状态行、固定的响应头和内容都在缓存项中，这里只生成 Connection 等可变的部分
+	if(cached_ && code_ == 200) {
+		if(NotModified_()) {
+			code_ = 304;
+		}
+		templated_ = true;
+		AddCommonHeaders_(buff);
+		return;
+	}
 	AddStateLine_(buff); // 添加状态行
 	AddHeader_(buff); // 添加头部
 	AddContent_(buff); // 添加内容
@@ -97,6 +185,9 @@ void HttpResponse::MakeResponse(Buffer& buff) {
 
 // 文件
 char* HttpResponse::File() {
+	if(cached_) {
+		return const_cast<char*>(cached_->Body()); // 只用于 writev，不会被修改
+	}
 	return mmFile_; // 返回文件映射地址
 }
 
@@ -105,56 +196,199 @@ size_t HttpResponse::FileLen() const {
 	return mmFileStat_.st_size; // 返回文件大小
 }
 
-// 错误页面
-void HttpResponse::ErrorHtml_() {
-	// 如果状态码对应的路径存在，则将路径设置为对应的路径，并获取文件状态
-	if(CODE_PATH.count(code_) == 1) {
-		path_ = CODE_PATH.find(code_)->second; // 获取路径
-		stat((srcDir_ + path_).data(), &mmFileStat_); // 获取文件状态
+const char* HttpResponse::Head(size_t* len) const {
+	if(page_) {
+		*len = page_->statusLen;
+		return page_->block.data();
+	}
+	if(!templated_) {
+		*len = 0;
+		return nullptr;
+	}
+	if(code_ == 304) {
+		*len = sizeof(NOT_MODIFIED) - 1;
+		return NOT_MODIFIED;
+	}
+	*len = cached_->statusLen;
+	return cached_->block.data();
+}
+
+const char* HttpResponse::Tail(size_t* len) const {
+	if(page_) {
+		*len = (headOnly_ ? page_->headLen : page_->block.size()) - page_->statusLen;
+		return page_->block.data() + page_->statusLen;
+	}
+	if(templated_ && code_ == 304) {
+		*len = cached_->notModified.size();
+		return cached_->notModified.data();
+	}
+	if(templated_) {
+		// HEAD：响应头之后的文件内容不发送
+		*len = (headOnly_ ? cached_->bodyOffset : cached_->block.size()) - cached_->statusLen;
+		return cached_->block.data() + cached_->statusLen;
+	}
+	char* file = const_cast<HttpResponse*>(this)->File();
+	*len = file && !headOnly_ ? FileLen() : 0;
+	return file;
+}
+
+void HttpResponse::LoadErrorPages(const string& srcDir) {
+	errorPages_.clear();
+	for(auto& status : CODE_STATUS) {
+		if(status.first < 400) {
+			continue;
+		}
+		auto it = CODE_PATH.find(status.first);
+		string file = srcDir + (it != CODE_PATH.end() ? it->second : "/error.html");
+		string body;
+		int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd >= 0) {
+			char buf[4096];
+			ssize_t len;
+			while((len = read(fd, buf, sizeof(buf))) > 0) {
+				body.append(buf, len);
+			}
+			close(fd);
+		}
+		if(body.empty()) {
+			LOG_WARN("Error page %s not found, use the built-in page", file.c_str());
+			body = "<html><title>Error</title><body bgcolor=\"ffffff\">" + to_string(status.first) + " : "
+				+ status.second + "<hr><em>WebServer</em></body></html>";
+		}
+		ErrorPage& page = errorPages_[status.first];
+		page.block = "HTTP/1.1 " + to_string(status.first) + " " + status.second + "\r\n";
+		page.statusLen = page.block.size();
+		page.block += "Content-type: text/html\r\n";
+		page.block += "Content-length: " + to_string(body.size()) + "\r\n\r\n";
+		page.headLen = page.block.size();
+		page.block += body;
 	}
 }
 
+// 错误页面：状态行 | Date、Connection 等 | 页面，状态行和页面都在启动时生成，不访问文件
+void HttpResponse::ErrorPage_(Buffer& buff) {
+	if(CODE_STATUS.count(code_) == 0) {
+		code_ = 400; // 和 AddStateLine_ 一样，不认识的状态码回复 400
+	}
+	auto it = errorPages_.find(code_);
+	if(it == errorPages_.end()) { // 没有调用 LoadErrorPages：生成简单的错误内容
+		ErrorContent(buff, CODE_STATUS.find(code_)->second);
+		return;
+	}
+	cached_.reset();
+	page_ = &it->second;
+	AddCommonHeaders_(buff);
+	if(code_ == 405) {
+		AddAllow_(buff);
+	}
+}
+
+void HttpResponse::AddAllow_(Buffer& buff) const {
+	buff.Append("Allow: ", 7);
+	bool first = true;
+	for(int m = 0; m < Router::METHOD_COUNT; m++) {
+		if(allowed_ & (1u << m)) {
+			if(!first) {
+				buff.Append(", ", 2);
+			}
+			buff.Append(Router::MethodName(static_cast<Router::Method>(m)));
+			first = false;
+		}
+	}
+	buff.Append("\r\n", 2);
+}
+
 // 添加状态行
 void HttpResponse::AddStateLine_(Buffer& buff) {
-	string status;
-	// 如果状态码对应的状态信息存在，则将状态信息设置为对应的状态信息
-	if(CODE_STATUS.count(code_) == 1) {
-		status = CODE_STATUS.find(code_)->second; // 获取状态信息
-	}
-	else {
+	auto it = CODE_STATUS.find(code_);
+	// 如果状态码对应的状态信息不存在，则回复 400
+	if(it == CODE_STATUS.end()) {
 		code_ = 400; // 状态码为400
-		status = CODE_STATUS.find(400)->second; // 状态信息为Bad Request
+		it = CODE_STATUS.find(400); // 状态信息为Bad Request
 	}
-	buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n"); // 添加状态行
+	// 分段追加，不拼接临时 string
+	buff.Append("HTTP/1.1 ", 9);
+	AppendNumber_(buff, code_);
+	buff.Append(" ", 1);
+	buff.Append(it->second);
+	buff.Append("\r\n", 2);
 }
 
 // 添加头部
 void HttpResponse::AddHeader_(Buffer& buff) {
-	buff.Append("Connection: "); // 连接
+	AddCommonHeaders_(buff);
+	buff.Append("Content-type: "); // 内容类型
+	buff.Append(ContentType(path_));
+	buff.Append("\r\n", 2);
+}
+
+void HttpResponse::AddDate(Buffer& buff) {
+	buff.Append("Date: ", 6);
+	buff.Append(TimeService::HttpDate(), TimeService::HTTP_DATE_LEN);
+	buff.Append("\r\n", 2);
+}
+
+void HttpResponse::AddCommonHeaders_(Buffer& buff) {
+	AddDate(buff);
 	if(isKeepAlive_) {
-		buff.Append("keep-alive\r\n"); // 保持连接
+		buff.Append("Connection: keep-alive\r\n"); // 保持连接
 		buff.Append("keep-alive: max=6, timeout=120\r\n"); // 保持连接的最大次数和超时时间
 	}
 	else {
-		buff.Append("close\r\n"); // 关闭连接
+		buff.Append("Connection: close\r\n"); // 关闭连接
+	}
+}
+
+// If-None-Match 优先：列表中任何一个（忽略 W/，弱比较）等于缓存项的 ETag，或者为 "*"；
+// 否则 If-Modified-Since 与缓存项的 Last-Modified 完全相同（浏览器原样发回收到的值）
+bool HttpResponse::NotModified_() const {
+	if(ifNoneMatch_) {
+		if(ifNoneMatch_ == "*") {
+			return true;
+		}
+		const string& etag = cached_->etag;
+		const char* end = ifNoneMatch_.data + ifNoneMatch_.size;
+		return search(ifNoneMatch_.data, end, etag.begin(), etag.end()) != end;
 	}
-	buff.Append("Content-type: " + GetFileType_() + "\r\n"); // 内容类型
+	return ifModifiedSince_ && ifModifiedSince_ == cached_->lastModified.c_str();
+}
+
+void HttpResponse::AppendNumber_(Buffer& buff, size_t n) {
+	char digits[20];
+	char* p = digits + sizeof(digits);
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while(n);
+	buff.Append(p, digits + sizeof(digits) - p);
 }
 
 // 添加内容
 void HttpResponse::AddContent_(Buffer& buff) {
+	if(cached_) { // 内容已在内存中，不需要打开文件
+		buff.Append("Content-length: ");
+		AppendNumber_(buff, cached_->BodySize());
+		buff.Append("\r\n\r\n", 4);
+		return;
+	}
+	if(headOnly_) { // 只需要长度，不打开文件
+		buff.Append("Content-length: ");
+		AppendNumber_(buff, mmFileStat_.st_size);
+		buff.Append("\r\n\r\n", 4);
+		return;
+	}
 	// O_RDONLY 是一个宏定义，用于表示以只读模式打开文件
 	/*调用 open 函数：int fileDescriptor = open(filePath, O_RDONLY); 以只读模式打开文件，并返回文件描述符。
 	检查返回值：如果 open 返回 -1，表示打开文件失败；否则表示成功。
 	关闭文件：使用 close(fileDescriptor); 关闭文件。*/
-	int srcFd = open((srcDir_ + path_).data(), O_RDONLY); // 打开文件
+	int srcFd = open(file_.c_str(), O_RDONLY); // 打开文件
 	if(srcFd < 0) { // 如果文件打开失败
 		ErrorContent(buff, "File NotFound!"); // 错误内容
 		return; // 返回
 	}
 
 	// 将文件映射到内存提高文件的访问速度  MAP_PRIVATE 建立一个写入时拷贝的私有映射
-	LOG_DEBUG("file path %s", (srcDir_ + path_).data());
+	LOG_DEBUG("file path %s", file_.c_str());
 	/*mmap 函数：
 
 	mmap 是一个 POSIX 系统调用，用于将文件或设备映射到内存地址空间。
@@ -181,7 +415,9 @@ void HttpResponse::AddContent_(Buffer& buff) {
 	}
 	mmFile_ = (char*)mmRet; // 文件映射地址
 	close(srcFd); // 关闭文件
-	buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n"); // 内容长度
+	buff.Append("Content-length: "); // 内容长度
+	AppendNumber_(buff, mmFileStat_.st_size);
+	buff.Append("\r\n\r\n", 4);
 }
 
 // 解除映射
@@ -190,6 +426,7 @@ void HttpResponse::UnmapFile() {
 		munmap(mmFile_, mmFileStat_.st_size); // 解除映射
 		mmFile_ = nullptr; // 文件映射地址为空
 	}
+	cached_.reset(); // 释放对缓存项的引用
 }
 
 // 错误内容
@@ -203,21 +440,27 @@ void HttpResponse::ErrorContent(Buffer& buff, string message) {
 	body += "<hr><em>WebServer</em></body></html>"; // 服务器
 	status = CODE_STATUS.find(code_)->second; // 状态
 	buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n"); // 状态行
+	AddDate(buff);
 	buff.Append("Content-type: text/html\r\n"); // 内容类型
 	buff.Append("Connection: close\r\n"); // 关闭连接
 	buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n"); // 内容长度
-	buff.Append(body); // 内容
+	if(!headOnly_) {
+		buff.Append(body); // 内容
+	}
 }
 
 // 获取文件类型
-string HttpResponse::GetFileType_() {
-	string::size_type idx = path_.find_last_of('.'); // 查找文件扩展名
-	if(idx == string::npos) { // 如果没有找到
-		return "text/plain"; // 返回文本类型
+const string& HttpResponse::ContentType(const string& path) {
+	static const string TEXT_PLAIN = "text/plain";
+	string::size_type idx = path.find_last_of('.'); // 查找文件扩展名
+	// 已知的扩展名都很短，过长的不用查；查找用的 suffix 放得进 string 的内联缓冲区，不分配内存
+	if(idx == string::npos || path.size() - idx > 15) {
+		return TEXT_PLAIN; // 返回文本类型
 	}
-	string suffix = path_.substr(idx); // 获取文件扩展名
-	if(SUFFIX_TYPE.count(suffix) == 1) { // 如果文件扩展名存在
-		return SUFFIX_TYPE.find(suffix)->second; // 返回文件类型
+	string suffix = path.substr(idx); // 获取文件扩展名
+	auto it = SUFFIX_TYPE.find(suffix);
+	if(it != SUFFIX_TYPE.end()) { // 如果文件扩展名存在
+		return it->second; // 返回文件类型
 	}
-	return "text/plain"; // 返回文本类型
-}
\ No newline at end of file
+	return TEXT_PLAIN; // 返回文本类型
+}
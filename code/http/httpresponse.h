@@ -9,6 +9,9 @@
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
+#include "headertable.h"
+#include "../timer/timeservice.h"
 
 class HttpResponse {
 private:
@@ -16,17 +19,35 @@ private:
 	void AddHeader_(Buffer& buff); // 添加头部
 	void AddContent_(Buffer& buff); // 添加内容
 
-	void ErrorHtml_(); // 错误页面
-	std::string GetFileType_(); // 获取文件类型
+	void ErrorPage_(Buffer& buff); // 预先加载的错误页面，没有加载时生成简单的错误内容
+	void AddAllow_(Buffer& buff) const; // 405 的 "Allow: GET, HEAD\r\n"
+	void AddCommonHeaders_(Buffer& buff); // 添加 Date、Connection 这些每个请求不同的响应头
+	bool NotModified_() const; // 条件请求的校验器与缓存项一致
+	static void AppendNumber_(Buffer& buff, size_t n); // 追加十进制数，不经过临时 string
 
 	int code_; // 状态码
 	bool isKeepAlive_; // 是否保持连接
 
 	std::string path_; // 路径
 	std::string srcDir_; // 源目录
+	std::string file_; // srcDir_ + path_，在连接的各个响应之间复用容量
 
 	char* mmFile_; // 文件映射地址
 	struct stat mmFileStat_; // 文件状态
+	FileCache::EntryPtr cached_; // 小文件的内存缓存，非空时不使用 mmap
+	bool templated_; // 使用缓存项中预先生成的响应头（200/304）
+	bool headOnly_; // HEAD 请求：响应头与 GET 相同（包括 Content-length），不发送内容
+	HeaderTable::View ifNoneMatch_, ifModifiedSince_; // 条件请求的校验器，指向请求的请求头
+
+	// 启动时生成的错误响应：状态行 | Content-type、Content-length、空行 | 页面内容，连续存放，之后只读
+	struct ErrorPage {
+		std::string block;
+		size_t statusLen; // 状态行的长度，可变的响应头插在它之后
+		size_t headLen; // 到空行为止的长度，之后是页面内容
+	};
+	const ErrorPage* page_; // 非空时回复这个错误页面
+	unsigned allowed_; // 405 的 Allow 中的方法，第 i 位对应 Router::Method i
+	static std::unordered_map<int, ErrorPage> errorPages_;
 
 	static const std:: unordered_map<std::string, std::string> SUFFIX_TYPE; // 后缀类型集
 	static const std:: unordered_map<int, std::string> CODE_STATUS; // 状态码集
@@ -37,12 +58,29 @@ public:
 	~HttpResponse(); // 析构函数
 
 	void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1); // 初始化
-	void MakeResponse(Buffer& buff); // 响应
+	// 条件请求（If-None-Match/If-Modified-Since），在 Init 之后、MakeResponse 之前设置，请求解析完之前有效
+	void SetConditional(HeaderTable::View ifNoneMatch, HeaderTable::View ifModifiedSince);
+	void SetAllowed(unsigned methods) { allowed_ = methods; } // 405 时设置，在 Init 之后
+	void SetHeadOnly(bool headOnly) { headOnly_ = headOnly; } // HEAD 请求，在 Init 之后、MakeResponse 之前设置
+	// 生成响应：buff 中是需要按请求生成的部分，发送顺序为 Head()、buff、Tail()
+	void MakeResponse(Buffer& buff);
+	const char* Head(size_t* len) const; // buff 之前的部分：模板的状态行，没有时 len 为 0
+	const char* Tail(size_t* len) const; // buff 之后的部分：模板的其余响应头和文件内容，或者文件内容
 	void UnmapFile(); // 解除映射
 	char* File(); // 文件
 	size_t FileLen() const; // 文件长度
 	void ErrorContent(Buffer& buff, std::string message); // 错误内容
 	int Code() const { return code_; }; // 状态码
+	static const std::string& ContentType(const std::string& path); // 按扩展名确定的 MIME 类型
+	static void AddDate(Buffer& buff); // "Date: <HTTP-date>\r\n"，取 TimeService 格式化好的字符串
+	bool IsCached() const { return cached_ != nullptr; } // 响应内容是否来自内存缓存
+
+	// 启动时（工作线程开始之前）读入 CODE_PATH 中的错误页面，其余错误状态码使用 error.html，
+	// 文件不存在时使用内置的页面；之后回复错误不再访问文件
+	static void LoadErrorPages(const std::string& srcDir);
+
+	// 预先生成的错误响应（408/413/429/431/500，带 Connection: close），不需要生成响应的状态码返回 nullptr
+	static const char* FastResponse(int code, size_t* len);
 };
 
 #endif //HTTP_RESPONSE_H
\ No newline at end of file
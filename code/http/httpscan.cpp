@@ -0,0 +1,352 @@
+#include "httpscan.h"
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// token 字符表（RFC 7230 tchar），标量实现和向量实现的查找表都由它生成
+static bool IsTchar_(unsigned char c) {
+	static const char EXTRA[] = "!#$%&'*+-.^_`|~";
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+		(c != 0 && strchr(EXTRA, c) != nullptr);
+}
+
+struct TcharTable {
+	bool scalar[256];
+	// 向量实现按高低两个半字节查表：lo[低半字节] 的第 h 位表示 (h << 4 | 低半字节) 是 token 字符，
+	// hi[高半字节] = 1 << 高半字节（只有 0~7，不是 ASCII 的字节查到 0），两者相与不为 0 即为 token 字符
+	alignas(16) uint8_t lo[16];
+	alignas(16) uint8_t hi[16];
+
+	TcharTable() : lo(), hi() {
+		for(int c = 0; c < 256; c++) {
+			scalar[c] = IsTchar_(c);
+			if(scalar[c]) {
+				lo[c & 0x0f] |= 1 << (c >> 4);
+			}
+		}
+		for(int h = 0; h < 8; h++) {
+			hi[h] = 1 << h;
+		}
+	}
+};
+static const TcharTable TCHAR;
+
+static inline bool IsCtl_(unsigned char c) {
+	return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+static inline bool IsFormSpecial_(char c) {
+	return c == '%' || c == '+' || c == '&' || c == '=';
+}
+
+/* ---------------- 标量 ---------------- */
+
+static const char* FindCharScalar_(const char* begin, const char* end, char c) {
+	const void* p = memchr(begin, c, end - begin);
+	return p ? static_cast<const char*>(p) : end;
+}
+
+static const char* SkipTokenScalar_(const char* begin, const char* end) {
+	while(begin < end && TCHAR.scalar[static_cast<unsigned char>(*begin)]) {
+		begin++;
+	}
+	return begin;
+}
+
+static const char* FindCtlScalar_(const char* begin, const char* end) {
+	while(begin < end && !IsCtl_(*begin)) {
+		begin++;
+	}
+	return begin;
+}
+
+static const char* FindFormSpecialScalar_(const char* begin, const char* end) {
+	while(begin < end && !IsFormSpecial_(*begin)) {
+		begin++;
+	}
+	return begin;
+}
+
+// key 是 4 个掩码字节按内存顺序组成的整数，复制两份后一次处理 8 字节
+static void UnmaskScalar_(char* data, size_t len, uint32_t key) {
+	uint64_t key8 = static_cast<uint64_t>(key) << 32 | key;
+	for(; len >= 8; data += 8, len -= 8) {
+		uint64_t v;
+		memcpy(&v, data, 8);
+		v ^= key8;
+		memcpy(data, &v, 8);
+	}
+	for(size_t i = 0; i < len; i++) {
+		data[i] ^= reinterpret_cast<const char*>(&key8)[i];
+	}
+}
+
+#ifdef HTTP_SCAN_X86
+
+/* ---------------- SSE4.2：一次 16 字节 ---------------- */
+
+__attribute__((target("sse4.2"), always_inline))
+static inline const char* FindCharSse42_(const char* begin, const char* end, char c) {
+	const __m128i needle = _mm_set1_epi8(c);
+	for(; end - begin >= 16; begin += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return FindCharScalar_(begin, end, c);
+}
+
+// 半字节查表，返回不是 token 字符的字节的掩码
+__attribute__((target("sse4.2"), always_inline))
+static inline int NonTokenMask16_(__m128i v) {
+	const __m128i loTable = _mm_load_si128(reinterpret_cast<const __m128i*>(TCHAR.lo));
+	const __m128i hiTable = _mm_load_si128(reinterpret_cast<const __m128i*>(TCHAR.hi));
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i lo = _mm_and_si128(v, nibble);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+	__m128i bits = _mm_and_si128(_mm_shuffle_epi8(loTable, lo), _mm_shuffle_epi8(hiTable, hi));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128()));
+}
+
+__attribute__((target("sse4.2"), always_inline))
+static inline const char* SkipTokenSse42_(const char* begin, const char* end) {
+	for(; end - begin >= 16; begin += 16) {
+		int mask = NonTokenMask16_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)));
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return SkipTokenScalar_(begin, end);
+}
+
+// PCMPESTRI 范围模式：0x00~0x08、0x0a~0x1f、0x7f
+__attribute__((target("sse4.2"), always_inline))
+static inline const char* FindCtlSse42_(const char* begin, const char* end) {
+	const __m128i ranges = _mm_setr_epi8(0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	for(; end - begin >= 16; begin += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		int i = _mm_cmpestri(ranges, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+		if(i < 16) {
+			return begin + i;
+		}
+	}
+	return FindCtlScalar_(begin, end);
+}
+
+// PCMPESTRI 字符集模式
+__attribute__((target("sse4.2"), always_inline))
+static inline const char* FindFormSpecialSse42_(const char* begin, const char* end) {
+	const __m128i set = _mm_setr_epi8('%', '+', '&', '=', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	for(; end - begin >= 16; begin += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		int i = _mm_cmpestri(set, 4, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+		if(i < 16) {
+			return begin + i;
+		}
+	}
+	return FindFormSpecialScalar_(begin, end);
+}
+
+__attribute__((target("sse4.2"), always_inline))
+static inline void UnmaskSse42_(char* data, size_t len, uint32_t key) {
+	const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+	for(; len >= 16; data += 16, len -= 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_xor_si128(v, k));
+	}
+	UnmaskScalar_(data, len, key); // 每组 16 字节是 4 的倍数，尾部的掩码相位不变
+}
+
+/* ---------------- AVX2：一次 32 字节，不足 32 字节的尾部交给 SSE4.2 ----------------
+SSE4.2 的实现强制内联，在 AVX2 函数中按 VEX 编码生成，避免在 AVX 和传统 SSE 指令之间切换的开销。 */
+
+__attribute__((target("avx2")))
+static const char* FindCharAvx2_(const char* begin, const char* end, char c) {
+	const __m256i needle = _mm256_set1_epi8(c);
+	for(; end - begin >= 32; begin += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return FindCharSse42_(begin, end, c);
+}
+
+__attribute__((target("avx2")))
+static const char* SkipTokenAvx2_(const char* begin, const char* end) {
+	// VPSHUFB 在两个 128 位通道内分别查表，表复制到两个通道
+	const __m256i loTable = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(TCHAR.lo)));
+	const __m256i hiTable = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(TCHAR.hi)));
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	for(; end - begin >= 32; begin += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		__m256i lo = _mm256_and_si256(v, nibble);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+		__m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(loTable, lo), _mm256_shuffle_epi8(hiTable, hi));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, _mm256_setzero_si256()));
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return SkipTokenSse42_(begin, end);
+}
+
+__attribute__((target("avx2")))
+static const char* FindCtlAvx2_(const char* begin, const char* end) {
+	const __m256i limit = _mm256_set1_epi8(0x1f);
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i del = _mm256_set1_epi8(0x7f);
+	for(; end - begin >= 32; begin += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		__m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v); // 无符号 v <= 0x1f
+		ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl);
+		ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, del));
+		unsigned mask = _mm256_movemask_epi8(ctl);
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return FindCtlSse42_(begin, end);
+}
+
+__attribute__((target("avx2")))
+static const char* FindFormSpecialAvx2_(const char* begin, const char* end) {
+	const __m256i pct = _mm256_set1_epi8('%');
+	const __m256i plus = _mm256_set1_epi8('+');
+	const __m256i amp = _mm256_set1_epi8('&');
+	const __m256i eq = _mm256_set1_epi8('=');
+	for(; end - begin >= 32; begin += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		__m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, pct), _mm256_cmpeq_epi8(v, plus)),
+									  _mm256_or_si256(_mm256_cmpeq_epi8(v, amp), _mm256_cmpeq_epi8(v, eq)));
+		unsigned mask = _mm256_movemask_epi8(hit);
+		if(mask) {
+			return begin + __builtin_ctz(mask);
+		}
+	}
+	return FindFormSpecialSse42_(begin, end);
+}
+
+__attribute__((target("avx2")))
+static void UnmaskAvx2_(char* data, size_t len, uint32_t key) {
+	const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+	for(; len >= 32; data += 32, len -= 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data), _mm256_xor_si256(v, k));
+	}
+	UnmaskSse42_(data, len, key);
+}
+
+#endif // HTTP_SCAN_X86
+
+/* ---------------- 分发 ---------------- */
+
+HttpScan::Level HttpScan::Detect() {
+#ifdef HTTP_SCAN_X86
+	__builtin_cpu_init(); // 可能在其他静态对象构造之前调用
+	if(__builtin_cpu_supports("avx2")) {
+		return AVX2;
+	}
+	if(__builtin_cpu_supports("sse4.2")) {
+		return SSE42;
+	}
+#endif
+	return SCALAR;
+}
+
+const HttpScan::Kernels& HttpScan::KernelsFor_(Level level) {
+	static const Kernels SCALAR_KERNELS = {
+		FindCharScalar_, SkipTokenScalar_, FindCtlScalar_, FindFormSpecialScalar_, UnmaskScalar_,
+	};
+#ifdef HTTP_SCAN_X86
+	static const Kernels SSE42_KERNELS = {
+		FindCharSse42_, SkipTokenSse42_, FindCtlSse42_, FindFormSpecialSse42_, UnmaskSse42_,
+	};
+	static const Kernels AVX2_KERNELS = {
+		FindCharAvx2_, SkipTokenAvx2_, FindCtlAvx2_, FindFormSpecialAvx2_, UnmaskAvx2_,
+	};
+	if(level == AVX2) {
+		return AVX2_KERNELS;
+	}
+	if(level == SSE42) {
+		return SSE42_KERNELS;
+	}
+#endif
+	return SCALAR_KERNELS;
+}
+
+HttpScan::Level HttpScan::level_ = HttpScan::Detect();
+HttpScan::Kernels HttpScan::kernels_ = HttpScan::KernelsFor_(HttpScan::level_);
+
+HttpScan::Level HttpScan::Current() {
+	return level_;
+}
+
+bool HttpScan::Use(Level level) {
+	if(level > Detect()) {
+		return false;
+	}
+	level_ = level;
+	kernels_ = KernelsFor_(level);
+	return true;
+}
+
+const char* HttpScan::Name(Level level) {
+	static const char* NAMES[] = { "scalar", "sse4.2", "avx2" };
+	return NAMES[level];
+}
+
+const char* HttpScan::FindChar(const char* begin, const char* end, char c) {
+	return kernels_.findChar(begin, end, c);
+}
+
+const char* HttpScan::FindCrlf(const char* begin, const char* end) {
+	while(true) {
+		const char* cr = kernels_.findChar(begin, end, '\r');
+		if(cr == end || (cr + 1 < end && cr[1] == '\n')) {
+			return cr;
+		}
+		if(cr + 1 == end) {
+			return end; // '\n' 还没有到
+		}
+		begin = cr + 1; // 单独的 '\r'
+	}
+}
+
+const char* HttpScan::SkipToken(const char* begin, const char* end) {
+	return kernels_.skipToken(begin, end);
+}
+
+const char* HttpScan::FindCtl(const char* begin, const char* end) {
+	return kernels_.findCtl(begin, end);
+}
+
+const char* HttpScan::FindFormSpecial(const char* begin, const char* end) {
+	return kernels_.findFormSpecial(begin, end);
+}
+
+int HttpScan::Hex(char ch) {
+	if(ch >= '0' && ch <= '9') {
+		return ch - '0';
+	}
+	if(ch >= 'A' && ch <= 'F') {
+		return ch - 'A' + 10;
+	}
+	if(ch >= 'a' && ch <= 'f') {
+		return ch - 'a' + 10;
+	}
+	return -1;
+}
+
+void HttpScan::Unmask(char* data, size_t len, const unsigned char key[4]) {
+	uint32_t k;
+	memcpy(&k, key, 4);
+	kernels_.unmask(data, len, k);
+}
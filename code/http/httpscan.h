@@ -0,0 +1,107 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h> // memmove
+
+/*解析请求时用到的字节扫描：查找分隔符、校验 token 和请求头的值、表单解码，以及 WebSocket 帧的解除掩码。
+每个扫描有标量、SSE4.2、AVX2 三种实现，启动时按 CPU 支持的指令集选择最快的一种（Detect），之后不再判断。
+所有函数都在 [begin, end) 中查找，没有找到时返回 end，不要求以 '\0' 结尾，不会越界读。*/
+class HttpScan {
+public:
+	enum Level {
+		SCALAR, // 逐字节
+		SSE42,  // 一次 16 字节（SSE2/SSSE3 比较和查表，SSE4.2 字符集匹配）
+		AVX2,   // 一次 32 字节
+	};
+
+	static Level Detect();           // CPU 支持的最高一级
+	static Level Current();          // 正在使用的一级
+	static bool Use(Level level);    // 切换实现（测试和基准测试用），CPU 不支持时返回 false
+	static const char* Name(Level level);
+
+	// 第一个 c
+	static const char* FindChar(const char* begin, const char* end, char c);
+	// 第一个 "\r\n" 的 '\r'
+	static const char* FindCrlf(const char* begin, const char* end);
+	// 第一个不是 token 字符（RFC 7230 tchar：字母、数字和 !#$%&'*+-.^_`|~）的字节
+	static const char* SkipToken(const char* begin, const char* end);
+	// 第一个不能出现在请求头的值中的字节：除 HTAB 以外的控制字符和 DEL
+	static const char* FindCtl(const char* begin, const char* end);
+	// 第一个 '%' '+' '&' '='，表单中其余的字节都原样复制
+	static const char* FindFormSpecial(const char* begin, const char* end);
+
+	static int Hex(char ch); // 十六进制数字的值，不是十六进制数字时返回 -1
+
+	// 原地异或 4 字节的掩码：data[i] ^= key 的第 i % 4 个字节（按内存顺序）
+	static void Unmask(char* data, size_t len, const unsigned char key[4]);
+
+	/*原地解析 application/x-www-form-urlencoded：一遍扫描，解码结果写回 data（解码后只会变短），不分配内存。
+	每个键值对调用一次 fn(key, keyLen, value, valueLen)，指针指向 data 内部；
+	'+' 解码为空格，不合法的 "%xx" 原样保留，没有 '=' 的键值为空，空的键值对（"&&"）跳过。*/
+	template<class Fn>
+	static void ParseForm(char* data, size_t len, Fn fn);
+
+private:
+	struct Kernels {
+		const char* (*findChar)(const char*, const char*, char);
+		const char* (*skipToken)(const char*, const char*);
+		const char* (*findCtl)(const char*, const char*);
+		const char* (*findFormSpecial)(const char*, const char*);
+		void (*unmask)(char*, size_t, uint32_t);
+	};
+	static const Kernels& KernelsFor_(Level level);
+	static Kernels kernels_;
+	static Level level_;
+};
+
+template<class Fn>
+void HttpScan::ParseForm(char* data, size_t len, Fn fn) {
+	const char* r = data;      // 读位置
+	const char* end = data + len;
+	char* w = data;            // 写位置，不会超过 r
+	char* key = data;          // 当前键值对的开始
+	char* value = nullptr;     // 值的开始（也是键的结束），还没有遇到 '=' 时为空
+	while(true) {
+		const char* s = FindFormSpecial(r, end);
+		if(w != r) {
+			memmove(w, r, s - r); // 解码过后写位置落后于读位置，普通字节整段前移
+		}
+		w += s - r;
+		r = s;
+		if(r == end || *r == '&') {
+			if(value) {
+				fn(key, value - key, value, w - value);
+			} else if(w != key) {
+				fn(key, w - key, w, 0);
+			}
+			if(r == end) {
+				break;
+			}
+			r++;
+			key = w;
+			value = nullptr;
+			continue;
+		}
+		char c = *r++;
+		if(c == '+') {
+			*w++ = ' ';
+		} else if(c == '%') {
+			int hi = end - r >= 2 ? Hex(r[0]) : -1;
+			int lo = hi >= 0 ? Hex(r[1]) : -1;
+			if(lo >= 0) {
+				*w++ = static_cast<char>(hi << 4 | lo);
+				r += 2;
+			} else {
+				*w++ = '%';
+			}
+		} else if(!value) { // 第一个 '='
+			value = w;
+		} else {
+			*w++ = '=';
+		}
+	}
+}
+
+#endif // HTTP_SCAN_H
@@ -0,0 +1,117 @@
+#include "ratelimiter.h"
+
+using namespace std;
+
+RateLimiter* RateLimiter::Instance() {
+	static RateLimiter limiter;
+	return &limiter;
+}
+
+void RateLimiter::Init(size_t slots) {
+	size_t perShard = 1;
+	while(perShard << SHARD_BITS < slots) {
+		perShard <<= 1;
+	}
+	if(perShard < MAX_PROBE) {
+		perShard = MAX_PROBE;
+	}
+	slots_.reset(new Slot[perShard << SHARD_BITS]);
+	for(size_t i = 0; i < perShard << SHARD_BITS; i++) {
+		slots_[i].key.store(0, memory_order_relaxed);
+		slots_[i].state.store(0, memory_order_relaxed);
+	}
+	shardMask_ = perShard - 1;
+}
+
+void RateLimiter::SetRate(RouteClass cls, uint32_t rate, uint32_t burst) {
+	assert(cls < ROUTE_COUNT);
+	burst = std::max<uint32_t>(1, std::min<uint32_t>(burst, TOKEN_MASK >> TOKEN_SHIFT)); // 令牌数只有 24 位
+	rates_[cls].burst.store(burst);
+	rates_[cls].rate.store(rate);
+	LOG_INFO("RateLimiter: class %d, %u/s, burst %u", (int)cls, rate, burst);
+}
+
+uint64_t RateLimiter::NowMs_() {
+	return chrono::duration_cast<chrono::milliseconds>(LoopClock::Now().time_since_epoch()).count()
+		& ((uint64_t(1) << 40) - 1);
+}
+
+uint64_t RateLimiter::Refill_(uint64_t state, uint64_t nowMs, uint32_t rate, uint32_t burst) {
+	uint64_t full = uint64_t(burst) << TOKEN_SHIFT;
+	if(state == 0) {
+		return full; // 新的桶是满的
+	}
+	uint64_t last = state >> 24;
+	uint64_t elapsed = nowMs > last ? std::min<uint64_t>(nowMs - last, 3600 * 1000) : 0; // 其他线程的缓存时间可能稍晚
+	uint64_t tokens = (state & TOKEN_MASK) + elapsed * rate * (1 << TOKEN_SHIFT) / 1000;
+	return std::min(tokens, full);
+}
+
+RateLimiter::Slot* RateLimiter::Find_(uint64_t key, uint64_t nowMs, uint32_t rate, uint32_t burst) {
+	uint64_t hash = key * 0x9E3779B97F4A7C15ull; // 乘法哈希，高位最均匀
+	Slot* shard = &slots_[(hash >> (64 - SHARD_BITS)) * (shardMask_ + 1)];
+	size_t index = hash >> 24;
+	Slot* victim = nullptr;
+	uint64_t victimKey = 0;
+	for(int i = 0; i < MAX_PROBE; i++) {
+		Slot* slot = &shard[(index + i) & shardMask_];
+		uint64_t cur = slot->key.load(memory_order_acquire);
+		if(cur == key) {
+			return slot;
+		}
+		if(cur == 0) {
+			// 空槽：占用它。槽里的状态是 0（新桶）或者被回收前的满桶，都不需要重新初始化
+			if(slot->key.compare_exchange_strong(cur, key, memory_order_acq_rel) || cur == key) {
+				return slot;
+			}
+			continue;
+		}
+		// 记下第一个已经补满的桶：它和不存在没有区别，可以让给新的键
+		if(!victim) {
+			const Rate& r = rates_[(cur & 0xff) - 1];
+			uint32_t curBurst = r.burst.load(memory_order_relaxed);
+			if(Refill_(slot->state.load(memory_order_relaxed), nowMs, r.rate.load(memory_order_relaxed), curBurst)
+					>= uint64_t(curBurst) << TOKEN_SHIFT) {
+				victim = slot;
+				victimKey = cur;
+			}
+		}
+	}
+	// 回收与正在更新旧键的线程并发时，最坏情况是新键的第一次扣减落在满桶上，不影响限流的正确性
+	if(victim && victim->key.compare_exchange_strong(victimKey, key, memory_order_acq_rel)) {
+		return victim;
+	}
+	return nullptr;
+}
+
+bool RateLimiter::Allow(const sockaddr_in& addr, RouteClass cls) {
+	assert(cls < ROUTE_COUNT);
+	uint32_t rate = rates_[cls].rate.load(memory_order_relaxed);
+	if(!slots_ || rate == 0) {
+		return true;
+	}
+	uint32_t burst = rates_[cls].burst.load(memory_order_relaxed);
+	uint64_t key = (uint64_t(ntohl(addr.sin_addr.s_addr)) << 8) | (cls + 1);
+	uint64_t nowMs = NowMs_();
+	Slot* slot = Find_(key, nowMs, rate, burst);
+	if(!slot) {
+		overflow_.fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+	uint64_t old = slot->state.load(memory_order_relaxed);
+	while(true) {
+		uint64_t tokens = Refill_(old, nowMs, rate, burst);
+		bool ok = tokens >= (1 << TOKEN_SHIFT);
+		if(ok) {
+			tokens -= 1 << TOKEN_SHIFT;
+		}
+		uint64_t last = old >> 24;
+		uint64_t state = (std::max(nowMs, last) << 24) | tokens;
+		if(slot->state.compare_exchange_weak(old, state, memory_order_relaxed)) {
+			if(!ok) {
+				limited_.fetch_add(1, memory_order_relaxed);
+			}
+			return ok;
+		}
+	}
+}
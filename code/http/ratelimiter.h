@@ -0,0 +1,70 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <netinet/in.h> // sockaddr_in
+#include <arpa/inet.h>  // ntohl
+
+#include "../log/log.h"
+#include "../timer/loopclock.h"
+
+/*按客户端 IP 的令牌桶限流。
+每个（IP，路由类别）一个令牌桶：每秒补充 rate 个令牌，最多积累 burst 个，每个请求消耗一个，没有令牌时拒绝（429）。
+令牌桶放在分片的开放寻址表中，键和状态各是一个 64 位原子量，查找、插入、扣减都用 CAS，请求路径上没有锁。
+表满时回收已经补满（等价于从未访问）的桶；探测范围内都在使用中时不限流（宁可放过也不误杀）。*/
+class RateLimiter {
+public:
+	// 路由类别，每类单独配置速率
+	enum RouteClass {
+		ROUTE_STATIC, // 静态资源
+		ROUTE_AUTH,   // 登录/注册（访问数据库）
+		ROUTE_UPLOAD, // 上传（写磁盘）
+		ROUTE_COUNT,
+	};
+
+	static RateLimiter* Instance();
+
+	// 分配表（slots 向上取 2 的幂，均分到各分片），只能在处理请求之前调用
+	void Init(size_t slots = 65536);
+	// 设置某类路由的速率（个/秒）和突发量，rate 为 0 表示不限流
+	void SetRate(RouteClass cls, uint32_t rate, uint32_t burst);
+	// 消耗一个令牌，返回 false 表示应拒绝
+	bool Allow(const sockaddr_in& addr, RouteClass cls);
+
+	uint64_t LimitedCount() const { return limited_.load(std::memory_order_relaxed); }  // 被拒绝的请求数
+	uint64_t OverflowCount() const { return overflow_.load(std::memory_order_relaxed); } // 表满未能限流的请求数
+
+private:
+	RateLimiter() = default;
+
+	// 一个令牌桶占 16 字节，一条缓存行 4 个
+	struct Slot {
+		std::atomic<uint64_t> key;   // (IP << 8) | (类别 + 1)，0 表示空
+		std::atomic<uint64_t> state; // 高 40 位：上次更新时间（毫秒），低 24 位：令牌数（1/256 个为单位）
+	};
+	struct Rate {
+		std::atomic<uint32_t> rate;  // 每秒补充的令牌数
+		std::atomic<uint32_t> burst; // 最多积累的令牌数
+	};
+
+	static const int SHARD_BITS = 4;       // 16 个分片，按哈希的高位选择
+	static const int MAX_PROBE = 16;       // 每个键最多探测的槽数
+	static const int TOKEN_SHIFT = 8;      // 令牌的定点小数位数
+	static const uint64_t TOKEN_MASK = (1u << 24) - 1;
+
+	static uint64_t NowMs_();
+	static uint64_t Refill_(uint64_t state, uint64_t nowMs, uint32_t rate, uint32_t burst); // 返回补充后的令牌数
+	Slot* Find_(uint64_t key, uint64_t nowMs, uint32_t rate, uint32_t burst); // 查找或占用一个槽，失败时返回 nullptr
+
+	std::unique_ptr<Slot[]> slots_;
+	size_t shardMask_ = 0;  // 每个分片的槽数 - 1
+	Rate rates_[ROUTE_COUNT] = {};
+	std::atomic<uint64_t> limited_{0};
+	std::atomic<uint64_t> overflow_{0};
+};
+
+#endif // RATE_LIMITER_H
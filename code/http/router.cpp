@@ -0,0 +1,169 @@
+#include "router.h"
+
+using namespace std;
+
+Router* Router::Instance() {
+	static Router router;
+	return &router;
+}
+
+Router::Router() : root_(new Node()) {}
+
+static const char* METHOD_NAMES[Router::METHOD_COUNT] = { "GET", "HEAD", "POST", "PUT", "DELETE" };
+
+Router::Method Router::ParseMethod(const string& method) {
+	for(int i = 0; i < METHOD_COUNT; i++) {
+		if(method == METHOD_NAMES[i]) {
+			return static_cast<Method>(i);
+		}
+	}
+	return METHOD_COUNT;
+}
+
+const char* Router::MethodName(Method method) {
+	assert(method < METHOD_COUNT);
+	return METHOD_NAMES[method];
+}
+
+void Router::AddStatic(const string& path, const string& target) {
+	routes_.push_back({target, nullptr, RateLimiter::ROUTE_STATIC, nullptr, nullptr, nullptr});
+	Insert_(METHOD_GET, path, &routes_.back());
+	Insert_(METHOD_HEAD, path, &routes_.back());
+}
+
+void Router::Add(Method method, const string& pattern, Handler handler, RateLimiter::RouteClass limit, SinkFactory sink) {
+	assert(handler);
+	routes_.push_back({"", handler, limit, sink, nullptr, nullptr});
+	Insert_(method, pattern, &routes_.back());
+}
+
+void Router::AddWebSocket(const string& pattern, shared_ptr<WebSocketHandler> handler, RateLimiter::RouteClass limit) {
+	assert(handler);
+	routes_.push_back({"", nullptr, limit, nullptr, handler, nullptr});
+	Insert_(METHOD_GET, pattern, &routes_.back());
+}
+
+void Router::AddEventStream(const string& pattern, shared_ptr<EventStreamHandler> handler, RateLimiter::RouteClass limit) {
+	assert(handler);
+	routes_.push_back({"", nullptr, limit, nullptr, nullptr, handler});
+	Insert_(METHOD_GET, pattern, &routes_.back());
+}
+
+void Router::Insert_(Method method, const string& pattern, const Route* route) {
+	assert(!pattern.empty() && pattern[0] == '/');
+	string path = pattern;
+	bool isPrefix = path.back() == '*';
+	if(isPrefix) {
+		path.pop_back();
+	}
+	Node* node = root_.get();
+	size_t i = 0;
+	while(i < path.size()) {
+		// 动态段：一直到下一个 '/'，参数名只用于注册时阅读
+		if(path[i] == ':') {
+			if(!node->param) {
+				node->param.reset(new Node());
+			}
+			node = node->param.get();
+			i = std::min(path.find('/', i), path.size());
+			continue;
+		}
+		size_t end = std::min(path.find(':', i), path.size());
+		while(i < end) {
+			unique_ptr<Node>* slot = nullptr;
+			for(auto& child : node->children) {
+				if(child->label[0] == path[i]) {
+					slot = &child;
+					break;
+				}
+			}
+			if(!slot) {
+				node->children.emplace_back(new Node());
+				node = node->children.back().get();
+				node->label = path.substr(i, end - i);
+				i = end;
+				break;
+			}
+			Node* child = slot->get();
+			size_t n = 0;
+			while(n < child->label.size() && i + n < end && child->label[n] == path[i + n]) {
+				n++;
+			}
+			// 只有一部分公共前缀：把子节点拆成两段
+			if(n < child->label.size()) {
+				unique_ptr<Node> mid(new Node());
+				mid->label = child->label.substr(0, n);
+				child->label.erase(0, n);
+				mid->children.push_back(std::move(*slot));
+				*slot = std::move(mid);
+				child = slot->get();
+			}
+			node = child;
+			i += n;
+		}
+	}
+	const Route** routes = isPrefix ? node->prefix : node->exact;
+	for(int m = 0; m < METHOD_COUNT; m++) {
+		if(method == METHOD_ANY ? !routes[m] : m == method) {
+			routes[m] = route;
+		}
+	}
+}
+
+bool Router::Lookup(const string& method, const string& path, Match* match) const {
+	match->route = nullptr;
+	match->params.count = 0;
+	Method m = ParseMethod(method);
+	if(m == METHOD_COUNT || path.empty()) {
+		return false;
+	}
+	return Find_(root_.get(), path, 0, m, match);
+}
+
+unsigned Router::Allowed(const string& path) const {
+	unsigned mask = 0;
+	if(path.empty()) {
+		return mask;
+	}
+	for(int m = 0; m < METHOD_COUNT; m++) {
+		Match match;
+		if(Find_(root_.get(), path, 0, m, &match)) {
+			mask |= 1u << m;
+		}
+	}
+	return mask;
+}
+
+// node 的 label 已经匹配到 pos 之前，先试静态子节点，再试动态段，最后用这里的前缀路由
+bool Router::Find_(const Node* node, const string& path, size_t pos, int method, Match* match) const {
+	if(pos == path.size() && node->exact[method]) {
+		match->route = node->exact[method];
+		return true;
+	}
+	if(pos < path.size()) {
+		for(auto& child : node->children) {
+			if(child->label[0] == path[pos]) {
+				if(path.compare(pos, child->label.size(), child->label) == 0 &&
+						Find_(child.get(), path, pos + child->label.size(), method, match)) {
+					return true;
+				}
+				break;
+			}
+		}
+		size_t end = std::min(path.find('/', pos), path.size());
+		if(node->param && end > pos && match->params.count < Params::MAX) {
+			int k = match->params.count++;
+			match->params.begin[k] = pos;
+			match->params.len[k] = end - pos;
+			if(Find_(node->param.get(), path, end, method, match)) {
+				return true;
+			}
+			match->params.count--;
+		}
+	}
+	if(node->prefix[method]) {
+		match->route = node->prefix[method];
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,105 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+#include "../log/log.h"
+#include "ratelimiter.h"
+#include "bodysink.h"
+
+class HttpRequest;
+class WebSocketHandler;
+class EventStreamHandler;
+
+/*路由表，启动时注册，之后只读。
+路径保存在压缩前缀树（radix trie）中，每条边是一段公共前缀，查找时逐段比较，不分配内存。
+支持三种路由：
+- 静态：路径完全相同，请求改为返回指定的文件（例如 "/login" -> "/login.html"）；
+- 动态：模式中的 ":name" 段匹配到下一个 '/' 为止，位置记在 Params 中；
+- 前缀：模式以 "*" 结尾，匹配以它开头的所有路径。
+优先级：静态段 > 动态段 > 前缀，前缀之间取最长的。处理函数在请求解析完成后由工作线程调用。*/
+class Router {
+public:
+	enum Method {
+		METHOD_GET,
+		METHOD_HEAD,
+		METHOD_POST,
+		METHOD_PUT,
+		METHOD_DELETE,
+		METHOD_COUNT,
+		METHOD_ANY = METHOD_COUNT, // 注册时使用，匹配所有方法
+	};
+
+	// 动态段在请求路径中的位置
+	struct Params {
+		static const int MAX = 4;
+		int count = 0;
+		uint16_t begin[MAX];
+		uint16_t len[MAX];
+		std::string Get(const std::string& path, int i) const { return path.substr(begin[i], len[i]); }
+	};
+
+	// 返回状态码，-1 表示按 req.path()（处理函数可以修改）对应的文件决定
+	typedef std::function<int(HttpRequest& req, const Params& params)> Handler;
+	// 请求头收完、开始接收请求体时调用，返回这个请求的请求体接收者，返回空时使用默认的 SpoolSink
+	typedef std::function<std::unique_ptr<BodySink>(HttpRequest& req, const Params& params)> SinkFactory;
+
+	struct Route {
+		std::string target; // 非空：静态路由，请求改为这个文件
+		Handler handler;    // 非空：解析完成后调用
+		RateLimiter::RouteClass limit; // 限流类别
+		SinkFactory sink;   // 非空：请求体交给它创建的接收者
+		std::shared_ptr<WebSocketHandler> ws; // 非空：升级为 WebSocket 连接，之后的消息交给它
+		std::shared_ptr<EventStreamHandler> events; // 非空：回复不结束的事件流（Server-Sent Events）
+	};
+
+	struct Match {
+		const Route* route = nullptr;
+		Params params;
+	};
+
+	static Router* Instance();
+
+	// 静态路由，GET/HEAD
+	void AddStatic(const std::string& path, const std::string& target);
+	// 处理函数，pattern 可以含 ":name" 段或以 "*" 结尾
+	void Add(Method method, const std::string& pattern, Handler handler,
+			 RateLimiter::RouteClass limit = RateLimiter::ROUTE_STATIC, SinkFactory sink = nullptr);
+	// WebSocket：GET 请求升级（101），不是合法的升级请求时回复 400
+	void AddWebSocket(const std::string& pattern, std::shared_ptr<WebSocketHandler> handler,
+					  RateLimiter::RouteClass limit = RateLimiter::ROUTE_STATIC);
+	// Server-Sent Events：GET 请求回复 text/event-stream，连接一直保持，由处理函数追加事件
+	void AddEventStream(const std::string& pattern, std::shared_ptr<EventStreamHandler> handler,
+						RateLimiter::RouteClass limit = RateLimiter::ROUTE_STATIC);
+	// 查找，没有匹配的路由时返回 false（按路径返回文件）
+	bool Lookup(const std::string& method, const std::string& path, Match* match) const;
+	// 路径上注册了路由的方法，第 i 位对应 Method i；只在回复 405 时调用
+	unsigned Allowed(const std::string& path) const;
+
+	static Method ParseMethod(const std::string& method); // 不认识的方法返回 METHOD_COUNT
+	static const char* MethodName(Method method);
+
+private:
+	Router();
+
+	struct Node {
+		std::string label;                          // 从父节点到这里的一段路径
+		std::vector<std::unique_ptr<Node>> children; // 静态子节点，首字符互不相同
+		std::unique_ptr<Node> param;                // ":name" 子节点
+		const Route* exact[METHOD_COUNT] = {};      // 路径在这里结束
+		const Route* prefix[METHOD_COUNT] = {};     // 以这里为前缀（"*"）
+	};
+
+	void Insert_(Method method, const std::string& pattern, const Route* route);
+	bool Find_(const Node* node, const std::string& path, size_t pos, int method, Match* match) const;
+
+	std::unique_ptr<Node> root_;
+	std::deque<Route> routes_; // 地址稳定，节点中保存指针
+};
+
+#endif // ROUTER_H
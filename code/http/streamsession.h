@@ -0,0 +1,20 @@
+#ifndef STREAM_SESSION_H
+#define STREAM_SESSION_H
+
+#include "../buffer/buffer.h"
+
+/*请求/响应结束之后接管连接的协议：WebSocket（101 之后的帧）和 Server-Sent Events（不结束的响应）。
+HttpConn 在响应头发完后调用 Open，之后所有的回调都在持有连接所有权的线程中调用，同一个连接不会并发。
+要发送的数据通过 HttpConn::Push 放入连接的发送队列。*/
+class StreamSession {
+public:
+	virtual ~StreamSession() = default;
+
+	virtual void Open() = 0;              // 响应头已发完：调用应用的 OnOpen
+	virtual bool Parse(Buffer& buff) = 0; // 处理到达的数据，返回 false 表示不再读，发送队列清空后断开
+	virtual bool Finished() const = 0;    // 会话已结束（例如其他线程调用了 Close），发送队列清空后断开
+	virtual bool Ping() = 0;              // 空闲超时：发出探测，返回 true 表示需要对方回应（WebSocket 的 pong）
+	virtual void Closed() = 0;            // 连接已关闭：取消订阅，调用应用的 OnClose
+};
+
+#endif // STREAM_SESSION_H
@@ -0,0 +1,336 @@
+#include "upload.h"
+
+#include <errno.h>
+#include <string.h>	  // memcmp
+#include <strings.h>  // strncasecmp
+#include <ctype.h>
+#include <stdlib.h>	  // mkstemp
+#include <sys/stat.h> // fchmod
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+std::string UploadSink::dir;
+size_t UploadSink::maxBytes = 16 * 1024 * 1024;
+
+bool UploadSink::Open_(const string& field, const string& name) {
+	if(dir.empty()) {
+		return Error_(403); // 没有配置上传目录
+	}
+	tmpPath_ = dir + ".upload-XXXXXX";
+	fd_ = mkstemp(&tmpPath_[0]);
+	if(fd_ < 0) {
+		LOG_ERROR("Upload: create file in %s error: %d", dir.c_str(), errno);
+		tmpPath_.clear();
+		return Error_(500);
+	}
+	fchmod(fd_, 0644); // 上传目录在资源目录下时，文件可以被直接访问
+	cur_ = {field, name, "", 0};
+	return true;
+}
+
+bool UploadSink::Append_(const char* data, size_t len) {
+	if(fd_ < 0) {
+		return false;
+	}
+	cur_.size += len;
+	while(len > 0) {
+		ssize_t n = write(fd_, data, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			LOG_ERROR("Upload: write %s error: %d", tmpPath_.c_str(), errno);
+			return Error_(500);
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool UploadSink::Commit_() {
+	if(fd_ < 0) {
+		return false;
+	}
+	close(fd_);
+	fd_ = -1;
+	// 用 link 而不是 rename：目标已存在时失败而不是覆盖
+	string base = SafeName_(cur_.name);
+	string::size_type dot = base.rfind('.');
+	string stem = dot == string::npos ? base : base.substr(0, dot);
+	string ext = dot == string::npos ? "" : base.substr(dot);
+	for(int i = 0; i < 1000; i++) {
+		string path = dir + (i == 0 ? base : stem + "-" + to_string(i) + ext);
+		if(link(tmpPath_.c_str(), path.c_str()) == 0) {
+			unlink(tmpPath_.c_str());
+			tmpPath_.clear();
+			cur_.path = path;
+			files_.push_back(cur_);
+			LOG_INFO("Upload: %s (%d bytes) saved as %s", cur_.name.c_str(), (int)cur_.size, path.c_str());
+			return true;
+		}
+		if(errno != EEXIST) {
+			LOG_ERROR("Upload: link %s error: %d", path.c_str(), errno);
+			break;
+		}
+	}
+	return Error_(500);
+}
+
+void UploadSink::Abort_() {
+	if(fd_ >= 0) {
+		close(fd_);
+		fd_ = -1;
+	}
+	if(!tmpPath_.empty()) {
+		unlink(tmpPath_.c_str());
+		tmpPath_.clear();
+	}
+}
+
+string UploadSink::SafeName_(const string& name) {
+	string::size_type slash = name.find_last_of("/\\");
+	string base = slash == string::npos ? name : name.substr(slash + 1);
+	string safe;
+	for(char c : base) {
+		if(safe.size() >= 100) {
+			break;
+		}
+		bool ok = isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_';
+		if(c == '.' && safe.empty()) {
+			continue; // 不生成隐藏文件，也不会是 "." 或 ".."
+		}
+		safe += ok ? c : '_';
+	}
+	return safe.empty() ? "upload" : safe;
+}
+
+FileSink::FileSink(const string& name) {
+	Open_("", name);
+}
+
+bool FileSink::Write(const char* data, size_t len) {
+	return Append_(data, len);
+}
+
+bool FileSink::Finish() {
+	return Commit_();
+}
+
+MultipartSink::MultipartSink(const string& boundary) : delim_("\r\n--" + boundary) {
+	carry_ = "\r\n"; // 请求体以 "--boundary" 开头，前面补上 "\r\n" 后和其他分隔符一样处理
+	error_ = 400;
+}
+
+string MultipartSink::Boundary(const string& contentType) {
+	static const char TYPE[] = "multipart/form-data";
+	if(strncasecmp(contentType.c_str(), TYPE, sizeof(TYPE) - 1) != 0) {
+		return "";
+	}
+	string::size_type pos = contentType.find("boundary=");
+	if(pos == string::npos) {
+		return "";
+	}
+	string boundary = contentType.substr(pos + 9);
+	boundary = boundary.substr(0, boundary.find(';'));
+	if(boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"') {
+		boundary = boundary.substr(1, boundary.size() - 2);
+	}
+	return boundary.size() <= 70 ? boundary : ""; // RFC 2046：1 到 70 个字符
+}
+
+bool MultipartSink::Write(const char* data, size_t len) {
+	if(failed_) {
+		return false;
+	}
+	// 通常上一段都处理完了，直接在读缓冲区上解析，不复制
+	if(carry_.empty()) {
+		size_t used = Process_(data, len);
+		carry_.assign(data + used, len - used);
+	} else {
+		string buf;
+		buf.swap(carry_);
+		buf.append(data, len);
+		size_t used = Process_(buf.data(), buf.size());
+		carry_.assign(buf.data() + used, buf.size() - used);
+	}
+	return !failed_;
+}
+
+bool MultipartSink::Finish() {
+	if(state_ != EPILOGUE) {
+		return Error_(400); // 没有结束分隔符，请求体不完整
+	}
+	return true;
+}
+
+size_t MultipartSink::Process_(const char* data, size_t len) {
+	size_t pos = 0;
+	while(pos < len && !failed_) {
+		switch(state_) {
+		case PREAMBLE:
+		case PART_DATA: {
+			const char* hit = FindDelimiter_(data + pos, len - pos);
+			if(hit) {
+				if(state_ == PART_DATA && (!PartData_(data + pos, hit - data - pos) || !EndPart_())) {
+					failed_ = true;
+					break;
+				}
+				pos = hit - data + delim_.size();
+				state_ = AFTER_DELIM;
+				break;
+			}
+			// 没有完整的分隔符：末尾可能是分隔符的开头，留到下一段
+			size_t keep = PartialTail_(data + pos, len - pos);
+			if(state_ == PART_DATA && !PartData_(data + pos, len - pos - keep)) {
+				failed_ = true;
+			}
+			return len - keep;
+		}
+		case AFTER_DELIM:
+			if(len - pos < 2) {
+				return pos;
+			}
+			if(data[pos] == '-' && data[pos + 1] == '-') {
+				state_ = EPILOGUE;
+			} else if(data[pos] == '\r' && data[pos + 1] == '\n') {
+				state_ = PART_HEADERS;
+				partField_.clear();
+				partFile_.clear();
+				partHeaderBytes_ = 0;
+			} else {
+				failed_ = !Error_(400);
+			}
+			pos += 2;
+			break;
+		case PART_HEADERS: {
+			static const char CRLF[] = "\r\n";
+			const char* end = search(data + pos, data + len, CRLF, CRLF + 2);
+			if(end == data + len) {
+				if(partHeaderBytes_ + len - pos > MAX_PART_HEADER) {
+					failed_ = !Error_(400);
+					break;
+				}
+				return pos;
+			}
+			string line(data + pos, end);
+			partHeaderBytes_ += line.size() + 2;
+			pos = end - data + 2;
+			if(partHeaderBytes_ > MAX_PART_HEADER) {
+				failed_ = !Error_(400);
+			} else if(line.empty()) {
+				failed_ = !BeginPart_();
+				state_ = PART_DATA;
+			} else {
+				failed_ = !PartHeader_(line);
+			}
+			break;
+		}
+		case EPILOGUE:
+			return len;
+		}
+	}
+	return failed_ ? len : pos;
+}
+
+const char* MultipartSink::FindDelimiter_(const char* data, size_t len) const {
+	const char* d = delim_.data();
+	size_t k = delim_.size();
+	if(len < k) {
+		return nullptr;
+	}
+	size_t i = 0;
+#ifdef __SSE2__
+	// 同时比较 16 个候选位置的首字节和尾字节，两者都相等的位置才做完整比较
+	const __m128i first = _mm_set1_epi8(d[0]);
+	const __m128i last = _mm_set1_epi8(d[k - 1]);
+	for(; i + k - 1 + 16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + k - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		while(mask) {
+			int bit = __builtin_ctz(mask);
+			if(memcmp(data + i + bit + 1, d + 1, k - 2) == 0) {
+				return data + i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for(; i + k <= len; i++) {
+		if(data[i] == d[0] && memcmp(data + i, d, k) == 0) {
+			return data + i;
+		}
+	}
+	return nullptr;
+}
+
+size_t MultipartSink::PartialTail_(const char* data, size_t len) const {
+	for(size_t n = std::min(len, delim_.size() - 1); n > 0; n--) {
+		if(memcmp(data + len - n, delim_.data(), n) == 0) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+// 只关心 Content-Disposition 的 name 和 filename
+bool MultipartSink::PartHeader_(const string& line) {
+	static const char DISPOSITION[] = "content-disposition:";
+	if(strncasecmp(line.c_str(), DISPOSITION, sizeof(DISPOSITION) - 1) != 0) {
+		return true;
+	}
+	string::size_type pos = line.find(';');
+	while(pos != string::npos) {
+		string::size_type next = line.find(';', pos + 1);
+		string param = line.substr(pos + 1, next == string::npos ? string::npos : next - pos - 1);
+		param.erase(0, param.find_first_not_of(' '));
+		string::size_type eq = param.find('=');
+		if(eq != string::npos) {
+			string key = param.substr(0, eq);
+			string value = param.substr(eq + 1);
+			if(value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+				value = value.substr(1, value.size() - 2);
+			}
+			if(key == "name") {
+				partField_ = value;
+			} else if(key == "filename") {
+				partFile_ = value;
+			}
+		}
+		pos = next;
+	}
+	return true;
+}
+
+bool MultipartSink::BeginPart_() {
+	partValue_.clear();
+	if(partFile_.empty()) {
+		return true; // 普通字段，或者没有选择文件的文件字段
+	}
+	return Open_(partField_, partFile_);
+}
+
+bool MultipartSink::PartData_(const char* data, size_t len) {
+	if(fd_ >= 0) {
+		return Append_(data, len);
+	}
+	fieldBytes_ += len;
+	if(fieldBytes_ > MAX_FIELD_BYTES) {
+		return Error_(413);
+	}
+	partValue_.append(data, len);
+	return true;
+}
+
+bool MultipartSink::EndPart_() {
+	if(fd_ >= 0) {
+		return Commit_();
+	}
+	fields_[partField_].swap(partValue_);
+	return true;
+}
@@ -0,0 +1,105 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "bodysink.h"
+
+/*文件上传的接收者，请求体直接写入上传目录，不经过内存中的缓冲。
+文件先写到上传目录下的临时文件，收完后以（清理过的）原文件名链接过去，同名时加序号，不会覆盖已有文件；
+请求没有收完（连接断开、超过上限、格式错误）时删除临时文件。*/
+class UploadSink : public BodySink {
+public:
+	struct File {
+		std::string field; // 表单字段名
+		std::string name;  // 客户端给出的文件名
+		std::string path;  // 保存的路径
+		size_t size;
+	};
+	~UploadSink() override { Abort_(); }
+
+	const std::vector<File>& Files() const { return files_; }
+	int ErrorCode() const override { return error_; }
+	size_t MaxBytes() const override { return maxBytes; }
+
+	static std::string dir;	 // 上传目录（末尾带 '/'），为空时不接受上传
+	static size_t maxBytes;	 // 一个上传请求的请求体上限
+
+protected:
+	bool Open_(const std::string& field, const std::string& name); // 开始一个文件
+	bool Append_(const char* data, size_t len);
+	bool Commit_(); // 文件收完，改为最终的文件名
+	void Abort_();	// 删除没有收完的文件
+	bool Error_(int code) { error_ = code; return false; }
+
+	static std::string SafeName_(const std::string& name); // 只保留文件名中的安全字符
+
+	int fd_ = -1;		  // 正在写入的临时文件
+	std::string tmpPath_;
+	File cur_;
+	std::vector<File> files_;
+	int error_ = 500;
+};
+
+// 整个请求体就是文件内容（PUT /upload/<name>），长度已知，可以从套接字直接 splice 到文件
+class FileSink : public UploadSink {
+public:
+	explicit FileSink(const std::string& name);
+
+	bool Write(const char* data, size_t len) override;
+	bool Finish() override;
+	int SpliceFd() const override { return fd_; }
+	void OnSpliced(size_t len) override { cur_.size += len; }
+};
+
+/*multipart/form-data 的流式解析。
+请求体分段到达，分隔符（"\r\n--" + boundary）可能跨两段，每段末尾可能是分隔符前缀的部分留到下一段再判断。
+文件部分边解析边写入文件，普通字段保存在 Fields() 中（总共最多 MAX_FIELD_BYTES）。
+分隔符用 SSE2 先比较首尾两个字节、一次检查 16 个位置，候选位置再 memcmp 确认。*/
+class MultipartSink : public UploadSink {
+public:
+	explicit MultipartSink(const std::string& boundary);
+
+	// 从 Content-Type 中取出 boundary，不是 multipart/form-data 时返回空串
+	static std::string Boundary(const std::string& contentType);
+
+	bool Write(const char* data, size_t len) override;
+	bool Finish() override;
+
+	const std::unordered_map<std::string, std::string>& Fields() const { return fields_; }
+
+	static const size_t MAX_PART_HEADER = 4096;	 // 每个部分的头部上限
+	static const size_t MAX_FIELD_BYTES = 64 * 1024; // 普通字段的总大小上限
+
+private:
+	enum STATE {
+		PREAMBLE,	  // 第一个分隔符之前
+		AFTER_DELIM,  // 分隔符之后："--" 表示结束，"\r\n" 表示下一个部分
+		PART_HEADERS, // 部分的头部
+		PART_DATA,	  // 部分的内容
+		EPILOGUE,	  // 结束分隔符之后，忽略
+	};
+
+	size_t Process_(const char* data, size_t len); // 返回处理了多少字节，剩下的需要和下一段一起判断
+	const char* FindDelimiter_(const char* data, size_t len) const;
+	size_t PartialTail_(const char* data, size_t len) const; // 末尾可能是分隔符前缀的字节数
+	bool PartHeader_(const std::string& line);
+	bool BeginPart_();
+	bool PartData_(const char* data, size_t len);
+	bool EndPart_();
+
+	std::string delim_; // "\r\n--" + boundary
+	STATE state_ = PREAMBLE;
+	std::string carry_; // 上一段没有处理完的字节
+	bool failed_ = false;
+
+	std::string partField_, partFile_; // 当前部分的字段名和文件名（没有文件名的是普通字段）
+	size_t partHeaderBytes_ = 0;
+	std::string partValue_;
+	size_t fieldBytes_ = 0;
+	std::unordered_map<std::string, std::string> fields_;
+};
+
+#endif // UPLOAD_H
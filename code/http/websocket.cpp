@@ -0,0 +1,413 @@
+#include "websocket.h"
+#include "httpconn.h"
+#include "httpscan.h"
+
+#include <algorithm> // find
+#include <assert.h>
+#include <string.h>  // memcpy, strlen
+#include <strings.h> // strncasecmp
+
+#include "../log/log.h"
+
+using namespace std;
+
+size_t WebSocket::maxMessageBytes = 1024 * 1024;
+
+WebSocket::WebSocket(HttpConn* conn, shared_ptr<WebSocketHandler> handler)
+	: conn_(conn), handler_(std::move(handler)), inFrame_(false), fin_(false), opcode_(0), mask_(),
+	  remaining_(0), maskOffset_(0), msgOpcode_(0), closeSent_(false), done_(false), opened_(false) {}
+
+WebSocket::~WebSocket() {
+	assert(groups_.empty());
+}
+
+bool WebSocket::Send(const Frame& frame) {
+	return !closeSent_.load() && conn_->Push(frame) == HttpConn::PUSH_QUEUED;
+}
+
+void WebSocket::Close(uint16_t code) {
+	if(!closeSent_.exchange(true)) {
+		conn_->Push(EncodeClose(code));
+	}
+}
+
+void WebSocket::Open() {
+	opened_ = true;
+	handler_->OnOpen(*this);
+}
+
+bool WebSocket::Ping() {
+	static const Frame PING_FRAME = Encode(PING, nullptr, 0);
+	if(!closeSent_.load()) {
+		conn_->Push(PING_FRAME);
+	}
+	return true;
+}
+
+void WebSocket::Closed() {
+	for(WebSocketGroup* group : groups_) {
+		group->Remove_(this);
+	}
+	groups_.clear();
+	if(opened_) {
+		opened_ = false;
+		handler_->OnClose(*this);
+	}
+}
+
+bool WebSocket::Parse(Buffer& buff) {
+	while(!done_) {
+		if(!inFrame_ && ParseHeader_(buff) <= 0) {
+			break;
+		}
+		size_t n = static_cast<size_t>(min<uint64_t>(remaining_, buff.ReadableBytes()));
+		if(n > 0) {
+			// 载荷追加到消息（或控制帧）之后再原地解除掩码，读缓冲区中的数据只复制一次
+			string& target = opcode_ & 0x8 ? control_ : message_;
+			size_t start = target.size();
+			target.append(buff.Peek(), n);
+			buff.Retrieve(n);
+			Unmask_(&target[start], n);
+			remaining_ -= n;
+		}
+		if(remaining_ > 0) {
+			break; // 等待更多数据
+		}
+		inFrame_ = false;
+		OnFrame_();
+	}
+	if(done_) {
+		buff.RetrieveAll(); // 关闭之后到达的数据丢弃
+	}
+	return !done_;
+}
+
+int WebSocket::ParseHeader_(Buffer& buff) {
+	size_t avail = buff.ReadableBytes();
+	if(avail < 2) {
+		return 0;
+	}
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buff.Peek());
+	bool fin = p[0] & 0x80;
+	int opcode = p[0] & 0x0f;
+	uint64_t len = p[1] & 0x7f;
+	// 没有协商扩展，RSV 必须为 0；客户端的帧必须带掩码
+	if((p[0] & 0x70) || !(p[1] & 0x80)) {
+		Fail_(PROTOCOL_ERROR);
+		return -1;
+	}
+	size_t head = 2 + (len == 126 ? 2 : len == 127 ? 8 : 0) + 4; // 扩展长度 + 4 字节掩码
+	if(avail < head) {
+		return 0;
+	}
+	if(len == 126) {
+		len = p[2] << 8 | p[3];
+	} else if(len == 127) {
+		len = 0;
+		for(int i = 0; i < 8; i++) {
+			len = len << 8 | p[2 + i];
+		}
+	}
+	if(opcode & 0x8) {
+		// 控制帧不能分片，载荷不超过 125 字节，可以插在分片消息的中间
+		if(opcode > PONG || !fin || len > 125) {
+			Fail_(PROTOCOL_ERROR);
+			return -1;
+		}
+		control_.clear();
+	} else {
+		// 分片消息以 TEXT/BINARY 开始，之后都是 CONTINUATION
+		if(opcode > BINARY || (opcode == CONTINUATION) != (msgOpcode_ != 0)) {
+			Fail_(PROTOCOL_ERROR);
+			return -1;
+		}
+		if(len > maxMessageBytes || message_.size() + len > maxMessageBytes) {
+			Fail_(MESSAGE_TOO_BIG);
+			return -1;
+		}
+		if(opcode != CONTINUATION) {
+			msgOpcode_ = opcode;
+		}
+	}
+	memcpy(mask_, p + head - 4, 4);
+	buff.Retrieve(head);
+	fin_ = fin;
+	opcode_ = opcode;
+	remaining_ = len;
+	maskOffset_ = 0;
+	inFrame_ = true;
+	return 1;
+}
+
+// 帧的载荷可能分几次到达，每次从 maskOffset_ 对应的掩码字节开始
+void WebSocket::Unmask_(char* data, size_t len) {
+	unsigned char key[4];
+	for(int i = 0; i < 4; i++) {
+		key[i] = mask_[(maskOffset_ + i) & 3];
+	}
+	HttpScan::Unmask(data, len, key);
+	maskOffset_ += len;
+}
+
+void WebSocket::OnFrame_() {
+	switch(opcode_) {
+	case PING:
+		if(!closeSent_.load()) {
+			conn_->Push(Encode(PONG, control_.data(), control_.size()));
+		}
+		break;
+	case PONG:
+		break; // 收到数据时连接已刷新活动时间
+	case CLOSE: {
+		uint16_t code = NO_STATUS;
+		if(control_.size() == 1) {
+			Fail_(PROTOCOL_ERROR);
+			return;
+		}
+		if(control_.size() >= 2) {
+			code = static_cast<uint8_t>(control_[0]) << 8 | static_cast<uint8_t>(control_[1]);
+			bool valid = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+			if(!valid || !ValidUtf8_(control_.data() + 2, control_.size() - 2)) {
+				Fail_(PROTOCOL_ERROR);
+				return;
+			}
+		}
+		// 对方先发的关闭帧：原样回复状态码；我们先发的：这是回复，握手完成
+		if(!closeSent_.exchange(true)) {
+			conn_->Push(EncodeClose(code == NO_STATUS ? NORMAL : code));
+		}
+		done_ = true;
+		break;
+	}
+	default:
+		if(!fin_) {
+			break; // 还有后续分片
+		}
+		if(msgOpcode_ == TEXT && !ValidUtf8_(message_.data(), message_.size())) {
+			Fail_(INVALID_DATA);
+			return;
+		}
+		handler_->OnMessage(*this, static_cast<Opcode>(msgOpcode_), message_);
+		message_.clear();
+		msgOpcode_ = 0;
+		break;
+	}
+}
+
+void WebSocket::Fail_(uint16_t code) {
+	LOG_DEBUG("WebSocket[%d] fail: %d", conn_->GetFd(), code);
+	if(!closeSent_.exchange(true)) {
+		conn_->Push(EncodeClose(code));
+	}
+	done_ = true;
+}
+
+bool WebSocket::ValidUtf8_(const char* data, size_t len) {
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* end = p + len;
+	while(p < end) {
+		// 一次跳过 8 个 ASCII 字节
+		uint64_t v;
+		if(end - p >= 8 && (memcpy(&v, p, 8), (v & 0x8080808080808080ull) == 0)) {
+			p += 8;
+			continue;
+		}
+		unsigned c = *p;
+		if(c < 0x80) {
+			p++;
+			continue;
+		}
+		int n;
+		uint32_t cp, min;
+		if((c & 0xe0) == 0xc0) {
+			n = 1, cp = c & 0x1f, min = 0x80;
+		} else if((c & 0xf0) == 0xe0) {
+			n = 2, cp = c & 0x0f, min = 0x800;
+		} else if((c & 0xf8) == 0xf0) {
+			n = 3, cp = c & 0x07, min = 0x10000;
+		} else {
+			return false;
+		}
+		if(end - p <= n) {
+			return false;
+		}
+		for(int i = 1; i <= n; i++) {
+			if((p[i] & 0xc0) != 0x80) {
+				return false;
+			}
+			cp = cp << 6 | (p[i] & 0x3f);
+		}
+		// 过长的编码、代理对和超出 Unicode 范围的码点都不合法
+		if(cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+			return false;
+		}
+		p += n + 1;
+	}
+	return true;
+}
+
+// Connection 是逗号分隔的列表，例如 "keep-alive, Upgrade"
+static bool HasToken_(HeaderTable::View value, const char* token) {
+	size_t tokenLen = strlen(token);
+	const char* p = value.data;
+	const char* end = value.data + value.size;
+	while(p && p < end) {
+		while(p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+			p++;
+		}
+		const char* e = p;
+		while(e < end && *e != ',') {
+			e++;
+		}
+		const char* t = e;
+		while(t > p && (t[-1] == ' ' || t[-1] == '\t')) {
+			t--;
+		}
+		if(static_cast<size_t>(t - p) == tokenLen && strncasecmp(p, token, tokenLen) == 0) {
+			return true;
+		}
+		p = e;
+	}
+	return false;
+}
+
+bool WebSocket::IsUpgradeRequest(const HttpRequest& request) {
+	HeaderTable::View key = request.Header(HeaderTable::SEC_WEBSOCKET_KEY);
+	return request.method() == "GET" &&
+		request.Header(HeaderTable::UPGRADE).EqualsIgnoreCase("websocket") &&
+		HasToken_(request.Header(HeaderTable::CONNECTION), "upgrade") &&
+		request.Header(HeaderTable::SEC_WEBSOCKET_VERSION) == "13" &&
+		key.size == 24; // 16 字节随机数的 base64
+}
+
+// SHA-1（FIPS 180-4），只用于握手
+static void Sha1_(const string& message, uint8_t digest[20]) {
+	uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	string data = message;
+	uint64_t bits = static_cast<uint64_t>(message.size()) * 8;
+	data.push_back(static_cast<char>(0x80));
+	while(data.size() % 64 != 56) {
+		data.push_back(0);
+	}
+	for(int i = 7; i >= 0; i--) {
+		data.push_back(static_cast<char>(bits >> (i * 8)));
+	}
+	auto rotl = [](uint32_t x, int n) { return x << n | x >> (32 - n); };
+	for(size_t off = 0; off < data.size(); off += 64) {
+		uint32_t w[80];
+		for(int i = 0; i < 16; i++) {
+			const uint8_t* b = reinterpret_cast<const uint8_t*>(data.data() + off + i * 4);
+			w[i] = static_cast<uint32_t>(b[0]) << 24 | b[1] << 16 | b[2] << 8 | b[3];
+		}
+		for(int i = 16; i < 80; i++) {
+			w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(int i = 0; i < 80; i++) {
+			uint32_t f, k;
+			if(i < 20) {
+				f = (b & c) | (~b & d), k = 0x5a827999;
+			} else if(i < 40) {
+				f = b ^ c ^ d, k = 0x6ed9eba1;
+			} else if(i < 60) {
+				f = (b & c) | (b & d) | (c & d), k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d, k = 0xca62c1d6;
+			}
+			uint32_t t = rotl(a, 5) + f + e + k + w[i];
+			e = d, d = c, c = rotl(b, 30), b = a, a = t;
+		}
+		h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+	}
+	for(int i = 0; i < 20; i++) {
+		digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+	}
+}
+
+string WebSocket::AcceptKey(const char* key, size_t len) {
+	static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint8_t digest[21] = {0}; // 多一个 0 字节，20 字节按 3 字节一组编码时最后一组不越界
+	Sha1_(string(key, len) + GUID, digest);
+	string out;
+	for(int i = 0; i < 20; i += 3) {
+		uint32_t v = digest[i] << 16 | digest[i + 1] << 8 | digest[i + 2];
+		out.push_back(BASE64[v >> 18 & 63]);
+		out.push_back(BASE64[v >> 12 & 63]);
+		out.push_back(BASE64[v >> 6 & 63]);
+		out.push_back(i + 2 < 20 ? BASE64[v & 63] : '=');
+	}
+	return out;
+}
+
+WebSocket::Frame WebSocket::Encode(Opcode opcode, const char* data, size_t len, bool fin) {
+	shared_ptr<string> frame = make_shared<string>();
+	frame->reserve(len + 10);
+	frame->push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+	if(len < 126) {
+		frame->push_back(static_cast<char>(len));
+	} else if(len <= 0xffff) {
+		frame->push_back(126);
+		frame->push_back(static_cast<char>(len >> 8));
+		frame->push_back(static_cast<char>(len));
+	} else {
+		frame->push_back(127);
+		for(int i = 7; i >= 0; i--) {
+			frame->push_back(static_cast<char>(static_cast<uint64_t>(len) >> (i * 8)));
+		}
+	}
+	frame->append(data, len);
+	return frame;
+}
+
+WebSocket::Frame WebSocket::EncodeClose(uint16_t code) {
+	char payload[2] = { static_cast<char>(code >> 8), static_cast<char>(code) };
+	return Encode(CLOSE, payload, sizeof(payload));
+}
+
+void WebSocketGroup::Join(WebSocket* ws) {
+	{
+		lock_guard<mutex> locker(mtx_);
+		if(find(members_.begin(), members_.end(), ws) != members_.end()) {
+			return;
+		}
+		members_.push_back(ws);
+	}
+	ws->groups_.push_back(this);
+}
+
+void WebSocketGroup::Leave(WebSocket* ws) {
+	Remove_(ws);
+	auto it = find(ws->groups_.begin(), ws->groups_.end(), this);
+	if(it != ws->groups_.end()) {
+		ws->groups_.erase(it);
+	}
+}
+
+void WebSocketGroup::Remove_(WebSocket* ws) {
+	lock_guard<mutex> locker(mtx_);
+	auto it = find(members_.begin(), members_.end(), ws);
+	if(it != members_.end()) {
+		*it = members_.back(); // 顺序无关，和最后一个交换后删除
+		members_.pop_back();
+	}
+}
+
+// 在锁内只把同一个 Frame 的引用放进各个连接的发送队列，不编码、不写套接字
+size_t WebSocketGroup::Broadcast(const WebSocket::Frame& frame) {
+	lock_guard<mutex> locker(mtx_);
+	size_t count = 0;
+	for(WebSocket* ws : members_) {
+		count += ws->Send(frame);
+	}
+	return count;
+}
+
+size_t WebSocketGroup::Broadcast(WebSocket::Opcode opcode, const string& message) {
+	return Broadcast(WebSocket::Encode(opcode, message.data(), message.size()));
+}
+
+size_t WebSocketGroup::Size() {
+	lock_guard<mutex> locker(mtx_);
+	return members_.size();
+}
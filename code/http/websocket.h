@@ -0,0 +1,134 @@
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include "../buffer/buffer.h"
+#include "httprequest.h"
+#include "streamsession.h"
+
+class HttpConn;
+class WebSocketHandler;
+class WebSocketGroup;
+
+/*RFC 6455 WebSocket 连接。
+握手由 HttpConn 在路由指定了 WebSocketHandler 的请求上完成（101），之后连接上的数据都按帧解析：
+客户端的帧必须带掩码，载荷到达多少就解除多少（HttpScan::Unmask），不需要等整个帧到齐；
+分片的消息拼接完整后交给处理函数，ping 自动回复 pong，收到 close 时回复 close，发完后断开。
+发出的帧不加掩码，编码成不可变、带引用计数的 Frame 放入连接的发送队列，广播时所有接收者共享同一个 Frame。
+同一个连接的回调不会并发执行：它们都在持有连接所有权的线程中调用。*/
+class WebSocket : public StreamSession {
+public:
+	enum Opcode {
+		CONTINUATION = 0x0,
+		TEXT = 0x1,
+		BINARY = 0x2,
+		CLOSE = 0x8,
+		PING = 0x9,
+		PONG = 0xa,
+	};
+
+	// 关闭帧中的状态码
+	enum CloseCode {
+		NORMAL = 1000,
+		GOING_AWAY = 1001,
+		PROTOCOL_ERROR = 1002,
+		NO_STATUS = 1005, // 收到的关闭帧没有状态码，不能发送
+		INVALID_DATA = 1007,
+		MESSAGE_TOO_BIG = 1009,
+	};
+
+	typedef std::shared_ptr<const std::string> Frame; // 编码好的帧，多个连接共享
+
+	WebSocket(HttpConn* conn, std::shared_ptr<WebSocketHandler> handler);
+	~WebSocket() override;
+
+	// 任何线程都可以调用；已经发出关闭帧、连接已关闭或发送队列超过上限时返回 false
+	bool Send(const Frame& frame);
+	bool SendText(const std::string& text) { return Send(Encode(TEXT, text.data(), text.size())); }
+	// 发送关闭帧，对方回复关闭帧后断开；任何线程都可以调用，只有第一次有效
+	void Close(uint16_t code = NORMAL);
+
+	HttpConn* Conn() const { return conn_; }
+
+	// StreamSession，由 HttpConn 在持有连接所有权时调用
+	void Open() override;              // 握手响应已发完：调用 OnOpen
+	bool Parse(Buffer& buff) override; // 处理已到达的数据，关闭握手完成或协议错误后返回 false
+	bool Finished() const override { return done_; }
+	bool Ping() override;              // 长时间没有收到数据时发出 ping，需要对方回应
+	void Closed() override;            // 连接已关闭：离开所有组，调用 OnClose
+
+	// 请求是否为合法的升级请求：GET、Upgrade: websocket、Connection 含 upgrade、版本 13、Sec-WebSocket-Key
+	static bool IsUpgradeRequest(const HttpRequest& request);
+	// Sec-WebSocket-Accept：base64(SHA-1(key + 固定的 GUID))
+	static std::string AcceptKey(const char* key, size_t len);
+	// 编码一个不加掩码的帧；fin 为 false 时是一条消息的一个分片，后续分片用 CONTINUATION
+	static Frame Encode(Opcode opcode, const char* data, size_t len, bool fin = true);
+	static Frame EncodeClose(uint16_t code);
+
+	static size_t maxMessageBytes; // 一条消息（所有分片）的上限，超过时以 1009 关闭
+
+private:
+	int ParseHeader_(Buffer& buff); // 1：帧头已解析；0：还不完整；-1：协议错误
+	void Unmask_(char* data, size_t len);
+	void OnFrame_(); // 当前帧的载荷收完
+	void Fail_(uint16_t code); // 协议错误：发出关闭帧，不再读
+	static bool ValidUtf8_(const char* data, size_t len);
+
+	HttpConn* conn_;
+	std::shared_ptr<WebSocketHandler> handler_;
+	std::vector<WebSocketGroup*> groups_; // 加入的组，关闭时自动离开
+
+	// 正在接收的帧
+	bool inFrame_;          // 帧头已解析，载荷还没收完
+	bool fin_;
+	int opcode_;
+	unsigned char mask_[4];
+	uint64_t remaining_;    // 还没收到的载荷字节数
+	uint64_t maskOffset_;   // 已解除掩码的载荷字节数，决定下一个字节用哪个掩码字节
+
+	int msgOpcode_;         // 正在拼接的消息的类型（TEXT/BINARY），0 表示没有
+	std::string message_;   // 拼接中的消息，在各条消息之间复用容量
+	std::string control_;   // 控制帧的载荷，最多 125 字节
+	std::atomic<bool> closeSent_;
+	bool done_;             // 关闭握手已完成或出现协议错误
+	bool opened_;
+
+	friend class WebSocketGroup;
+};
+
+// 应用的处理函数，注册在路由上（Router::AddWebSocket），所有连接共用一个
+class WebSocketHandler {
+public:
+	virtual ~WebSocketHandler() = default;
+	virtual void OnOpen(WebSocket& ws) {}
+	// 一条完整的消息，TEXT 已校验为 UTF-8；message 在回调返回后被复用
+	virtual void OnMessage(WebSocket& ws, WebSocket::Opcode opcode, const std::string& message) = 0;
+	virtual void OnClose(WebSocket& ws) {}
+};
+
+/*一组连接，广播的消息只编码一次，所有成员共享同一个 Frame。
+Join/Leave 在这个连接的回调中调用，连接关闭时自动离开；组要比其中的连接活得长（通常是处理函数的成员）。*/
+class WebSocketGroup {
+public:
+	void Join(WebSocket* ws);
+	void Leave(WebSocket* ws);
+	size_t Broadcast(const WebSocket::Frame& frame); // 任何线程都可以调用，返回接受了这一帧的连接数
+	size_t Broadcast(WebSocket::Opcode opcode, const std::string& message);
+	size_t Size();
+
+private:
+	void Remove_(WebSocket* ws);
+
+	std::mutex mtx_;
+	std::vector<WebSocket*> members_;
+
+	friend class WebSocket;
+};
+
+#endif // WEBSOCKET_H
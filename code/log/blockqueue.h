@@ -139,11 +139,16 @@ bool BlockQueue<T>::pop(T &item)
     unique_lock<mutex> locker(mtx_);
     while (deq_.empty())
     {
+        if (isClose_)
+        {
+            return false; // 队列已关闭，写线程退出
+        }
         condConsumer_.wait(locker); // 队列空了，需要等待
     }
     item = deq_.front();
     deq_.pop_front();
     condProducer_.notify_one(); // 唤醒生产者
+    return true;
 }
 
 template <typename T>
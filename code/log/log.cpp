@@ -90,12 +90,95 @@ void Log::init(int level, const char* path, const char* suffix, int maxQueCapaci
 			flush();
 			fclose(fp_);
 		}
-		fp_ = fopen(fileName, "a");  // 打开文件读取并附加写入
+		fp_ = fopen(fileName, "ae");  // 打开文件读取并附加写入（e：O_CLOEXEC，热升级 exec 时不继承）
 		if(fp_ == nullptr) {
 			mkdir(path_, 0777);
-			fp_ = fopen(fileName, "a");  // 生成目录文件（最大权限）
+			fp_ = fopen(fileName, "ae");  // 生成目录文件（最大权限）
 		}
 		assert(fp_ != nullptr);
 	}
 }
 
+
+// 写一条日志：时间戳取 TimeService 预先格式化好的字符串，日期变化或行数超过上限时换文件
+void Log::write(int level, const char *format, ...) {
+	// 工作线程、定时任务等不在反应堆线程中写日志，事件循环空闲时快照可能是几秒甚至几小时之前的；
+	// 秒数没变时 Update() 只是一次 CLOCK_REALTIME_COARSE（vDSO）和比较
+	TimeService::Update();
+	const TimeService::Snapshot* now = TimeService::Now();
+	va_list vaList;
+
+	unique_lock<mutex> locker(mtx_);
+	if(toDay_ != now->mday || (lineCount_ && (lineCount_ % MAX_LINES == 0))) {
+		char newFile[LOG_NAME_LEN];
+		char tail[36] = {0};
+		snprintf(tail, sizeof(tail), "%04d_%02d_%02d", now->year, now->mon, now->mday);
+		if(toDay_ != now->mday) {
+			snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+			toDay_ = now->mday;
+			lineCount_ = 0;
+		} else {
+			snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_ / MAX_LINES), suffix_);
+		}
+		flush();
+		fclose(fp_);
+		fp_ = fopen(newFile, "ae");
+		assert(fp_ != nullptr);
+	}
+
+	lineCount_++;
+	buff_.Append(now->logTime, TimeService::LOG_TIME_LEN);
+	buff_.Append(" ", 1);
+	AppendLogLevelTitle_(level);
+	va_start(vaList, format);
+	int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
+	va_end(vaList);
+	if(m >= 0 && static_cast<size_t>(m) >= buff_.WritableBytes()) { // 放不下：扩容后重新格式化
+		buff_.EnsureWriteable(m + 1);
+		va_start(vaList, format);
+		m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
+		va_end(vaList);
+	}
+	if(m > 0) {
+		buff_.HasWritten(m);
+	}
+	buff_.Append("\n", 1);
+	if(isAsync_ && deque_ && !deque_->full()) { // 异步：交给写线程
+		string line = buff_.RetrieveAllToStr();
+		locker.unlock(); // 写线程写文件时要加同一把锁，队列满时 push_back 会等它
+		deque_->push_back(line);
+		return;
+	}
+	fwrite(buff_.Peek(), 1, buff_.ReadableBytes(), fp_);
+	buff_.RetrieveAll();
+}
+
+void Log::AppendLogLevelTitle_(int level) {
+	switch(level) {
+	case 0:
+		buff_.Append("[debug]: ", 9);
+		break;
+	case 1:
+		buff_.Append("[info] : ", 9);
+		break;
+	case 2:
+		buff_.Append("[warn] : ", 9);
+		break;
+	case 3:
+		buff_.Append("[error]: ", 9);
+		break;
+	default:
+		buff_.Append("[info] : ", 9);
+		break;
+	}
+}
+
+int Log::GetLevel() {
+	lock_guard<mutex> locker(mtx_);
+	return level_;
+}
+
+void Log::SetLevel(int level) {
+	lock_guard<mutex> locker(mtx_);
+	level_ = level;
+}
@@ -11,6 +11,7 @@
 #include <sys/stat.h>         // mkdir
 #include "blockqueue.h"
 #include "../buffer/buffer.h"
+#include "../timer/timeservice.h"
 
 class Log {
 public:
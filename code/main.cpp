@@ -5,8 +5,13 @@ int main()
 {
     // 守护进程 后台运行
     WebServer server(
-        1316, 3, 60000,                      // 端口 ET模式 timeoutMs
+        1316, 3, 60000,                      // 端口 ET模式（3：EPOLLONESHOT；4：持久注册） timeoutMs
         3306, "root", "123456", "webserver", /* Mysql配置 */
-        12, 8, true, 1, 1024);               /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 8, true, 1, 1024,                /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        24, true,                            /* 连接池最大连接数 工作线程独占数据库连接 */
+        nullptr,                             /* 嵌入式用户库文件（如 "./users.db"），为空时使用 MySQL */
+        true,                                /* 反应堆线程直接响应命中缓存的静态请求 */
+        1024, 256,                           /* 全连接队列长度 TCP Fast Open 队列长度 */
+        10000, 30000);                       /* 请求头超时 请求体超时（毫秒） */
     server.Start();
 }
@@ -0,0 +1,180 @@
+#include "registerbatcher.h"
+#include "userfilter.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+RegisterBatcher* RegisterBatcher::Instance() {
+	static RegisterBatcher batcher;
+	return &batcher;
+}
+
+void RegisterBatcher::Init(size_t maxBatch, int windowMs) {
+	assert(maxBatch > 0 && windowMs >= 0);
+	lock_guard<mutex> locker(mtx_);
+	if(!isClosed_) {
+		return;
+	}
+	maxBatch_ = maxBatch;
+	windowMs_ = windowMs;
+	isClosed_ = false;
+	flushThread_ = std::thread(&RegisterBatcher::FlushLoop_, this);
+}
+
+std::future<bool> RegisterBatcher::Submit(const std::string& name, const std::string& pwd) {
+	lock_guard<mutex> locker(mtx_);
+	if(isClosed_) {
+		std::promise<bool> refused;
+		refused.set_value(false);
+		return refused.get_future();
+	}
+	pending_.push_back({name, pwd, std::promise<bool>(), std::chrono::steady_clock::now()});
+	std::future<bool> result = pending_.back().result.get_future();
+	// 第一条到达时开始计时，凑满一批时立即提交
+	if(pending_.size() == 1 || pending_.size() >= maxBatch_) {
+		cond_.notify_one();
+	}
+	return result;
+}
+
+void RegisterBatcher::Close() {
+	{
+		lock_guard<mutex> locker(mtx_);
+		if(isClosed_) {
+			return;
+		}
+		isClosed_ = true;
+	}
+	cond_.notify_one();
+	if(flushThread_.joinable()) {
+		flushThread_.join(); // 后台线程退出前会把剩余的注册提交完
+	}
+}
+
+void RegisterBatcher::FlushLoop_() {
+	unique_lock<mutex> locker(mtx_);
+	while(true) {
+		cond_.wait(locker, [this]() { return isClosed_ || !pending_.empty(); });
+		if(pending_.empty()) {
+			break; // 已关闭且没有剩余
+		}
+		// 时间窗口：从第一条入队开始最多等待 windowMs_，凑满一批则提前提交
+		auto deadline = pending_.front().enqueued + std::chrono::milliseconds(windowMs_);
+		cond_.wait_until(locker, deadline, [this]() {
+			return isClosed_ || pending_.size() >= maxBatch_;
+		});
+		std::vector<Pending> batch;
+		while(!pending_.empty() && batch.size() < maxBatch_) {
+			batch.push_back(std::move(pending_.front()));
+			pending_.pop_front();
+		}
+		locker.unlock();
+		Flush_(batch);
+		locker.lock();
+	}
+	locker.unlock();
+	mysql_thread_end();
+}
+
+// 转义后加上单引号，用于拼接 SQL
+static std::string Quote_(MYSQL* sql, const std::string& str) {
+	std::string out(str.size() * 2 + 3, '\0');
+	out[0] = '\'';
+	unsigned long len = mysql_real_escape_string(sql, &out[1], str.c_str(), str.size());
+	out[len + 1] = '\'';
+	out.resize(len + 2);
+	return out;
+}
+
+void RegisterBatcher::Flush_(std::vector<Pending>& batch) {
+	// 同一批内重复的用户名只有第一个可能成功，按 username 列的排序规则比较（与 UserFilter 一致）
+	std::vector<Pending*> rows;
+	std::unordered_set<std::string> seen;
+	for(auto& p : batch) {
+		if(seen.insert(UserFilter::Instance()->Key(p.name)).second) {
+			rows.push_back(&p);
+		} else {
+			p.result.set_value(false);
+		}
+	}
+
+	MYSQL* sql;
+	SqlConnRAII sqlConn(&sql, SqlConnPool::Instance());
+	if(!sql) {
+		LOG_WARN("RegisterBatcher: no sql connection, %d registrations failed", (int)rows.size());
+		for(auto p : rows) {
+			p->result.set_value(false);
+		}
+		return;
+	}
+
+	std::unordered_map<std::string, std::string> quoted;
+	std::string names;
+	for(auto p : rows) {
+		quoted[p->name] = Quote_(sql, p->name);
+		names += (names.empty() ? "" : ",") + quoted[p->name];
+	}
+
+	if(mysql_query(sql, "START TRANSACTION")) {
+		LOG_WARN("RegisterBatcher: start transaction error: %s", mysql_error(sql));
+		InsertOneByOne_(sql, rows);
+		return;
+	}
+	// 锁定读：找出已存在的用户名，这些注册直接判定失败
+	std::string order = "SELECT username FROM user WHERE username IN (" + names + ") FOR UPDATE";
+	LOG_DEBUG("%s", order.c_str());
+	if(mysql_query(sql, order.c_str())) {
+		LOG_WARN("RegisterBatcher: select error: %s", mysql_error(sql));
+		mysql_query(sql, "ROLLBACK");
+		InsertOneByOne_(sql, rows);
+		return;
+	}
+	std::unordered_set<std::string> exists;
+	MYSQL_RES* res = mysql_store_result(sql);
+	while(MYSQL_ROW row = mysql_fetch_row(res)) {
+		if(row[0]) {
+			exists.insert(UserFilter::Instance()->Key(row[0]));
+		}
+	}
+	mysql_free_result(res);
+
+	std::vector<Pending*> inserts;
+	order = "INSERT INTO user(username, password) VALUES ";
+	for(auto p : rows) {
+		if(exists.count(UserFilter::Instance()->Key(p->name))) {
+			LOG_INFO("user used!");
+			p->result.set_value(false);
+			continue;
+		}
+		order += (inserts.empty() ? "(" : ",(") + quoted[p->name] + "," + Quote_(sql, p->pwd) + ")";
+		inserts.push_back(p);
+	}
+	if(inserts.empty()) {
+		mysql_query(sql, "COMMIT");
+		return;
+	}
+	LOG_DEBUG("%s", order.c_str());
+	if(mysql_query(sql, order.c_str()) || mysql_query(sql, "COMMIT")) {
+		// 多行插入整体失败（例如其他进程抢先插入触发唯一键冲突），回滚后逐条确定结果
+		LOG_WARN("RegisterBatcher: batch insert error: %s", mysql_error(sql));
+		mysql_query(sql, "ROLLBACK");
+		InsertOneByOne_(sql, inserts);
+		return;
+	}
+	LOG_DEBUG("RegisterBatcher: committed %d registrations", (int)inserts.size());
+	for(auto p : inserts) {
+		p->result.set_value(true);
+	}
+}
+
+void RegisterBatcher::InsertOneByOne_(MYSQL* sql, std::vector<Pending*>& rows) {
+	for(auto p : rows) {
+		std::string order = "INSERT INTO user(username, password) VALUES (" +
+							Quote_(sql, p->name) + "," + Quote_(sql, p->pwd) + ")";
+		bool ok = mysql_query(sql, order.c_str()) == 0;
+		if(!ok) {
+			LOG_DEBUG("Insert error!");
+		}
+		p->result.set_value(ok);
+	}
+}
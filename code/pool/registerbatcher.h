@@ -0,0 +1,56 @@
+#ifndef REGISTERBATCHER_H
+#define REGISTERBATCHER_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <chrono>
+#include "sqlconnpool.h"
+#include "../log/log.h"
+
+/*注册请求的组提交（group commit）。
+工作线程把新用户交给 Submit 后等待返回的 future；后台线程把一段时间窗口内（或凑满 maxBatch 条）
+的注册合并成一个事务：先 SELECT ... FOR UPDATE 找出已存在的用户名，再用一条多行 INSERT 写入其余用户。
+每条注册的结果（是否成功）通过各自的 promise 返回给对应的请求。*/
+class RegisterBatcher
+{
+private:
+	RegisterBatcher() = default;
+	~RegisterBatcher() { Close(); }
+
+	struct Pending
+	{
+		std::string name;
+		std::string pwd;
+		std::promise<bool> result;
+		std::chrono::steady_clock::time_point enqueued;
+	};
+
+	void FlushLoop_();							// 后台线程：按数量或时间窗口取出一批并提交
+	void Flush_(std::vector<Pending> &batch);	// 在一个事务中提交一批注册
+	void InsertOneByOne_(MYSQL *sql, std::vector<Pending *> &rows); // 批量插入失败时逐条插入，确定每条的结果
+
+	size_t maxBatch_ = 64;	// 每批最多合并的注册数
+	int windowMs_ = 2;		// 第一条注册最多等待多久就提交
+
+	std::deque<Pending> pending_;	 // 等待提交的注册
+	std::mutex mtx_;
+	std::condition_variable cond_;
+	std::thread flushThread_;
+	bool isClosed_ = true;
+
+public:
+	static RegisterBatcher *Instance();
+
+	void Init(size_t maxBatch = 64, int windowMs = 2);
+	// 提交一次注册，future 为 true 表示写入成功，false 表示用户名已存在或数据库错误
+	std::future<bool> Submit(const std::string &name, const std::string &pwd);
+	void Close(); // 提交剩余的注册并停止后台线程
+};
+
+#endif // REGISTERBATCHER_H
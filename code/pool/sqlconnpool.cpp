@@ -21,71 +21,299 @@ port: 数据库端口号。
 user: 数据库用户名。
 pwd: 数据库密码。
 dbName: 数据库名称。
-connSize: 连接池中连接的数量，默认为 10。
+connSize: 连接池的最小连接数，启动时全部建立。
+maxConnSize: 连接池的最大连接数，负载高时按需扩容，0 表示与 connSize 相同。
+idleTimeoutMs: 超出最小连接数的连接空闲多久后被回收。
+pingIntervalMs: 空闲连接健康检查（mysql_ping）的间隔。
 */
 void SqlConnPool::Init(const char* host, uint16_t port,
 				const char* user, const char* pwd,
-				const char* dbName, int connSize = 10) {
+				const char* dbName, int connSize,
+				int maxConnSize, int idleTimeoutMs, int pingIntervalMs) {
 	assert(connSize > 0);
-	// 创建指定数量的数据库连接。
+	host_ = host;
+	port_ = port;
+	user_ = user;
+	pwd_ = pwd;
+	dbName_ = dbName;
+	MIN_CONN_ = connSize;
+	MAX_CONN_ = maxConnSize > connSize ? maxConnSize : connSize;
+	idleTimeoutMs_ = idleTimeoutMs;
+	pingIntervalMs_ = pingIntervalMs;
+
+	// mysql_library_init 不是线程安全的，必须在并行建立连接之前调用一次
+	mysql_library_init(0, nullptr, nullptr);
+
+	// 并行建立初始连接：每个线程负责一条，启动耗时约等于一次握手的时间，而不是 connSize 次
+	std::vector<MYSQL*> conns(connSize, nullptr);
+	std::vector<std::thread> starters;
+	starters.reserve(connSize);
 	for(int i = 0; i < connSize; i++) {
-		MYSQL* conn = nullptr; // 声明一个指向 MYSQL 类型的指针 conn，并将其初始化为 nullptr。
-		conn = mysql_init(conn); // 调用 mysql_init 函数初始化 conn。如果初始化失败，conn 将保持为 nullptr。
-		if(!conn) {
-			LOG_ERROR("MySql init error!");
-			assert(conn);
-		}
-		// 调用 mysql_real_connect 函数连接到数据库。该函数使用提供的主机、用户、密码、数据库名称和端口号。如果连接失败，conn 将为 nullptr。
-		conn = mysql_real_connect(conn, host, user, pwd, dbName, port, nullptr, 0);
-		if(!conn) {
-			LOG_ERROR("MySql Connect error!");
-		}
-		// 将 conn 放入连接队列 connQue_ 中，即使连接失败也会放入队列。
-		// emplace 是 C++ 标准库中容器类（如 std::queue, std::vector, std::map 等）提供的一个成员函数。
-		//它用于在容器中原地构造元素，避免了不必要的拷贝或移动操作，从而提高性能。
-		connQue_.emplace(conn);
-	}
-	MAX_CONN_ = connSize;
-	// 初始化一个信号量 semId_，初始值为 MAX_CONN_。信号量用于控制对连接池的访问。
-	sem_init(&semId_, 0 ,MAX_CONN_);
+		starters.emplace_back([this, &conns, i]() {
+			conns[i] = Connect_();
+			mysql_thread_end(); // 释放 mysql_init 为本线程分配的资源
+		});
+	}
+	for(auto& t : starters) {
+		t.join();
+	}
+
+	{
+		lock_guard<mutex> locker(mtx_);
+		auto now = SteadyClock::now();
+		for(MYSQL* conn : conns) {
+			// 连接失败的不再放入队列，之后 GetConn 会按需重试扩容
+			if(conn) {
+				connQue_.push_back({conn, now});
+				totalConn_++;
+			}
+		}
+		isClosed_ = false;
+	}
+	if(totalConn_ < connSize) {
+		LOG_ERROR("MySql Connect error! %d/%d connections established", totalConn_, connSize);
+	}
+	maintainThread_ = std::thread(&SqlConnPool::MaintainLoop_, this);
 }
 
-MYSQL* SqlConnPool::GetConn() {
-	MYSQL* conn = nullptr; // 声明一个指向 MYSQL 类型的指针 conn，并将其初始化为 nullptr。
-	// 如果连接队列 connQue_ 为空，表示没有可用连接，返回 nullptr。
-	if(connQue_.empty()) {
-		LOG_WARN("SqlConnPool busy!");
+// 建立一条新连接，不持有锁调用
+MYSQL* SqlConnPool::Connect_() {
+	MYSQL* conn = mysql_init(nullptr); // 初始化 conn，失败返回 nullptr
+	if(!conn) {
+		LOG_ERROR("MySql init error!");
 		return nullptr;
 	}
-	// 如果连接队列 connQue_ 不为空，从队列中取出一个连接。
-	sem_wait(&semId_); // 等待信号量 semId_，如果信号量的值大于 0，将其减 1；否则阻塞当前线程。
-	lock_guard<mutex> locker(mtx_); // 创建一个 lock_guard 对象 locker，用于在作用域结束时自动释放互斥锁 mtx_。
-	conn = connQue_.front(); // 取出连接队列 connQue_ 的第一个元素，并将其赋值给 conn。
-	connQue_.pop(); // 弹出连接队列 connQue_ 的第一个元素。
-	return conn; // 返回取出的连接。
+	// 调用 mysql_real_connect 函数连接到数据库，失败时需要释放 mysql_init 分配的句柄
+	if(!mysql_real_connect(conn, host_.c_str(), user_.c_str(), pwd_.c_str(),
+						   dbName_.c_str(), port_, nullptr, 0)) {
+		LOG_ERROR("MySql Connect error: %s", mysql_error(conn));
+		mysql_close(conn);
+		return nullptr;
+	}
+	return conn;
+}
+
+MYSQL* SqlConnPool::GetConn(int timeoutMs) {
+	auto deadline = SteadyClock::now() + std::chrono::milliseconds(timeoutMs);
+	bool triedGrow = false; // 每次获取最多尝试扩容一次，避免数据库不可用时忙等
+	unique_lock<mutex> locker(mtx_);
+	while(!isClosed_) {
+		// 优先取最近归还的连接（队尾），冷连接留在队头等待收缩
+		if(!connQue_.empty()) {
+			IdleConn idle = connQue_.back();
+			connQue_.pop_back();
+			locker.unlock();
+			// 维护线程来不及检查的陈旧连接，在借出前透明地检测并重连
+			if(SteadyClock::now() - idle.lastUsed > std::chrono::milliseconds(pingIntervalMs_)
+			   && mysql_ping(idle.conn) != 0) {
+				LOG_WARN("MySql connection lost, reconnecting");
+				mysql_close(idle.conn);
+				idle.conn = Connect_();
+				if(!idle.conn) {
+					triedGrow = true; // 数据库刚连不上，不再用空出的名额重试一次
+					locker.lock();
+					totalConn_--;
+					cond_.notify_one(); // 空出的名额交给等待的线程
+					continue;
+				}
+			}
+			return idle.conn;
+		}
+		// 没有空闲连接但还没到上限：占一个名额，在锁外建立新连接
+		if(totalConn_ < MAX_CONN_ && !triedGrow) {
+			triedGrow = true;
+			totalConn_++;
+			locker.unlock();
+			MYSQL* conn = Connect_();
+			if(conn) {
+				LOG_INFO("SqlConnPool grow to %d", totalConn_);
+				return conn;
+			}
+			locker.lock();
+			totalConn_--;
+			cond_.notify_one();
+			continue;
+		}
+		// 等待其他线程归还，超时返回 nullptr
+		if(cond_.wait_until(locker, deadline) == std::cv_status::timeout && connQue_.empty()) {
+			LOG_WARN("SqlConnPool busy!");
+			return nullptr;
+		}
+	}
+	return nullptr;
 }
 
 // 存入连接池，实际上没有关闭
 void SqlConnPool::FreeConn(MYSQL* conn) {
 	assert(conn); // 断言 conn 不为空。
-	lock_guard<mutex> locker(mtx_); // 创建一个 lock_guard 对象 locker，用于在作用域结束时自动释放互斥锁 mtx_。
-	connQue_.push(conn); // 将连接 conn 放回连接队列 connQue_。
-	sem_post(&semId_); // 释放信号量 semId_，将其加 1。
+	{
+		lock_guard<mutex> locker(mtx_);
+		if(!isClosed_) {
+			connQue_.push_back({conn, SteadyClock::now()}); // 归还到队尾，下次优先被复用
+			cond_.notify_one(); // 唤醒一个等待连接的线程
+			return;
+		}
+		totalConn_--;
+	}
+	// 连接池已关闭，借出的连接归还时直接关闭
+	mysql_close(conn);
+}
+
+// 后台维护：定期检查空闲连接是否可用，并回收超出最小连接数且长时间空闲的连接
+void SqlConnPool::MaintainLoop_() {
+	// 检查周期取两者中较短的一个，但不小于 1 秒
+	auto interval = std::chrono::milliseconds(std::max(1000, std::min(pingIntervalMs_, idleTimeoutMs_)));
+	unique_lock<mutex> locker(mtx_);
+	while(!isClosed_) {
+		maintainCond_.wait_for(locker, interval);
+		if(isClosed_) {
+			break;
+		}
+		auto now = SteadyClock::now();
+		// 空闲收缩：队头是最久未使用的连接
+		std::vector<MYSQL*> expired;
+		while(!connQue_.empty() && totalConn_ > MIN_CONN_
+			  && now - connQue_.front().lastUsed > std::chrono::milliseconds(idleTimeoutMs_)) {
+			expired.push_back(connQue_.front().conn);
+			connQue_.pop_front();
+			totalConn_--;
+		}
+		// 健康检查：把久未使用的空闲连接暂时取出，在锁外 ping，避免阻塞 GetConn
+		std::vector<MYSQL*> stale;
+		for(auto it = connQue_.begin(); it != connQue_.end();) {
+			if(now - it->lastUsed > std::chrono::milliseconds(pingIntervalMs_)) {
+				stale.push_back(it->conn);
+				it = connQue_.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if(expired.empty() && stale.empty()) {
+			continue;
+		}
+		locker.unlock();
+		for(MYSQL* conn : expired) {
+			mysql_close(conn);
+		}
+		if(!expired.empty()) {
+			LOG_INFO("SqlConnPool shrink %d idle connections", (int)expired.size());
+		}
+		for(MYSQL*& conn : stale) {
+			if(mysql_ping(conn) != 0) {
+				LOG_WARN("MySql ping failed, reconnecting");
+				mysql_close(conn);
+				conn = Connect_();
+			}
+		}
+		locker.lock();
+		now = SteadyClock::now();
+		for(MYSQL* conn : stale) {
+			if(!conn) {
+				totalConn_--; // 重连失败，释放名额，之后由 GetConn 按需扩容
+				cond_.notify_one();
+			} else if(isClosed_) {
+				totalConn_--;
+				mysql_close(conn);
+			} else {
+				connQue_.push_front({conn, now}); // 放回队头，保持热连接在队尾
+				cond_.notify_one();
+			}
+		}
+	}
+	locker.unlock();
+	mysql_thread_end();
 }
 
 // 关闭连接池
 void SqlConnPool::ClosePool() {
-	lock_guard<mutex> locker(mtx_); // 创建一个 lock_guard 对象 locker，用于在作用域结束时自动释放互斥锁 mtx_。
+	{
+		lock_guard<mutex> locker(mtx_);
+		if(isClosed_ && !maintainThread_.joinable()) {
+			return; // 已经关闭过（WebServer 析构和单例析构都会调用）
+		}
+		isClosed_ = true;
+	}
+	maintainCond_.notify_all();
+	cond_.notify_all(); // 唤醒所有等待连接的线程，让它们返回 nullptr
+	if(maintainThread_.joinable()) {
+		maintainThread_.join();
+	}
+	lock_guard<mutex> locker(mtx_);
 	while(!connQue_.empty()) { // 循环直到连接队列 connQue_ 为空。
-		auto conn = connQue_.front(); // 取出连接队列 connQue_ 的第一个元素，并将其赋值给 conn。
-		connQue_.pop(); // 弹出连接队列 connQue_ 的第一个元素。
-		mysql_close(conn); // 关闭连接 conn。
+		mysql_close(connQue_.front().conn); // 关闭连接。
+		connQue_.pop_front();
+		totalConn_--;
 	}
 	mysql_library_end(); // 调用 mysql_library_end 函数，释放 MySQL 库的资源。
 }
 
+thread_local SqlConnPool::AffineSlot SqlConnPool::affine_;
+std::atomic<bool> SqlConnPool::alive_(false);
+
+// 线程退出时把独占的连接还给连接池；连接池已经析构时不再访问它，连接随进程退出释放
+SqlConnPool::AffineSlot::~AffineSlot() {
+	if(conn && alive_.load()) {
+		SqlConnPool* pool = SqlConnPool::Instance();
+		pool->affineConn_--;
+		pool->FreeConn(conn);
+		conn = nullptr;
+	}
+}
+
+// 开启/关闭线程独占模式，在工作线程开始处理请求之前调用
+void SqlConnPool::SetThreadAffine(int maxThreads) {
+	assert(maxThreads >= 0);
+	maxAffine_ = maxThreads;
+}
+
+MYSQL* SqlConnPool::GetAffineConn() {
+	AffineSlot& slot = affine_;
+	if(slot.inUse) {
+		return nullptr; // 嵌套获取，本线程的连接正在使用
+	}
+	if(!slot.conn) {
+		// 第一次使用：在名额以内从共享池取走一条连接，之后归本线程所有
+		if(affineConn_.fetch_add(1) >= maxAffine_) {
+			affineConn_--;
+			return nullptr;
+		}
+		slot.conn = GetConn(DEFAULT_ACQUIRE_MS);
+		if(!slot.conn) {
+			affineConn_--;
+			return nullptr;
+		}
+	}
+	else if(SteadyClock::now() - slot.lastUsed > std::chrono::milliseconds(pingIntervalMs_)
+			&& mysql_ping(slot.conn) != 0) {
+		// 维护线程看不到独占连接，由所属线程在使用前检查并重连
+		LOG_WARN("MySql affine connection lost, reconnecting");
+		mysql_close(slot.conn);
+		slot.conn = Connect_();
+		if(!slot.conn) {
+			affineConn_--;
+			lock_guard<mutex> locker(mtx_);
+			totalConn_--;
+			cond_.notify_one();
+			return nullptr;
+		}
+	}
+	slot.inUse = true;
+	return slot.conn;
+}
+
+void SqlConnPool::ReleaseAffineConn() {
+	affine_.inUse = false;
+	affine_.lastUsed = SteadyClock::now();
+}
+
 // 获取当前空闲连接的数量
 int SqlConnPool::GetFreeConnCount() {
 	lock_guard<mutex> locker(mtx_); // 创建一个 lock_guard 对象 locker，用于在作用域结束时自动释放互斥锁 mtx_。
 	return connQue_.size(); // 返回连接队列 connQue_ 的大小，即当前空闲连接的数量。
-}
\ No newline at end of file
+}
+
+// 获取当前已建立的连接数量（空闲 + 借出）
+int SqlConnPool::GetTotalConnCount() {
+	lock_guard<mutex> locker(mtx_);
+	return totalConn_;
+}
@@ -3,10 +3,14 @@
 
 #include <mysql/mysql.h>
 #include <string>
-#include <queue>
+#include <deque>
+#include <algorithm>
+#include <vector>
 #include <mutex>
-#include <semaphore.h>
+#include <condition_variable>
+#include <chrono>
 #include <thread>
+#include <atomic>
 #include "../log/log.h"
 
 // SqlConnPool 类是一个用于管理 MySQL 数据库连接池的单例类。它提供了一些方法来初始化连接池、获取和释放连接，以及关闭连接池。
@@ -26,27 +30,77 @@ private:
 
 	提供一个静态方法 Instance()，用于返回类的唯一实例。
 	该方法内部通常会检查实例是否已经创建，如果没有创建则创建一个新的实例，并返回该实例。*/
-	SqlConnPool() = default;				// 私有构造函数，确保只能通过 Instance() 方法获取实例。这是为了实现单例模式
-	~SqlConnPool() { ClosePool(); } // 析构函数，在对象销毁时关闭连接池
+	SqlConnPool() { alive_ = true; }				// 私有构造函数，确保只能通过 Instance() 方法获取实例。这是为了实现单例模式
+	~SqlConnPool() { ClosePool(); alive_ = false; } // 析构函数，在对象销毁时关闭连接池
 
-	int MAX_CONN_; // 最大连接数
+	typedef std::chrono::steady_clock SteadyClock;
 
-	std::queue<MYSQL *> connQue_; // 连接队列，存储可用的 MySQL 连接
-	std::mutex mtx_;							// 互斥锁，用于保护连接队列的访问
-	// sem_t 是 POSIX 信号量的类型，用于在多线程编程中实现线程同步。信号量是一个计数器，用于控制对共享资源的访问。
-	sem_t semId_; // 信号量，用于管理连接池中的可用连接数
+	// 空闲连接及其最近一次归还的时间，用于空闲收缩和健康检查
+	struct IdleConn
+	{
+		MYSQL *conn;
+		SteadyClock::time_point lastUsed;
+	};
+
+	/*线程独占连接：开启后每个工作线程第一次访问数据库时从池中取走一条连接，
+	保存在 thread_local 中，之后该线程的数据库访问不再经过互斥锁和条件变量。
+	线程退出时析构函数把连接还给连接池。*/
+	struct AffineSlot
+	{
+		MYSQL *conn = nullptr;
+		bool inUse = false;					// 同一线程内嵌套获取时，第二次走共享池
+		SteadyClock::time_point lastUsed;
+		~AffineSlot();
+	};
+	static thread_local AffineSlot affine_;
+	// 单例是否还存在：进程退出时单例析构之后才退出的线程，不能再把独占连接还给它
+	static std::atomic<bool> alive_;
+
+	MYSQL *Connect_();	// 按保存的配置建立一条新连接，失败返回 nullptr
+	void MaintainLoop_(); // 后台维护线程：定期 mysql_ping 空闲连接、收缩长时间空闲的连接
+
+	int MIN_CONN_ = 0;		  // 最小连接数，启动时并行建立，收缩不会低于该值
+	int MAX_CONN_ = 0;		  // 最大连接数，高负载时按需增长到该值
+	int totalConn_ = 0;	  // 当前已建立的连接数（空闲 + 借出）
+	int idleTimeoutMs_ = 0;  // 超过 MIN_CONN_ 的连接空闲多久后被关闭
+	int pingIntervalMs_ = 0; // 空闲连接健康检查的间隔
+	bool isClosed_ = true;	  // 连接池是否已关闭
+
+	std::atomic<int> maxAffine_{0};	 // 最多允许多少个线程独占连接，0 表示关闭该模式
+	std::atomic<int> affineConn_{0}; // 当前被线程独占的连接数
+
+	std::string host_, user_, pwd_, dbName_; // 连接配置，扩容和重连时使用
+	uint16_t port_ = 0;
+
+	std::deque<IdleConn> connQue_;			// 空闲连接，队尾是最近归还的（热连接），队头最先被收缩
+	std::mutex mtx_;						// 互斥锁，保护连接队列和计数
+	std::condition_variable cond_;			// 有连接归还或可以扩容时唤醒等待者
+	std::condition_variable maintainCond_; // 用于唤醒/停止维护线程
+	std::thread maintainThread_;			// 维护线程
 
 public:
+	static const int DEFAULT_ACQUIRE_MS = 500; // 获取连接的默认等待时间（毫秒）
+
 	static SqlConnPool *Instance(); // 获取单例实例的方法
 
-	MYSQL *GetConn();						// 获取一个可用的 MySQL 连接
+	// 获取一个可用的 MySQL 连接：没有空闲连接时在 MAX_CONN_ 以内扩容，否则最多阻塞 timeoutMs 毫秒，超时返回 nullptr
+	MYSQL *GetConn(int timeoutMs = DEFAULT_ACQUIRE_MS);
 	void FreeConn(MYSQL *conn); // 释放一个 MySQL 连接，将其归还到连接池
-	int GetFreeConnCount();			// 获取当前空闲连接的数量
+	int GetFreeConnCount();		// 获取当前空闲连接的数量
+	int GetTotalConnCount();	// 获取当前已建立的连接数量
 
+	// 线程独占模式：最多 maxThreads 个线程各自持有一条连接，其余请求仍走共享池（0 关闭）
+	void SetThreadAffine(int maxThreads);
+	bool IsThreadAffine() const { return maxAffine_.load(std::memory_order_relaxed) > 0; }
+	MYSQL *GetAffineConn();	 // 获取本线程独占的连接，没有可用的独占连接时返回 nullptr
+	void ReleaseAffineConn(); // 本线程用完独占连接，只清除标记，不归还连接池
+
+	// 初始化连接池：并行建立 connSize 条连接；maxConnSize 为 0 时不扩容
 	void Init(const char *host, uint16_t port,
-						const char *user, const char *pwd,
-						const char *dbName, int connSize); // 初始化连接池
-	void ClosePool();														 // 关闭连接池，释放所有连接
+			  const char *user, const char *pwd,
+			  const char *dbName, int connSize,
+			  int maxConnSize = 0, int idleTimeoutMs = 60000, int pingIntervalMs = 30000);
+	void ClosePool(); // 关闭连接池，释放所有连接
 };
 
 /*资源在对象构造初始化 资源在对象析构时释放
@@ -55,23 +109,39 @@ RAII 是一种常见的 C++ 编程惯用法，通过在对象的生命周期内
 class SqlConnRAII
 {
 private:
-	MYSQL *sql_;						// 用于存储从连接池获取的 MySQL 连接
+	MYSQL *sql_;			// 用于存储从连接池获取的 MySQL 连接
 	SqlConnPool *connpool_; // 指向一个连接池对象。
+	bool isAffine_;			// 是否为本线程独占的连接
 public:
-	SqlConnRAII(MYSQL **sql, SqlConnPool *connpool)
+	// timeoutMs 为获取连接的最长等待时间，超时后 *sql 为 nullptr，调用方需要检查
+	// allowAffine 为 false 时总是从共享池获取（用于偶尔访问数据库的后台线程）
+	SqlConnRAII(MYSQL **sql, SqlConnPool *connpool, int timeoutMs = SqlConnPool::DEFAULT_ACQUIRE_MS,
+				bool allowAffine = true)
 	{
-		assert(connpool_);
-		// 从连接池中获取一个 MySQL 连接，并将其赋值给 sql 和 sql_
-		*sql = connpool_->GetConn();
-		sql_ = *sql;
+		assert(connpool);
 		connpool_ = connpool;
+		isAffine_ = false;
+		// 线程独占模式下优先使用本线程的连接，拿不到时再从共享池获取
+		if (allowAffine && connpool_->IsThreadAffine() && (*sql = connpool_->GetAffineConn()))
+		{
+			isAffine_ = true;
+		}
+		else
+		{
+			*sql = connpool_->GetConn(timeoutMs);
+		}
+		sql_ = *sql;
 	}
 
 	/*在对象销毁时调用。如果 sql_ 非空，析构函数会将 MySQL 连接归还给连接池。
 	这确保了在 SqlConnRAII 对象的生命周期结束时，MySQL 连接能够被正确释放，避免资源泄漏。*/
 	~SqlConnRAII()
 	{
-		if (sql_)
+		if (isAffine_)
+		{
+			connpool_->ReleaseAffineConn();
+		}
+		else if (sql_)
 		{
 			connpool_->FreeConn(sql_);
 		}
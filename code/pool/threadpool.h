@@ -6,6 +6,8 @@
 #include <condition_variable>
 #include <functional>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <assert.h>
 
 class ThreadPool
@@ -37,8 +39,11 @@ public:
 						1.不能出现在赋值操作符的左侧。
 						2.不能取地址。
 						3.通常是字面值、临时对象、表达式的结果等。*/
-						auto task = std::move(pool_->tasks.front()); // 左值变右值，资产转移
+						auto task = std::move(pool_->tasks.front().fn); // 左值变右值，资产转移
+						auto enqueued = pool_->tasks.front().enqueued;
 						pool_->tasks.pop();
+						pool_->depth.store(pool_->tasks.size(), std::memory_order_relaxed);
+						pool_->UpdateSojourn(enqueued);
 						locker.unlock();  // 因为已经把任务取出来了，所以可以提前解锁了
 						task();
 						locker.lock(); // 马上又要取任务了，上锁
@@ -69,12 +74,43 @@ public:
 		std::unique_lock<std::mutex> locker(pool_->mtx_);
 		/*使用 std::forward 将任务完美转发到任务队列中。
 		emplace 方法会在队列中直接构造任务对象，避免不必要的拷贝。*/
-		pool_->tasks.emplace(std::forward<T>(task));
+		pool_->tasks.push({std::function<void()>(std::forward<T>(task)), Clock::now()});
+		pool_->depth.store(pool_->tasks.size(), std::memory_order_relaxed);
 		pool_->cond_.notify_one();  // 通知一个等待的线程有新任务到来
 	}
 
+	/*准入控制参数。
+	maxQueue：任务队列长度上限，0 表示不限制；
+	targetMs / intervalMs：CoDel 的目标排队时延和观察窗口，任务在队列中的等待时间
+	持续 intervalMs 都超过 targetMs 时认为已过载，直到某个任务的等待时间回到 targetMs 以下或队列排空。*/
+	void SetAdmission(size_t maxQueue, int targetMs = 5, int intervalMs = 100) {
+		std::unique_lock<std::mutex> locker(pool_->mtx_);
+		pool_->maxQueue.store(maxQueue, std::memory_order_relaxed);
+		pool_->target = std::chrono::milliseconds(targetMs);
+		pool_->interval = std::chrono::milliseconds(intervalMs);
+	}
+
+	// 是否还能接收新任务（不加锁，供反应堆线程在投递前快速判断）
+	bool Admit() const {
+		size_t maxQueue = pool_->maxQueue.load(std::memory_order_relaxed);
+		if(maxQueue > 0 && pool_->depth.load(std::memory_order_relaxed) >= maxQueue) {
+			return false;
+		}
+		return !pool_->overloaded.load(std::memory_order_relaxed);
+	}
+
+	size_t QueueSize() const { return pool_->depth.load(std::memory_order_relaxed); } // 当前排队的任务数
+	bool Overloaded() const { return pool_->overloaded.load(std::memory_order_relaxed); } // CoDel 是否判定过载
+
 
 private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Task {
+		std::function<void()> fn;
+		Clock::time_point enqueued; // 入队时间，用于计算排队时延
+	};
+
 	// 用一个结构体封装起来，方便调用
 	struct Pool {
 		std::mutex mtx_;  // 互斥锁,保护任务队列
@@ -83,7 +119,27 @@ private:
 		/*存储待执行的任务。
 		任务类型为 std::function<void()>，表示不接受参数且没有返回值的函数。
 		可以存储任意可调用对象，如函数指针、lambda 表达式、绑定表达式等。*/
-		std::queue<std::function<void()>> tasks; // 任务队列，函数类型为void()的队列
+		std::queue<Task> tasks; // 任务队列，函数类型为void()的队列
+
+		std::atomic<size_t> depth{0}; // 队列长度，供不加锁读取
+		std::atomic<bool> overloaded{false}; // CoDel 判定的过载状态
+		std::atomic<size_t> maxQueue{0};
+		Clock::duration target = std::chrono::milliseconds(5);
+		Clock::duration interval = std::chrono::milliseconds(100);
+		Clock::time_point firstAbove{}; // 排队时延第一次超过 target 后的 interval 截止时间，持锁访问
+
+		// 取出任务时调用（持锁）：按 CoDel 的方式根据排队时延更新过载状态
+		void UpdateSojourn(Clock::time_point enqueued) {
+			Clock::time_point now = Clock::now();
+			if(now - enqueued < target || tasks.empty()) {
+				firstAbove = Clock::time_point();
+				overloaded.store(false, std::memory_order_relaxed);
+			} else if(firstAbove == Clock::time_point()) {
+				firstAbove = now + interval;
+			} else if(now >= firstAbove) {
+				overloaded.store(true, std::memory_order_relaxed);
+			}
+		}
 	};
 	std::shared_ptr<Pool> pool_; // shared_ptr是一个智能指针，可以自动释放内存
 };
@@ -0,0 +1,210 @@
+#include "userfilter.h"
+
+#include <cmath>
+#include <functional>
+
+UserFilter* UserFilter::Instance() {
+	static UserFilter filter;
+	return &filter;
+}
+
+// 按预计元素数和误判率计算位数 m = -n*ln(p)/(ln2)^2 与哈希个数 k = m/n*ln2
+UserFilter::Bloom::Bloom(size_t expected, double fpRate) {
+	double n = expected > 0 ? expected : 1;
+	double m = -n * std::log(fpRate) / (std::log(2.0) * std::log(2.0));
+	nbits = (static_cast<size_t>(m) + 63) / 64 * 64;
+	k = std::max(1, static_cast<int>(std::round(m / n * std::log(2.0))));
+	words.reset(new std::atomic<uint64_t>[nbits / 64]);
+	for(size_t i = 0; i < nbits / 64; i++) {
+		words[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+// 双重哈希：第 i 个位置为 h1 + i*h2
+void UserFilter::Bloom::Add(size_t hash) {
+	size_t h2 = (hash >> 33) | 1;
+	for(int i = 0; i < k; i++) {
+		size_t bit = (hash + i * h2) % nbits;
+		words[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_relaxed);
+	}
+}
+
+bool UserFilter::Bloom::MayContain(size_t hash) const {
+	size_t h2 = (hash >> 33) | 1;
+	for(int i = 0; i < k; i++) {
+		size_t bit = (hash + i * h2) % nbits;
+		if(!(words[bit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (bit % 64)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t UserFilter::Hash_(const std::string& key) {
+	return std::hash<std::string>()(key);
+}
+
+bool UserFilter::Key_(const std::string& name, bool fold, std::string* key) {
+	if(!fold) {
+		*key = name;
+		return true;
+	}
+	size_t len = name.find_last_not_of(' ') + 1; // 全是空格时 npos + 1 为 0
+	key->resize(len);
+	for(size_t i = 0; i < len; i++) {
+		unsigned char c = name[i];
+		if(c < 0x20 || c >= 0x7f) {
+			return false; // 控制字符可能被忽略，非 ASCII 字符可能不区分重音
+		}
+		(*key)[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+	}
+	return true;
+}
+
+void UserFilter::Add_(Bloom& bloom, const std::string& name) {
+	std::string key;
+	if(Key_(name, bloom.fold, &key)) {
+		bloom.Add(Hash_(key));
+	} else {
+		bloom.complete.store(false);
+	}
+}
+
+// 没有查到或者查询失败时按不区分大小写处理，只会多查询几次数据库
+bool UserFilter::FoldCase_(MYSQL* sql) {
+	if(mysql_query(sql, "SELECT COLLATION_NAME FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE() "
+						"AND TABLE_NAME = 'user' AND COLUMN_NAME = 'username'")) {
+		return true;
+	}
+	MYSQL_RES* res = mysql_store_result(sql);
+	if(!res) {
+		return true;
+	}
+	bool fold = true;
+	if(MYSQL_ROW row = mysql_fetch_row(res)) {
+		std::string collation = row[0] ? row[0] : "binary"; // 二进制类型的列没有排序规则
+		fold = !(collation == "binary" || (collation.size() > 4 && collation.compare(collation.size() - 4, 4, "_bin") == 0));
+	}
+	mysql_free_result(res);
+	return fold;
+}
+
+bool UserFilter::Init(size_t expectedUsers, double fpRate, int rebuildSec) {
+	assert(fpRate > 0 && fpRate < 1);
+	expected_ = expectedUsers;
+	fpRate_ = fpRate;
+	rebuildSec_ = rebuildSec;
+	isClosed_ = false;
+	bool ok = Rebuild_();
+	if(rebuildSec_ > 0) {
+		rebuildThread_ = std::thread(&UserFilter::RebuildLoop_, this);
+	}
+	return ok;
+}
+
+void UserFilter::Close() {
+	{
+		lock_guard<mutex> locker(mtx_);
+		isClosed_ = true;
+	}
+	cond_.notify_all();
+	if(rebuildThread_.joinable()) {
+		rebuildThread_.join();
+	}
+}
+
+void UserFilter::Add(const std::string& name) {
+	lock_guard<mutex> locker(mtx_); // 只在注册成功时调用，和重建互斥
+	std::shared_ptr<Bloom> cur = std::atomic_load(&cur_);
+	if(cur) {
+		Add_(*cur, name);
+	}
+	if(building_) {
+		Add_(*building_, name);
+	}
+}
+
+bool UserFilter::MayContain(const std::string& name) const {
+	std::shared_ptr<Bloom> cur = std::atomic_load(&cur_);
+	if(!cur || !cur->complete.load()) {
+		return true; // 还没有加载成功，或者表中有无法归一化的用户名，不能下结论
+	}
+	std::string key;
+	if(!Key_(name, cur->fold, &key)) {
+		return true;
+	}
+	return cur->MayContain(Hash_(key));
+}
+
+std::string UserFilter::Key(const std::string& name) const {
+	std::shared_ptr<Bloom> cur = std::atomic_load(&cur_);
+	std::string key;
+	if(!Key_(name, cur ? cur->fold : true, &key)) {
+		return name;
+	}
+	return key;
+}
+
+bool UserFilter::Rebuild_() {
+	MYSQL* sql;
+	// 重建很少发生，不占用线程独占连接的名额
+	SqlConnRAII sqlConn(&sql, SqlConnPool::Instance(), SqlConnPool::DEFAULT_ACQUIRE_MS, false);
+	if(!sql) {
+		LOG_WARN("UserFilter: no sql connection, keep the old filter");
+		return false;
+	}
+	// 先开始记录新增用户，再执行查询，保证查询之后提交的注册不会漏掉
+	bool fold = FoldCase_(sql);
+	std::shared_ptr<Bloom> bloom;
+	{
+		lock_guard<mutex> locker(mtx_);
+		bloom = std::make_shared<Bloom>(expected_, fpRate_);
+		bloom->fold = fold;
+		building_ = bloom;
+	}
+	bool ok = mysql_query(sql, "SELECT username FROM user") == 0;
+	MYSQL_RES* res = ok ? mysql_use_result(sql) : nullptr;
+	size_t rows = 0;
+	if(res) {
+		// 逐行读取，不把整张表缓存在客户端
+		while(MYSQL_ROW row = mysql_fetch_row(res)) {
+			if(!row[0]) {
+				continue; // username 为 NULL 的行不可能被登录或注册匹配
+			}
+			unsigned long* lengths = mysql_fetch_lengths(res);
+			Add_(*bloom, std::string(row[0], lengths[0]));
+			rows++;
+		}
+		mysql_free_result(res);
+	}
+	lock_guard<mutex> locker(mtx_);
+	building_.reset();
+	if(!res) {
+		LOG_WARN("UserFilter: load users error: %s", mysql_error(sql));
+		return false;
+	}
+	if(rows * 2 > expected_) {
+		expected_ = rows * 2; // 预留增长空间，下次重建按新容量分配
+	}
+	std::atomic_store(&cur_, bloom);
+	LOG_INFO("UserFilter: loaded %d users, %d bits, k=%d, fold case %d", (int)rows, (int)bloom->nbits, bloom->k, (int)fold);
+	if(!bloom->complete.load()) {
+		LOG_WARN("UserFilter: non-ASCII usernames under a case-insensitive collation, filter disabled");
+	}
+	return true;
+}
+
+void UserFilter::RebuildLoop_() {
+	unique_lock<mutex> locker(mtx_);
+	while(!isClosed_) {
+		cond_.wait_for(locker, std::chrono::seconds(rebuildSec_));
+		if(isClosed_) {
+			break;
+		}
+		locker.unlock();
+		Rebuild_();
+		locker.lock();
+	}
+	locker.unlock();
+	mysql_thread_end();
+}
@@ -0,0 +1,72 @@
+#ifndef USERFILTER_H
+#define USERFILTER_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "sqlconnpool.h"
+#include "../log/log.h"
+
+/*用户名存在性索引（布隆过滤器）。
+启动时通过 SqlConnPool 从 user 表加载所有用户名，注册成功后增量加入，并按固定周期重建（调整容量、清除已删除的用户）。
+MayContain 返回 false 表示用户名一定不存在：登录可以直接拒绝，注册可以跳过 SELECT。
+返回 true 时仍需要查询数据库确认。未加载成功时总是返回 true，不影响正确性。
+用户名按 username 列的排序规则比较：二进制排序规则按原样；其他排序规则（默认的 *_ci）不区分大小写、
+忽略末尾的空格，键先转成小写、去掉末尾空格。含有非 ASCII 字符的名字在这些排序规则下还可能
+不区分重音，无法可靠地归一化：查询时不经过过滤器，出现在表中时整个过滤器不再使用，直到下次重建。*/
+class UserFilter
+{
+private:
+	UserFilter() = default;
+	~UserFilter() { Close(); }
+
+	// 一个固定大小的布隆过滤器，位数组用原子操作更新，读写都不需要加锁
+	struct Bloom
+	{
+		Bloom(size_t expected, double fpRate);
+		void Add(size_t hash);
+		bool MayContain(size_t hash) const;
+
+		size_t nbits;
+		int k;											// 哈希函数个数
+		std::unique_ptr<std::atomic<uint64_t>[]> words; // 位数组
+		bool fold = true;								// 键是否按不区分大小写的排序规则归一化
+		std::atomic<bool> complete{true};				// false：有无法归一化的用户名，不能下结论
+	};
+
+	bool Rebuild_();		 // 从数据库重新加载，构建新的过滤器后原子替换
+	void RebuildLoop_();	 // 后台线程，周期性调用 Rebuild_
+	static bool FoldCase_(MYSQL *sql); // 查询 username 列的排序规则，不是二进制的返回 true
+	// 生成比较用的键，返回 false 表示无法归一化（fold 时含有非 ASCII 字符）
+	static bool Key_(const std::string &name, bool fold, std::string *key);
+	static size_t Hash_(const std::string &key);
+	static void Add_(Bloom &bloom, const std::string &name);
+
+	size_t expected_ = 0;	// 预计用户数，实际用户更多时按 2 倍扩容
+	double fpRate_ = 0.01;	// 目标误判率
+	int rebuildSec_ = 0;	// 重建周期（秒），0 表示只增量更新
+
+	std::shared_ptr<Bloom> cur_;	  // 当前使用的过滤器，通过 std::atomic_load/atomic_store 访问
+	std::shared_ptr<Bloom> building_; // 重建期间新增的用户同时写入这里
+	std::mutex mtx_;				  // 保护 building_ 和重建过程
+	std::condition_variable cond_;
+	std::thread rebuildThread_;
+	bool isClosed_ = true;
+
+public:
+	static UserFilter *Instance();
+
+	// 初始化并从数据库加载一次，返回是否加载成功
+	bool Init(size_t expectedUsers = 100000, double fpRate = 0.01, int rebuildSec = 600);
+	void Add(const std::string &name);				// 注册成功后加入
+	bool MayContain(const std::string &name) const; // false 表示用户名一定不存在
+	// 与 username 列排序规则一致的比较键（未加载时按不区分大小写处理），无法归一化时返回原名
+	std::string Key(const std::string &name) const;
+	void Close();
+};
+
+#endif // USERFILTER_H
@@ -1,14 +1,30 @@
 #include "epoller.h"
 
+#include <algorithm>
+
 // 构造函数，初始化 Epoller 对象
-Epoller::Epoller(int maxEvent)
-    // 初始化 epoll 文件描述符，创建一个 epoll 实例，参数 512 是提示内核需要的文件描述符数量
-    : epollFd_(epoll_create(512)),
+Epoller::Epoller(int maxEvent, int maxFd)
+    // 初始化 epoll 文件描述符；热升级 exec 新进程时自动关闭，不泄漏给它
+    : epollFd_(epoll_create1(EPOLL_CLOEXEC)),
       // 初始化事件数组，大小为 maxEvent
-      events_(maxEvent)
+      events_(maxEvent),
+      minEvents_(maxEvent),
+      maxEvents_(std::max(maxEvent, maxFd)), // 最多每个 fd 一个事件
+      fullWaits_(0),
+      sparseWaits_(0),
+      pendingResize_(-1),
+      // 每个 fd 的事件集合
+      maxFd_(maxFd),
+      armed_(new std::atomic<uint32_t>[maxFd]),
+      ctlCalls_(0),
+      ctlSkipped_(0)
 {
   // 断言检查，确保 epoll 文件描述符创建成功且事件数组大小大于 0
-  assert(epollFd_ >= 0 && events_.size() > 0);
+  assert(epollFd_ >= 0 && events_.size() > 0 && maxFd_ > 0);
+  for (int i = 0; i < maxFd_; i++)
+  {
+    armed_[i].store(0, std::memory_order_relaxed);
+  }
 }
 
 Epoller::~Epoller()
@@ -17,25 +33,50 @@ Epoller::~Epoller()
   close(epollFd_);
 }
 
-// 向 epoll 实例中添加一个文件描述符及其事件
-bool Epoller::AddFd(int fd, uint32_t events)
+// 调用 epoll_ctl 并记录 fd 当前生效的事件集合
+bool Epoller::Ctl_(int op, int fd, uint32_t events)
 {
-  // 如果文件描述符无效（小于 0），返回 false
-  if (fd < 0)
-    return false;
-
   // 初始化 epoll_event 结构体，清零所有成员
   epoll_event ev = {0};
 
+  // 设置 epoll_event 结构体中的文件描述符，Wait 返回后通过 GetEventFd 取出
+  ev.data.fd = fd;
+
   // 设置事件类型，例如 EPOLLIN, EPOLLOUT 等
   ev.events = events;
 
-  // 调用 epoll_ctl 函数将文件描述符添加到 epoll 实例中
+  ctlCalls_.fetch_add(1, std::memory_order_relaxed);
+
+  // 先记录再调用：EPOLLONESHOT 的事件可能在 epoll_ctl 返回之前就被 Wait 取出并清除记录，
+  // 之后再写入会留下“仍然生效”的错误记录，下一次相同的 ModFd 被跳过，连接不再有事件。
+  // 同一个连接的下一次 ModFd 发生在这次注册的事件被处理之后，不会与这里的写入交错
+  if (fd < maxFd_)
+  {
+    armed_[fd].store(op == EPOLL_CTL_DEL ? 0 : events, std::memory_order_release);
+  }
+
+  // 调用 epoll_ctl 函数
   // epollFd_ 是 epoll 实例的文件描述符
-  // EPOLL_CTL_ADD 表示添加操作
-  // fd 是要添加的文件描述符
-  // &ev 是指向 epoll_event 结构体的指针，包含事件类型
-  return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+  // op 是 EPOLL_CTL_ADD / EPOLL_CTL_MOD / EPOLL_CTL_DEL
+  // fd 是要操作的文件描述符
+  // &ev 是指向 epoll_event 结构体的指针，包含事件类型（删除时被忽略）
+  bool ok = 0 == epoll_ctl(epollFd_, op, fd, &ev);
+  if (!ok && fd < maxFd_)
+  {
+    armed_[fd].store(0, std::memory_order_release); // 不知道内核中的状态，下一次 ModFd 总是调用
+  }
+  return ok;
+}
+
+// 向 epoll 实例中添加一个文件描述符及其事件
+bool Epoller::AddFd(int fd, uint32_t events)
+{
+  // 如果文件描述符无效（小于 0），返回 false
+  if (fd < 0)
+    return false;
+
+  // 添加到 epoll 实例中
+  return Ctl_(EPOLL_CTL_ADD, fd, events);
 }
 
 // 修改 epoll 实例中已存在的文件描述符的事件
@@ -45,21 +86,23 @@ bool Epoller::ModFd(int fd, uint32_t events)
   if (fd < 0)
     return false;
 
-  // 初始化 epoll_event 结构体，清零所有成员
-  epoll_event ev = {0};
-
-  // 设置 epoll_event 结构体中的文件描述符
-  ev.data.fd = fd;
+  // 事件集合没有变化且仍然生效（非 EPOLLONESHOT，或者 EPOLLONESHOT 还没有触发）时不需要系统调用
+  if (fd < maxFd_ && armed_[fd].load(std::memory_order_acquire) == events)
+  {
+    ctlSkipped_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
 
-  // 设置事件类型，例如 EPOLLIN, EPOLLOUT 等
-  ev.events = events;
+  // 修改 epoll 实例中已存在的文件描述符的事件
+  return Ctl_(EPOLL_CTL_MOD, fd, events);
+}
 
-  // 调用 epoll_ctl 函数修改 epoll 实例中已存在的文件描述符的事件
-  // epollFd_ 是 epoll 实例的文件描述符
-  // EPOLL_CTL_MOD 表示修改操作
-  // fd 是要修改的文件描述符
-  // &ev 是指向 epoll_event 结构体的指针，包含新的事件类型
-  return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+// 强制执行 EPOLL_CTL_MOD：即使事件集合没有变化，内核也会重新检查 fd 是否就绪，就绪时再报告一次
+bool Epoller::RearmFd(int fd, uint32_t events)
+{
+  if (fd < 0)
+    return false;
+  return Ctl_(EPOLL_CTL_MOD, fd, events);
 }
 
 // 从 epoll 实例中删除一个文件描述符
@@ -69,23 +112,73 @@ bool Epoller::DelFd(int fd)
   if (fd < 0)
     return false;
 
-  // 调用 epoll_ctl 函数从 epoll 实例中删除文件描述符
-  // epollFd_ 是 epoll 实例的文件描述符
-  // EPOLL_CTL_DEL 表示删除操作
-  // fd 是要删除的文件描述符
-  // 最后一个参数为 0，因为删除操作不需要 epoll_event 结构体
-  return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, 0);
+  // 从 epoll 实例中删除文件描述符
+  return Ctl_(EPOLL_CTL_DEL, fd, 0);
 }
 
 // 等待事件
 int Epoller::Wait(int timeoutMs)
 {
+  // 按上一次返回的事件数调整容量（上一次的事件此时已经处理完）
+  if (pendingResize_ >= 0)
+  {
+    Resize_(pendingResize_);
+    pendingResize_ = -1;
+  }
+
   // 调用 epoll_wait 函数等待事件
   // epollFd_ 是 epoll 实例的文件描述符
   // &events_[0] 是指向 epoll_event 结构体数组的指针
   // events_.size() 是 epoll_event 结构体数组的大小
   // timeoutMs 是超时时间，单位是毫秒
-  return epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
+  int n = epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
+  if (n < 0)
+  {
+    return n;
+  }
+
+  // EPOLLONESHOT 的 fd 报告事件后在内核中已失效，之后的 ModFd 即使事件集合相同也必须重新注册
+  for (int i = 0; i < n; i++)
+  {
+    int fd = events_[i].data.fd;
+    if (fd >= 0 && fd < maxFd_ && (armed_[fd].load(std::memory_order_relaxed) & EPOLLONESHOT))
+    {
+      armed_[fd].store(0, std::memory_order_release);
+    }
+  }
+  // 本次的事件已经在数组里，先不能改变容量；放到下一次 Wait 开始前调整
+  pendingResize_ = n;
+  return n;
+}
+
+// 调整事件数组容量。数组填满说明还有就绪的 fd 没有取出，要多一次 epoll_wait 才能处理到
+void Epoller::Resize_(int n)
+{
+  size_t cap = events_.size();
+  if (static_cast<size_t>(n) == cap)
+  {
+    sparseWaits_ = 0;
+    if (++fullWaits_ >= GROW_AFTER && cap < maxEvents_)
+    {
+      events_.resize(std::min(cap * 2, maxEvents_));
+      fullWaits_ = 0;
+    }
+  }
+  else if (static_cast<size_t>(n) < cap / 4)
+  {
+    fullWaits_ = 0;
+    if (++sparseWaits_ >= SHRINK_AFTER && cap > minEvents_)
+    {
+      events_.resize(std::max(cap / 2, minEvents_));
+      events_.shrink_to_fit();
+      sparseWaits_ = 0;
+    }
+  }
+  else
+  {
+    fullWaits_ = 0;
+    sparseWaits_ = 0;
+  }
 }
 
 // 获取事件的fd
@@ -106,4 +199,4 @@ uint32_t Epoller::GetEvents(size_t i) const
 
   // 返回第 i 个事件的属性
   return events_[i].events;
-}
\ No newline at end of file
+}
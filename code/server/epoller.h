@@ -5,23 +5,49 @@
 #include <unistd.h>    // close()
 #include <assert.h>    // close()
 #include <vector>
+#include <memory>
+#include <atomic>
 #include <errno.h>
 
 class Epoller
 {
 private:
   int epollFd_;                            // epoll句柄
-  std::vector<struct epoll_event> events_; // 事件数组
+  std::vector<struct epoll_event> events_; // 事件数组，大小随负载自适应调整
+
+  // 事件数组的自适应：连续 GROW_AFTER 次填满时翻倍，连续 SHRINK_AFTER 次用不到 1/4 时减半
+  static const int GROW_AFTER = 2;
+  static const int SHRINK_AFTER = 64;
+  size_t minEvents_;  // 事件数组的最小容量（构造时的 maxEvent）
+  size_t maxEvents_;  // 事件数组的最大容量
+  int fullWaits_;     // 连续填满的次数
+  int sparseWaits_;   // 连续用不到 1/4 的次数
+  int pendingResize_; // 上一次 Wait 返回的事件数，-1 表示没有
+  void Resize_(int n); // 根据本次 Wait 返回的事件数调整容量
+
+  // 每个 fd 当前在内核中生效的事件集合，0 表示未注册或 EPOLLONESHOT 已触发（已失效）。
+  // ModFd 由工作线程调用、Wait 由反应堆线程调用，所以用原子变量
+  int maxFd_;
+  std::unique_ptr<std::atomic<uint32_t>[]> armed_;
+  std::atomic<uint64_t> ctlCalls_;   // 实际执行的 epoll_ctl 次数
+  std::atomic<uint64_t> ctlSkipped_; // 事件集合没有变化而省掉的次数
+
+  bool Ctl_(int op, int fd, uint32_t events); // 调用 epoll_ctl 并记录事件集合
 public:
-  explicit Epoller(int maxEvent = 1024); // 构造函数 maxEvent默认为1024
+  explicit Epoller(int maxEvent = 1024, int maxFd = 65536); // 构造函数 maxEvent默认为1024，是事件数组的初始（也是最小）容量
   ~Epoller();                            // 析构函数
 
   bool AddFd(int fd, uint32_t events); // 添加事件
-  bool ModFd(int fd, uint32_t events); // 修改事件
+  bool ModFd(int fd, uint32_t events); // 修改事件，与当前生效的事件集合相同时不调用 epoll_ctl
   bool DelFd(int fd);                  // 删除事件
+  bool RearmFd(int fd, uint32_t events); // 强制重新注册：ET 模式下让内核重新检查就绪状态
   int Wait(int timeoutMs = -1);        // 等待事件
   int GetEventFd(size_t i) const;      // 获取事件的fd
   uint32_t GetEvents(size_t i) const;  // 获取事件属性
+
+  size_t GetEventCapacity() const { return events_.size(); } // 当前事件数组容量
+  uint64_t GetCtlCount() const { return ctlCalls_.load(std::memory_order_relaxed); }     // epoll_ctl 调用次数
+  uint64_t GetCtlSkipped() const { return ctlSkipped_.load(std::memory_order_relaxed); } // 省掉的 epoll_ctl 次数
 };
 
 #endif // EPOLLER_H
\ No newline at end of file
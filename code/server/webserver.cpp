@@ -2,15 +2,42 @@
 
 using namespace std;
 
+// 热升级时新进程从这个环境变量得到与旧进程通信的套接字
+static const char HANDOFF_ENV[] = "WEBSERVER_HANDOFF_FD";
+
+const char WebServer::UPLOAD_DIR[] = "upload/";
+
+const char WebServer::SERVICE_UNAVAILABLE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+
 // WebServer 构造函数，初始化 WebServer 对象
 WebServer::WebServer(
     int port, int trigMode, int timeoutMS,
     int sqlPort, const char *sqlUser, const char *sqlPwd,
     const char *dbName, int connPoolNum, int threadNum,
-    bool openLog, int logLevel, int logQueSize)
+    bool openLog, int logLevel, int logQueSize,
+    int connPoolMax, bool sqlThreadAffine,
+    const char *userDb, bool inlineFastPath,
+    int listenBacklog, int fastOpenQueue,
+    int headerTimeoutMS, int bodyTimeoutMS)
     : port_(port),                            // 初始化服务器端口号
       timeoutMS_(timeoutMS),                  // 初始化超时时间（毫秒）
+      headerTimeoutMS_(headerTimeoutMS > 0 ? headerTimeoutMS : timeoutMS), // 请求头超时，未设置时与空闲超时相同
+      bodyTimeoutMS_(bodyTimeoutMS > 0 ? bodyTimeoutMS : timeoutMS),       // 请求体超时
       isClose_(false),                        // 初始化服务器关闭标志为 false
+      inlineFastPath_(inlineFastPath),        // 是否启用反应堆线程快速路径
+      listenFd_(-1),                          // 监听套接字在 InitSocket_ 中创建
+      listenBacklog_(listenBacklog),          // 全连接队列长度
+      fastOpenQueue_(fastOpenQueue),          // TCP Fast Open 队列长度
+      signalFd_(CreateSignalFd_()),           // 先屏蔽信号，之后创建的线程都会继承
+      wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), // 流式连接的发送队列有数据时由写入方唤醒
+      handoffFd_(-1),                         // 没有进行中的热升级
+      childPid_(-1),                          // 没有新进程
+      exePath_(ExePath_()),                   // 在部署替换文件之前记下路径
+      draining_(false),                       // 没有在排空
       timer_(new HeapTimer()),                // 初始化定时器
       threadpool_(new ThreadPool(threadNum)), // 初始化线程池，指定线程数量
       epoller_(new Epoller())                 // 初始化 epoll 实例
@@ -43,7 +70,10 @@ WebServer::WebServer(
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
 
             // 记录 SQL 连接池数量和线程池数量
-            LOG_INFO("sqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("sqlConnPool num: %d(max %d), ThreadPool num: %d", connPoolNum, connPoolMax, threadNum);
+
+            // 记录请求分发模式
+            LOG_INFO("Dispatch Mode: %s", inlineFastPath_ ? "inline fast path" : "thread pool");
         }
     }
 
@@ -52,23 +82,116 @@ WebServer::WebServer(
     strcat(srcDir_, "/resources/"); // 拼接资源目录
     HttpConn::userCount = 0;        // 初始化用户数量为 0
     HttpConn::srcDir = srcDir_;     // 设置资源目录
+    // 准入控制：队列过长或排队时延持续超过目标值时，新请求直接回复 503
+    threadpool_->SetAdmission(threadNum * MAX_QUEUE_PER_THREAD, QUEUE_TARGET_MS, QUEUE_INTERVAL_MS);
+    // 小文件缓存：64KB 以下的文件缓存在内存中，总共最多 64MB，每秒最多检查一次文件是否修改
+    FileCache::Instance()->Init(64 * 1024, 64 * 1024 * 1024, 1000);
+    // 错误页面在启动时读入并生成完整的响应，之后回复 4xx/5xx 不再访问文件
+    HttpResponse::LoadErrorPages(srcDir_);
+    // 按 IP 限流：登录/注册访问数据库，限制每个 IP 的速率；静态资源不限
+    RateLimiter::Instance()->Init(MAX_FD);
+    RateLimiter::Instance()->SetRate(RateLimiter::ROUTE_AUTH, AUTH_RATE_PER_SEC, AUTH_BURST);
+    RateLimiter::Instance()->SetRate(RateLimiter::ROUTE_UPLOAD, UPLOAD_RATE_PER_SEC, UPLOAD_BURST);
+    // 上传的文件直接写入工作目录下的上传目录。不放在资源目录下：否则上传的 .html/.js 会按扩展名作为
+    // 同源的页面、脚本返回（存储型 XSS）
+    char *workDir = getcwd(nullptr, 0);
+    assert(workDir);
+    UploadSink::dir = std::string(workDir) + "/" + UPLOAD_DIR;
+    free(workDir);
+    UploadSink::maxBytes = UPLOAD_MAX_BYTES;
+    if (mkdir(UploadSink::dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("Upload dir %s error: %d, uploads disabled", UploadSink::dir.c_str(), errno);
+        UploadSink::dir.clear();
+    }
+    InitRoutes_();
 
-    // 初始化 SQL 连接池
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum); // 连接池单例的初始化
+    if (userDb)
+    {
+        // 嵌入式用户存储：用户保存在本地 mmap 文件中，不需要 MySQL
+        std::unique_ptr<MmapUserStore> store(new MmapUserStore());
+        if (!store->Open(userDb))
+        {
+            isClose_ = true;
+        }
+        UserStore::Install(std::move(store));
+    }
+    else
+    {
+        // 初始化 SQL 连接池：启动时并行建立 connPoolNum 条连接，负载高时扩容到 connPoolMax
+        SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum, connPoolMax); // 连接池单例的初始化
+        // 注册请求的组提交：最多 64 条合并为一个事务，第一条最多等待 2ms
+        RegisterBatcher::Instance()->Init(64, 2);
+        // 用户名布隆过滤器：启动时加载，之后每 10 分钟重建一次
+        UserFilter::Instance()->Init(100000, 0.01, 600);
+        if (sqlThreadAffine)
+        {
+            // 每个工作线程（以及组提交线程）独占一条连接，共享池只作为溢出
+            SqlConnPool::Instance()->SetThreadAffine(threadNum + 1);
+        }
+        UserStore::Install(std::unique_ptr<UserStore>(new MySqlUserStore()));
+    }
     // 初始化事件模式和初始化套接字（监听）
     InitEventMode_(trigMode); // 初始化事件模式
     if (!InitSocket_())
     {
         isClose_ = true;
     } // 初始化套接字
+
+    // 定时器由 timerfd 驱动，epoll_wait 不需要超时参数
+    if (timeoutMS_ > 0 && !epoller_->AddFd(timer_->GetFd(), EPOLLIN))
+    {
+        LOG_ERROR("Add timerfd error!");
+        isClose_ = true;
+    }
+
+    // 监听信号
+    if (signalFd_ < 0 || !epoller_->AddFd(signalFd_, EPOLLIN))
+    {
+        LOG_ERROR("Add signalfd error!");
+        isClose_ = true;
+    }
+
+    // 其他线程向流式连接追加数据后唤醒反应堆线程
+    if (wakeFd_ < 0 || !epoller_->AddFd(wakeFd_, EPOLLIN))
+    {
+        LOG_ERROR("Add wake eventfd error!");
+        isClose_ = true;
+    }
+    HttpConn::wakeFd = wakeFd_;
 }
 
 // WebServer 析构函数，销毁 WebServer 对象
 WebServer::~WebServer()
 {
-    close(listenFd_);                     // 关闭监听套接字
+    AcceptStats stats = GetAcceptStats();
+    LOG_INFO("accepted %llu in %llu wakeups, budget exhausted %llu, rejected %llu, listen overflows %llu drops %llu",
+             (unsigned long long)stats.accepted, (unsigned long long)stats.wakeups,
+             (unsigned long long)stats.budgetExhausted, (unsigned long long)stats.rejected,
+             (unsigned long long)stats.listenOverflows, (unsigned long long)stats.listenDrops);
+    LOG_INFO("shed %llu requests with 503", (unsigned long long)shedCount_);
+    if (listenFd_ >= 0)
+    {
+        close(listenFd_); // 关闭监听套接字（热升级后新进程仍持有它）
+    }
+    if (signalFd_ >= 0)
+    {
+        close(signalFd_);
+    }
+    HttpConn::wakeFd = -1;
+    if (wakeFd_ >= 0)
+    {
+        close(wakeFd_);
+    }
+    if (handoffFd_ >= 0)
+    {
+        close(handoffFd_);
+    }
     isClose_ = true;                      // 设置服务器关闭标志为 true
     free(srcDir_);                        // 释放资源目录
+    RegisterBatcher::Instance()->Close(); // 提交剩余的注册，要在连接池关闭之前
+    UserFilter::Instance()->Close();      // 停止重建线程
+    UserStore::Install(nullptr);          // 关闭用户存储（嵌入式后端在这里落盘）
     SqlConnPool::Instance()->ClosePool(); // 关闭 SQL 连接池
 }
 
@@ -77,6 +200,7 @@ void WebServer::InitEventMode_(int trigMode)
 {
     listenEvent_ = EPOLLRDHUP;              // 监听事件类型：检测 socket 关闭
     connEvent_ = EPOLLONESHOT | EPOLLRDHUP; // 连接事件类型：EPOLLONESHOT 由一个线程处理
+    persistentEvents_ = false;
 
     /*在代码中，|= 运算符用于将某些标志位添加到现有的事件标志中。例如：
     connEvent_ |= EPOLLET;
@@ -98,6 +222,12 @@ void WebServer::InitEventMode_(int trigMode)
         listenEvent_ |= EPOLLET; // 边缘触发模式
         connEvent_ |= EPOLLET;   // 边缘触发模式
         break;
+    case 4:
+        // 边缘触发，连接注册一次 EPOLLIN|EPOLLOUT 之后不再修改，每次读写都省掉一次 epoll_ctl
+        listenEvent_ |= EPOLLET;          // 边缘触发模式
+        connEvent_ = EPOLLET | EPOLLRDHUP; // 去掉 EPOLLONESHOT
+        persistentEvents_ = true;
+        break;
     default:
         // 如果 trigMode 不在上述范围内，默认将 listenEvent_ 和 connEvent_ 都设置为边缘触发模式（EPOLLET）。
         listenEvent_ |= EPOLLET; // 边缘触发模式
@@ -105,6 +235,7 @@ void WebServer::InitEventMode_(int trigMode)
         break;
     }
     HttpConn::isET = (connEvent_ & EPOLLET); // 设置连接事件类型
+    HttpConn::ioBudget = IO_BUDGET;          // 设置每次读写的字节配额
 }
 
 // 启动服务器
@@ -117,21 +248,43 @@ void WebServer::Start()
     if (!isClose_)
     {
         LOG_INFO("========== Server start ==========");
+
+        // 由旧进程热升级启动：初始化已完成，通知旧进程停止 accept 并排空
+        if (handoffFd_ >= 0)
+        {
+            if (send(handoffFd_, "R", 1, MSG_NOSIGNAL) != 1)
+            {
+                LOG_WARN("notify old process error!");
+            }
+            close(handoffFd_);
+            handoffFd_ = -1;
+        }
     }
 
     // 进入主循环，直到服务器关闭
     while (!isClose_)
     {
-        // 如果设置了超时时间
-        if (timeoutMS_ > 0)
+        // 排空中：所有连接都已关闭或到达截止时间就退出
+        if (draining_)
         {
-            // 获取下一次的超时等待时间
-            timeMS = timer_->GetNextTick();
+            auto now = LoopClock::Now();
+            if (HttpConn::userCount <= 0 || now >= drainDeadline_)
+            {
+                LOG_INFO("Drain finished, %d connections left", (int)HttpConn::userCount);
+                isClose_ = true;
+                break;
+            }
+            // 至少每 100ms 检查一次，排空完成后尽快退出
+            timeMS = (timeMS < 0 || timeMS > 100) ? 100 : timeMS;
         }
 
-        // 调用 epoll 等待事件，返回事件数量
+        // 调用 epoll 等待事件，返回事件数量；定时器到期时 timerfd 可读，不需要计算等待时间
         int eventCnt = epoller_->Wait(timeMS);
 
+        // 本轮事件处理使用同一个缓存的时间
+        LoopClock::Update();
+        TimeService::Update(); // Date 和日志时间戳，秒数变化时才重新格式化
+
         // 遍历所有事件
         for (int i = 0; i < eventCnt; i++)
         {
@@ -147,6 +300,34 @@ void WebServer::Start()
                 // 处理监听事件（如新连接）
                 DealListen_();
             }
+            // 定时器到期
+            else if (fd == timer_->GetFd())
+            {
+                timer_->OnTimerFd();
+            }
+            // 信号
+            else if (fd == signalFd_)
+            {
+                DealSignal_();
+            }
+            // 热升级中新进程的确认
+            else if (fd == handoffFd_)
+            {
+                DealHandoff_();
+            }
+            // 流式连接的发送队列有数据
+            else if (fd == wakeFd_)
+            {
+                DealWake_();
+            }
+            // 持久注册模式和流式连接：所有连接事件都先经过所有权判断
+            else if (persistentEvents_ || users_[fd].IsStreaming())
+            {
+                // 确保用户映射表中存在该文件描述符
+                assert(users_.count(fd) > 0);
+
+                DealEvent_(&users_[fd], events);
+            }
             // 如果事件是关闭、挂起或错误事件
             else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
@@ -184,17 +365,16 @@ void WebServer::Start()
 }
 
 // 发送错误信息
-void WebServer::SendError_(int fd, const char *info)
+void WebServer::SendError_(int fd, const char *info, size_t len)
 {
     // 断言文件描述符有效（大于 0）
     assert(fd > 0);
 
     // 发送错误信息给客户端
     // fd 是客户端的文件描述符
-    // info 是要发送的错误信息
-    // strlen(info) 获取错误信息的长度
-    // 0 表示默认的发送标志
-    int ret = send(fd, info, strlen(info), 0);
+    // info 是要发送的错误信息，len 是它的长度
+    // 套接字是非阻塞的，发送缓冲区一定放得下这么短的响应；对端已关闭时不产生 SIGPIPE
+    int ret = send(fd, info, len, MSG_DONTWAIT | MSG_NOSIGNAL);
 
     // 如果发送失败（返回值小于 0）
     if (ret < 0)
@@ -207,6 +387,131 @@ void WebServer::SendError_(int fd, const char *info)
     close(fd);
 }
 
+// 登录/注册：表单中的用户名和密码交给 UserStore 验证，成功返回欢迎页，失败返回错误页
+static int AuthHandler_(HttpRequest &req, bool isLogin)
+{
+    if (!req.IsFormPost())
+    {
+        return -1; // 不是表单提交，返回页面本身
+    }
+    bool ok = HttpRequest::UserVerify(req.GetPost("username"), req.GetPost("password"), isLogin);
+    req.path() = ok ? "/welcome.html" : "/error.html";
+    return -1;
+}
+
+// 上传：文件已经在接收请求体时写入上传目录，这里只记录结果
+static int UploadHandler_(HttpRequest &req)
+{
+    UploadSink *upload = dynamic_cast<UploadSink *>(req.Body());
+    if (!upload)
+    {
+        return 400; // 不是 multipart/form-data，或者没有请求体
+    }
+    for (const UploadSink::File &file : upload->Files())
+    {
+        LOG_INFO("Uploaded %s -> %s, %d bytes", file.name.c_str(), file.path.c_str(), (int)file.size);
+    }
+    req.path() = "/picture.html";
+    return -1;
+}
+
+// WebSocket 聊天室：每条消息广播给所有在线的连接，只编码一次；文本消息同时发给订阅了 "chat" 的 SSE 连接
+class ChatHandler_ : public WebSocketHandler
+{
+public:
+    explicit ChatHandler_(std::shared_ptr<EventBroadcaster> events) : events_(std::move(events)) {}
+
+    void OnOpen(WebSocket &ws) override
+    {
+        room_.Join(&ws);
+    }
+    void OnMessage(WebSocket &ws, WebSocket::Opcode opcode, const std::string &message) override
+    {
+        room_.Broadcast(opcode, message);
+        if (opcode == WebSocket::TEXT)
+        {
+            events_->Publish("chat", message, "message");
+        }
+    }
+
+private:
+    WebSocketGroup room_; // 连接关闭时自动离开
+    std::shared_ptr<EventBroadcaster> events_;
+};
+
+// SSE：只读的聊天室，慢的客户端丢弃消息而不是占用内存
+class ChatEvents_ : public EventStreamHandler
+{
+public:
+    explicit ChatEvents_(std::shared_ptr<EventBroadcaster> events) : events_(std::move(events)) {}
+
+    void OnOpen(EventStream &stream) override
+    {
+        events_->Subscribe("chat", &stream, EventStream::DROP); // 连接关闭时自动取消
+        stream.Send("connected", "ready");
+    }
+
+private:
+    std::shared_ptr<EventBroadcaster> events_;
+};
+
+// 注册路由
+void WebServer::InitRoutes_()
+{
+    Router *router = Router::Instance();
+    router->AddStatic("/", "/index.html");
+    for (const char *page : {"/index", "/register", "/login", "/welcome", "/video", "/picture"})
+    {
+        router->AddStatic(page, std::string(page) + ".html");
+    }
+    auto login = [](HttpRequest &req, const Router::Params &) { return AuthHandler_(req, true); };
+    auto reg = [](HttpRequest &req, const Router::Params &) { return AuthHandler_(req, false); };
+    // 页面中的表单提交到 "/login"、"/register"
+    for (const char *path : {"/login", "/login.html"})
+    {
+        router->Add(Router::METHOD_POST, path, login, RateLimiter::ROUTE_AUTH);
+    }
+    for (const char *path : {"/register", "/register.html"})
+    {
+        router->Add(Router::METHOD_POST, path, reg, RateLimiter::ROUTE_AUTH);
+    }
+    // 上传：POST /upload 为表单（multipart/form-data），PUT /upload/<文件名> 的请求体就是文件内容
+    auto upload = [](HttpRequest &req, const Router::Params &) { return UploadHandler_(req); };
+    router->Add(Router::METHOD_POST, "/upload", upload, RateLimiter::ROUTE_UPLOAD,
+                [](HttpRequest &req, const Router::Params &) -> std::unique_ptr<BodySink> {
+                    std::string boundary = MultipartSink::Boundary(req.GetHeader("Content-Type"));
+                    return std::unique_ptr<BodySink>(boundary.empty() ? nullptr : new MultipartSink(boundary));
+                });
+    router->Add(Router::METHOD_PUT, "/upload/:name", upload, RateLimiter::ROUTE_UPLOAD,
+                [](HttpRequest &req, const Router::Params &params) -> std::unique_ptr<BodySink> {
+                    return std::unique_ptr<BodySink>(new FileSink(params.Get(req.path(), 0)));
+                });
+    // WebSocket：GET /ws 升级，消息广播给所有连接；GET /events 以 SSE 只接收消息
+    auto chat = std::make_shared<EventBroadcaster>();
+    router->AddWebSocket("/ws", std::make_shared<ChatHandler_>(chat));
+    router->AddEventStream("/events", std::make_shared<ChatEvents_>(chat));
+}
+
+// 过载时拒绝请求
+void WebServer::ShedConn_(HttpConn *client)
+{
+    assert(client);
+    int fd = client->GetFd();
+
+    // 先读掉已到达的请求数据：关闭时接收缓冲区里还有数据，内核会发 RST，客户端可能收不到 503
+    char discard[4096];
+    for (int i = 0; i < 16 && recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0; i++)
+    {
+    }
+    if (send(fd, SERVICE_UNAVAILABLE, sizeof(SERVICE_UNAVAILABLE) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+    {
+        LOG_WARN("send 503 to client[%d] error!", fd);
+    }
+    shedCount_++;
+    LOG_DEBUG("Client[%d] shed, queue %d", fd, (int)threadpool_->QueueSize());
+    CloseConn_(client);
+}
+
 // 关闭客户端连接
 void WebServer::CloseConn_(HttpConn *client)
 {
@@ -235,17 +540,15 @@ void WebServer::AddClient_(int fd, sockaddr_in addr)
     // 如果设置了超时时间
     if (timeoutMS_ > 0)
     {
-        // 添加定时器，超时时间为 timeoutMS_ 毫秒
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        // 添加定时器：新连接处于接收请求头阶段，先按请求头超时
+        timer_->add(fd, headerTimeoutMS_, std::bind(&WebServer::OnDeadline_, this, &users_[fd]));
     }
 
     // 向 epoll 实例中添加客户端的文件描述符和事件类型
     // fd 是客户端的文件描述符
     // EPOLLIN | connEvent_ 是事件类型，包括读事件和连接事件
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-
-    // 设置文件描述符为非阻塞模式
-    SetFdNonblock(fd);
+    // 套接字已由 accept4 设置为非阻塞；持久注册模式下读写事件一次注册好
+    epoller_->AddFd(fd, EPOLLIN | connEvent_ | (persistentEvents_ ? EPOLLOUT : 0));
 
     // 记录客户端连接日志
     LOG_INFO("Client[%d] in!", users_[fd].GetFd());
@@ -257,29 +560,36 @@ void WebServer::DealListen_()
     // 定义客户端地址结构体
     struct sockaddr_in addr;
 
-    // 定义客户端地址结构体长度
-    socklen_t len = sizeof(addr);
+    acceptWakeups_++;
 
-    // 循环处理新连接
-    do
+    // 每次就绪最多 accept ACCEPT_BATCH 个连接；水平触发模式下也一次取一批，减少 epoll_wait 次数
+    for (int i = 0; i < ACCEPT_BATCH; i++)
     {
-        // 接受新的连接，返回客户端的文件描述符
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        // 定义客户端地址结构体长度（accept4 会修改它，每次都要重置）
+        socklen_t len = sizeof(addr);
 
-        // 如果文件描述符小于等于 0，返回
+        // 接受新的连接并直接设置非阻塞和 close-on-exec，省去两次 fcntl
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        // 队列已空（EAGAIN）或出错，返回
         if (fd <= 0)
         {
+            if (fd < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_WARN("accept error: %d", errno);
+            }
             return;
         }
 
         // 如果客户端数量大于等于最大文件描述符数量
         else if (HttpConn::userCount >= MAX_FD)
         {
-            // 发送错误信息给客户端
-            SendError_(fd, "Server busy!");
+            // 发送 503 给客户端
+            SendError_(fd, SERVICE_UNAVAILABLE, sizeof(SERVICE_UNAVAILABLE) - 1);
 
             // 记录警告日志，提示客户端数量已满
             LOG_WARN("Clients is full!");
+            acceptRejected_++;
 
             // 返回
             return;
@@ -287,7 +597,314 @@ void WebServer::DealListen_()
 
         // 添加客户端
         AddClient_(fd, addr);
-    } while (listenEvent_ & EPOLLET); // 如果是边缘触发模式，继续循环
+        acceptCount_++;
+    }
+
+    // 配额用完，队列里可能还有连接。
+    // 边缘触发模式下不会再收到通知，重新注册监听事件，内核发现队列非空会在下一轮 epoll_wait 再次报告
+    acceptBudgetExhausted_++;
+    if (listenEvent_ & EPOLLET)
+    {
+        epoller_->RearmFd(listenFd_, listenEvent_ | EPOLLIN);
+    }
+}
+
+// 屏蔽并通过 signalfd 接收信号
+int WebServer::CreateSignalFd_()
+{
+    // 写已关闭的连接时返回 EPIPE，而不是让 SIGPIPE 终止进程
+    signal(SIGPIPE, SIG_IGN);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR2);
+    // 在创建线程池之前屏蔽，之后创建的线程继承屏蔽字，信号只会通过 signalfd 送达
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0)
+    {
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+// 处理信号
+void WebServer::DealSignal_()
+{
+    struct signalfd_siginfo info;
+    while (read(signalFd_, &info, sizeof(info)) == sizeof(info))
+    {
+        if (info.ssi_signo == SIGUSR2)
+        {
+            Upgrade_();
+        }
+        else
+        {
+            StartDrain_(info.ssi_signo == SIGINT ? "SIGINT" : "SIGTERM");
+        }
+    }
+}
+
+// 通过 Unix 套接字发送一个文件描述符
+static bool SendFd_(int sock, int fd)
+{
+    char byte = 'L';
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+// 从 Unix 套接字接收一个文件描述符，失败时返回 -1
+static int RecvFd_(int sock)
+{
+    char byte;
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+    {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+// /proc/self/exe 指向进程启动时的文件（inode）：部署替换文件后它仍是旧的程序，
+// 所以启动时就把它解析成路径保存下来，升级时 exec 这个路径上的新文件
+std::string WebServer::ExePath_()
+{
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0)
+    {
+        return std::string();
+    }
+    return std::string(path, len);
+}
+
+// 热升级
+void WebServer::Upgrade_()
+{
+    if (draining_ || handoffFd_ >= 0)
+    {
+        LOG_WARN("Upgrade already in progress");
+        return;
+    }
+    if (exePath_.empty())
+    {
+        LOG_ERROR("Upgrade: unknown executable path!");
+        return;
+    }
+    // 取得当前进程的命令行参数，新进程使用相同的参数启动
+    std::vector<std::string> args;
+    FILE *fp = fopen("/proc/self/cmdline", "r");
+    if (fp)
+    {
+        std::string arg;
+        int c;
+        while ((c = fgetc(fp)) != EOF)
+        {
+            if (c == '\0')
+            {
+                args.push_back(arg);
+                arg.clear();
+            }
+            else
+            {
+                arg += static_cast<char>(c);
+            }
+        }
+        fclose(fp);
+    }
+    if (args.empty())
+    {
+        LOG_ERROR("Upgrade: read cmdline error!");
+        return;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        LOG_ERROR("Upgrade: socketpair error!");
+        return;
+    }
+    // exec 需要的参数在 fork 之前准备好：多线程进程 fork 后的子进程里不能分配内存
+    std::vector<char *> argv;
+    for (auto &arg : args)
+    {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+    char env[64];
+    snprintf(env, sizeof(env), "%s=%d", HANDOFF_ENV, sv[1]);
+    std::vector<char *> envp;
+    for (char **e = environ; *e; e++)
+    {
+        envp.push_back(*e);
+    }
+    envp.push_back(env);
+    envp.push_back(nullptr);
+    sigset_t emptyMask;
+    sigemptyset(&emptyMask);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        LOG_ERROR("Upgrade: fork error!");
+        close(sv[0]);
+        close(sv[1]);
+        return;
+    }
+    if (pid == 0)
+    {
+        // 子进程：只保留 sv[1]，恢复信号屏蔽字后 exec。这里只能调用 async-signal-safe 的函数
+        fcntl(sv[1], F_SETFD, 0);
+        pthread_sigmask(SIG_SETMASK, &emptyMask, nullptr);
+        execve(exePath_.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+
+    close(sv[1]);
+    // 新进程 exec 并初始化完成后才会读取，监听套接字在这期间一直由本进程 accept
+    if (!SendFd_(sv[0], listenFd_))
+    {
+        LOG_ERROR("Upgrade: send listen fd error!");
+        close(sv[0]);
+        return;
+    }
+    handoffFd_ = sv[0];
+    childPid_ = pid;
+    SetFdNonblock(handoffFd_);
+    epoller_->AddFd(handoffFd_, EPOLLIN | EPOLLRDHUP);
+    LOG_INFO("Upgrade: started new process %d", pid);
+}
+
+// 新进程回复确认（或启动失败关闭了套接字）
+void WebServer::DealHandoff_()
+{
+    char ack = 0;
+    ssize_t n = recv(handoffFd_, &ack, 1, 0);
+    if (n < 0 && errno == EAGAIN)
+    {
+        return;
+    }
+    epoller_->DelFd(handoffFd_);
+    close(handoffFd_);
+    handoffFd_ = -1;
+    if (n == 1 && ack == 'R')
+    {
+        LOG_INFO("Upgrade: new process %d is ready", childPid_);
+        StartDrain_("upgrade");
+        return;
+    }
+    // 新进程初始化失败，继续由本进程服务
+    LOG_ERROR("Upgrade: new process %d failed, keep serving", childPid_);
+    waitpid(childPid_, nullptr, WNOHANG);
+    childPid_ = -1;
+}
+
+// 开始排空
+void WebServer::StartDrain_(const char *reason)
+{
+    if (draining_)
+    {
+        return;
+    }
+    LOG_INFO("Drain (%s): stop accepting, %d connections in flight", reason, (int)HttpConn::userCount);
+    draining_ = true;
+    drainDeadline_ = LoopClock::Now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+    if (listenFd_ >= 0)
+    {
+        epoller_->DelFd(listenFd_);
+        close(listenFd_);
+        listenFd_ = -1;
+    }
+    // 空闲的长连接不再等待完整的超时时间
+    for (auto &user : users_)
+    {
+        if (!user.second.IsClose())
+        {
+            ExtentTime_(&user.second);
+        }
+    }
+}
+
+// 读取 /proc/net/netstat 中 TcpExt 的某个计数，失败时返回 0
+static uint64_t ReadTcpExtCounter_(const char *name)
+{
+    FILE *fp = fopen("/proc/net/netstat", "r");
+    if (!fp)
+    {
+        return 0;
+    }
+    // 文件中 TcpExt 占两行：第一行是字段名，第二行是对应的值
+    char keys[8192], values[8192];
+    uint64_t result = 0;
+    while (fgets(keys, sizeof(keys), fp) && fgets(values, sizeof(values), fp))
+    {
+        if (strncmp(keys, "TcpExt:", 7) != 0)
+        {
+            continue;
+        }
+        char *keySave = nullptr, *valSave = nullptr;
+        char *key = strtok_r(keys, " \n", &keySave);
+        char *val = strtok_r(values, " \n", &valSave);
+        while (key && val)
+        {
+            if (strcmp(key, name) == 0)
+            {
+                result = strtoull(val, nullptr, 10);
+                break;
+            }
+            key = strtok_r(nullptr, " \n", &keySave);
+            val = strtok_r(nullptr, " \n", &valSave);
+        }
+        break;
+    }
+    fclose(fp);
+    return result;
+}
+
+// 获取 accept 统计
+WebServer::AcceptStats WebServer::GetAcceptStats() const
+{
+    AcceptStats stats = {};
+    stats.accepted = acceptCount_;
+    stats.wakeups = acceptWakeups_;
+    stats.budgetExhausted = acceptBudgetExhausted_;
+    stats.rejected = acceptRejected_;
+
+    // 对监听套接字，tcpi_unacked 是当前全连接队列长度，tcpi_sacked 是队列上限
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (listenFd_ >= 0 && getsockopt(listenFd_, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+    {
+        stats.acceptQueue = info.tcpi_unacked;
+        stats.backlog = info.tcpi_sacked;
+    }
+    stats.listenOverflows = ReadTcpExtCounter_("ListenOverflows");
+    stats.listenDrops = ReadTcpExtCounter_("ListenDrops");
+    return stats;
 }
 
 // 处理读事件，主要逻辑是将 OnRead 加入线程池的任务队列中
@@ -299,10 +916,92 @@ void WebServer::DealRead_(HttpConn *client)
     // 延长客户端连接时间
     ExtentTime_(client);
 
+    // 快速路径：由反应堆线程自己读取，只把需要阻塞的工作交给线程池
+    if (inlineFastPath_)
+    {
+        OnReadInline_(client);
+        return;
+    }
+
+    // 线程池已过载，新请求不再排队
+    if (!threadpool_->Admit())
+    {
+        ShedConn_(client);
+        return;
+    }
+
     // 将 OnRead 加入线程池的任务队列中
     threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
 }
 
+// 持久注册模式下的连接事件
+void WebServer::DealEvent_(HttpConn *client, uint32_t events)
+{
+    // 已有线程在处理这个连接，它结束时会看到这次事件
+    if (!client->Acquire())
+    {
+        return;
+    }
+    // 关闭、挂起或错误事件
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+    {
+        CloseConn_(client);
+    }
+    // 流式连接：读写都在 OnStream_ 中处理
+    else if (client->IsStreaming())
+    {
+        threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+    }
+    // 上一个响应还没发完：先发完，OnWrite_ 结束后会接着读
+    else if (client->ToWriteBytes() > 0)
+    {
+        DealWrite_(client);
+    }
+    else if (events & EPOLLIN)
+    {
+        DealRead_(client);
+    }
+    // 没有要发送的数据，只是可写通知
+    else
+    {
+        Rearm_(client, EPOLLIN);
+    }
+}
+
+// 一次读/写处理结束
+void WebServer::Rearm_(HttpConn *client, uint32_t events)
+{
+    if (!persistentEvents_)
+    {
+        epoller_->ModFd(client->GetFd(), connEvent_ | events);
+        return;
+    }
+    // 配额用完，连接里还有数据：保留所有权，排到线程池队尾接着处理
+    if (client->IoBudgetHit())
+    {
+        Resume_(client);
+        return;
+    }
+    // 事件一直注册着，只需要放弃所有权；处理期间又来了事件（ET 不会再通知）就接着处理
+    if (!client->Release())
+    {
+        Resume_(client);
+    }
+}
+
+// 接着处理持有所有权的连接（在新的一轮中）
+void WebServer::Resume_(HttpConn *client)
+{
+    if (client->ToWriteBytes() > 0)
+    {
+        threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    }
+    else
+    {
+        threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    }
+}
+
 // 处理写事件，主要逻辑是将 OnWrite 加入线程池的任务队列中
 void WebServer::DealWrite_(HttpConn *client)
 {
@@ -325,13 +1024,101 @@ void WebServer::ExtentTime_(HttpConn *client)
     // 如果设置了超时时间
     if (timeoutMS_ > 0)
     {
+        int timeout = timeoutMS_;
+        switch (client->Phase())
+        {
+        case HttpConn::HEADERS:
+        case HttpConn::BODY:
+            return; // 截止时间从阶段开始计算，收到数据也不延长，慢速发送的请求不能一直占用连接
+        case HttpConn::IDLE:
+            timeout = headerTimeoutMS_; // 空闲的长连接上收到数据：新请求开始
+            break;
+        default:
+            client->Touch(); // 响应有进展
+            break;
+        }
+        if (draining_)
+        {
+            // 排空中不再等到完整的空闲超时，最多到截止时间
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(drainDeadline_ - LoopClock::Now()).count();
+            timeout = std::max<int>(0, std::min<long long>(timeout, left));
+        }
         // 调整定时器，将客户端的文件描述符和超时时间传入
-        timer_->adjust(client->GetFd(), timeoutMS_);
+        timer_->adjust(client->GetFd(), timeout);
+    }
+}
+
+// 定时器到期
+void WebServer::OnDeadline_(HttpConn *client)
+{
+    assert(client);
+    if (client->IsClose())
+    {
+        return;
+    }
+    HttpConn::PHASE phase = client->Phase();
+    if (phase == HttpConn::STREAMING)
+    {
+        StreamDeadline_(client);
+        return;
+    }
+    int limit = timeoutMS_;
+    if (phase == HttpConn::HEADERS)
+    {
+        limit = headerTimeoutMS_;
+    }
+    else if (phase == HttpConn::BODY)
+    {
+        limit = bodyTimeoutMS_;
+    }
+    auto deadline = client->PhaseSince() + std::chrono::milliseconds(limit);
+    if (draining_)
+    {
+        // 排空中空闲的长连接直接关闭，其余最多到排空截止时间
+        deadline = phase == HttpConn::IDLE ? LoopClock::Now() : std::min(deadline, drainDeadline_);
+    }
+    // 定时器比截止时间早（阶段改变、响应有进展后没有调整定时器），按剩余时间重新设置
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - LoopClock::Now()).count();
+    if (left > DEADLINE_SLACK_MS)
+    {
+        timer_->add(client->GetFd(), left, std::bind(&WebServer::OnDeadline_, this, client));
+        return;
     }
+    if (phase == HttpConn::HEADERS || phase == HttpConn::BODY)
+    {
+        size_t len = 0;
+        const char *timeout = HttpResponse::FastResponse(408, &len);
+        // 状态行 | Date | 其余部分
+        size_t status = strstr(timeout, "\r\n") + 2 - timeout;
+        char date[64];
+        int dateLen = snprintf(date, sizeof(date), "Date: %s\r\n", TimeService::HttpDate());
+        struct iovec iov[3] = {{const_cast<char *>(timeout), status},
+                               {date, static_cast<size_t>(dateLen)},
+                               {const_cast<char *>(timeout + status), len - status}};
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 3;
+        if (sendmsg(client->GetFd(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        {
+            LOG_WARN("send 408 to client[%d] error!", client->GetFd());
+        }
+        LOG_DEBUG("Client[%d] request timeout in %s", client->GetFd(), phase == HttpConn::HEADERS ? "headers" : "body");
+    }
+    CloseConn_(client);
 }
 
 // 处理读事件
 void WebServer::OnRead_(HttpConn *client)
+{
+    client->BeginTurn();
+    if (Read_(client))
+    {
+        Serve_(client);
+    }
+}
+
+// 读取请求并处理；返回 true 表示持久注册模式下响应已发完，调用方接着读下一个请求
+bool WebServer::Read_(HttpConn *client)
 {
     // 断言客户端连接有效
     assert(client);
@@ -350,31 +1137,138 @@ void WebServer::OnRead_(HttpConn *client)
         CloseConn_(client);
 
         // 返回
-        return;
+        return false;
     }
 
     // 业务逻辑的处理（先读后处理）
-    OnProcess(client);
+    return Process_(client);
 }
 
 // 处理读（请求）数据的函数
 void WebServer::OnProcess(HttpConn *client)
+{
+    if (Process_(client))
+    {
+        Serve_(client);
+    }
+}
+
+bool WebServer::Process_(HttpConn *client)
 {
     // 首先调用 process() 进行逻辑处理
     if (client->process())
     {
         // 读完事件就跟内核说可以写了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT); // 响应成功，修改监听事件为写,等待 OnWrite_() 发送
+        if (persistentEvents_)
+        {
+            return Write_(client); // 写事件一直注册着，直接写，写不完时等待下一次可写通知
+        }
+        Rearm_(client, EPOLLOUT); // 响应成功，修改监听事件为写,等待 OnWrite_() 发送
     }
     else
     {
         // 写完事件就跟内核说可以读了
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        Rearm_(client, EPOLLIN);
+    }
+    return false;
+}
+
+// 快速路径的读事件处理（在反应堆线程中执行）
+void WebServer::OnReadInline_(HttpConn *client)
+{
+    client->BeginTurn();
+    if (ReadInline_(client))
+    {
+        Serve_(client);
     }
 }
 
+// 读取是非阻塞的；命中内存缓存的 GET 直接生成响应并写出，不经过线程池。
+// POST（登录/注册需要访问数据库）和需要打开文件的请求仍交给线程池，避免阻塞事件循环。
+bool WebServer::ReadInline_(HttpConn *client)
+{
+    // 断言客户端连接有效
+    assert(client);
+
+    int readErrno = 0;
+    int ret = client->read(&readErrno);
+    if (ret <= 0 && readErrno != EAGAIN)
+    {
+        CloseConn_(client);
+        return false;
+    }
+
+    // 没有数据，继续等待读事件
+    if (!client->HasInput())
+    {
+        Rearm_(client, EPOLLIN);
+        return false;
+    }
+
+    // 不是完整的 GET 请求：可能需要访问数据库，整体交给线程池
+    if (!client->IsReadOnlyRequest())
+    {
+        if (!threadpool_->Admit())
+        {
+            ShedConn_(client);
+            return false;
+        }
+        threadpool_->AddTask(std::bind(&WebServer::OnProcess, this, client));
+        return false;
+    }
+
+    // 请求还不完整（例如带请求体的 GET），继续等待读事件
+    if (!client->ParseRequest())
+    {
+        Rearm_(client, EPOLLIN);
+        return false;
+    }
+
+    // 资源不在缓存中，生成响应需要 stat/open/mmap，交给线程池
+    if (!client->HasCachedResponse())
+    {
+        if (!threadpool_->Admit())
+        {
+            ShedConn_(client);
+            return false;
+        }
+        threadpool_->AddTask(std::bind(&WebServer::OnRespond_, this, client));
+        return false;
+    }
+
+    // 命中缓存：直接生成响应并尝试写出，写不完时由 OnWrite_ 重新注册写事件
+    client->MakeResponse();
+    return Write_(client);
+}
+
+// 生成响应并等待写事件（在线程池中执行）
+void WebServer::OnRespond_(HttpConn *client)
+{
+    client->MakeResponse();
+    if (persistentEvents_)
+    {
+        // 写事件一直注册着，直接写
+        if (Write_(client))
+        {
+            Serve_(client);
+        }
+        return;
+    }
+    Rearm_(client, EPOLLOUT);
+}
+
 // 处理写事件
 void WebServer::OnWrite_(HttpConn *client)
+{
+    client->BeginTurn();
+    if (Write_(client))
+    {
+        Serve_(client);
+    }
+}
+
+// 写出响应；返回 true 表示响应已发完、连接保持，调用方接着读下一个请求
+bool WebServer::Write_(HttpConn *client)
 {
     // 断言客户端连接有效
     assert(client);
@@ -389,13 +1283,31 @@ void WebServer::OnWrite_(HttpConn *client)
     // 如果客户端要写的字节数为 0
     if (client->ToWriteBytes() == 0)
     {
-        // 传输完成
-        if (client->IsKeepAlive())
+        // 101 或 SSE 的响应头发完，之后是 WebSocket 帧或事件；排空中不再建立新的流式连接
+        if (client->IsStreamPending() && !draining_)
         {
-            // OnProcess(client);
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN); // 回归换成监测读事件
-            return;
+            StartStream_(client);
+            return false;
         }
+        // 传输完成；排空中不再保持连接
+        if (client->IsKeepAlive() && !draining_)
+        {
+            // 持久注册（ET）模式下，写的期间到达的请求不会再有读通知；读缓冲区里还有流水线上的请求时
+            // 也不会再有读通知（数据已经不在套接字里）。这两种情况由 Serve_ 接着读
+            if (persistentEvents_ || client->HasInput())
+            {
+                return true;
+            }
+            Rearm_(client, EPOLLIN); // 回归换成监测读事件
+            return false;
+        }
+    }
+    // 配额用完还没写完：重新排队，先处理其他连接
+    // （EPOLLONESHOT 模式下重新注册 EPOLLOUT，套接字可写时马上再次就绪，排在本轮其他事件之后）
+    else if (client->IoBudgetHit())
+    {
+        Rearm_(client, EPOLLOUT);
+        return false;
     }
     // 如果写返回值小于 0
     else if (ret < 0)
@@ -403,17 +1315,29 @@ void WebServer::OnWrite_(HttpConn *client)
         // 如果写错误号是 EAGAIN，缓冲区满了
         if (writeErrno == EAGAIN)
         {
-            // 继续传输
-            // 传输完成
-            if (client->IsKeepAlive())
-            {
-                // OnProcess(client);
-                epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN); // 回归换成监测读事件
-                return;
-            }
+            // 继续传输：等待套接字可写后由 OnWrite_ 写出剩余部分
+            Rearm_(client, EPOLLOUT);
+            return false;
         }
     }
     CloseConn_(client); // 关闭客户端连接
+    return false;
+}
+
+// 一个响应发完、连接保持：循环读取并处理流水线上的下一个请求，不递归。
+// 一轮（线程拿到连接之后）最多处理 TURN_REQUESTS 个请求、读写 IO_BUDGET 字节，哪个先用完都
+// 把连接（仍持有所有权，EPOLLONESHOT 模式下也还没有重新注册）排到线程池队尾，
+// 一个不停发送请求的连接不会独占反应堆线程或工作线程，也不会让读缓冲区无限增长
+void WebServer::Serve_(HttpConn *client)
+{
+    for (int i = 0; i < TURN_REQUESTS && !client->TurnSpent(); i++)
+    {
+        if (!(inlineFastPath_ ? ReadInline_(client) : Read_(client)))
+        {
+            return;
+        }
+    }
+    Resume_(client);
 }
 
 // 创建监听套接字
@@ -431,8 +1355,25 @@ bool WebServer::InitSocket_()
     // 设置端口号，使用网络字节序
     addr.sin_port = htons(port_);
 
-    // 创建套接字，使用 IPv4 地址族，流式套接字，默认协议
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    // 由旧进程热升级启动：直接使用旧进程交过来的监听套接字，不需要重新 bind
+    const char *handoff = getenv(HANDOFF_ENV);
+    if (handoff)
+    {
+        handoffFd_ = atoi(handoff);
+        unsetenv(HANDOFF_ENV);
+        fcntl(handoffFd_, F_SETFD, FD_CLOEXEC);
+        listenFd_ = RecvFd_(handoffFd_);
+        if (listenFd_ < 0 || !epoller_->AddFd(listenFd_, listenEvent_ | EPOLLIN))
+        {
+            LOG_ERROR("Receive listen fd from old process error!");
+            return false;
+        }
+        LOG_INFO("Server port:%d, listen fd inherited from old process", port_);
+        return true;
+    }
+
+    // 创建套接字，使用 IPv4 地址族，流式套接字，默认协议；直接创建为非阻塞、close-on-exec
+    listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 
     // 如果创建套接字失败，记录错误日志并返回 false
     if (listenFd_ < 0)
@@ -466,8 +1407,21 @@ bool WebServer::InitSocket_()
         return false;
     }
 
-    // 开始监听，最大监听队列长度为 8
-    ret = listen(listenFd_, 8);
+    // 三次握手完成后，等客户端发来请求数据再放入全连接队列，减少只建连不发数据时的空唤醒
+    optval = DEFER_ACCEPT_SEC;
+    if (setsockopt(listenFd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &optval, sizeof(optval)) < 0)
+    {
+        LOG_WARN("set TCP_DEFER_ACCEPT error!");
+    }
+
+    // TCP Fast Open：客户端重连时可以在 SYN 中携带请求数据，节省一个 RTT
+    if (fastOpenQueue_ > 0 && setsockopt(listenFd_, IPPROTO_TCP, TCP_FASTOPEN, &fastOpenQueue_, sizeof(fastOpenQueue_)) < 0)
+    {
+        LOG_WARN("set TCP_FASTOPEN error!");
+    }
+
+    // 开始监听，全连接队列长度为 listenBacklog_，超过 net.core.somaxconn 时内核会截断
+    ret = listen(listenFd_, listenBacklog_);
 
     // 如果监听失败，记录错误日志，关闭套接字并返回 false
     if (ret < 0)
@@ -488,11 +1442,8 @@ bool WebServer::InitSocket_()
         return false;
     }
 
-    // 设置监听套接字为非阻塞模式
-    SetFdNonblock(listenFd_);
-
     // 记录服务器端口信息
-    LOG_INFO("Server port:%d", port_);
+    LOG_INFO("Server port:%d, backlog:%d, fastopen:%d", port_, GetAcceptStats().backlog, fastOpenQueue_);
 
     // 返回 true，表示初始化成功
     return true;
@@ -504,6 +1455,110 @@ int WebServer::SetFdNonblock(int fd)
     // 断言文件描述符有效（大于 0）
     assert(fd > 0);
 
-    // 获取文件描述符的当前标志，并添加非阻塞标志
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+    // 获取文件状态标志（F_GETFL，不是描述符标志 F_GETFD），并添加非阻塞标志
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// 处理 wakeFd_：Push 过数据的连接交给线程池发送
+void WebServer::DealWake_()
+{
+    uint64_t count;
+    while (read(wakeFd_, &count, sizeof(count)) == sizeof(count))
+    {
+    }
+    HttpConn::TakeWoken(&woken_);
+    for (auto &woken : woken_)
+    {
+        HttpConn *client = woken.first;
+        // fd 已经关闭并分配给了新连接，或者连接已关闭
+        if (client->Generation() != woken.second || client->IsClose() || !client->IsStreaming())
+        {
+            continue;
+        }
+        // 刚升级的连接：定时器还是按接收请求设置的，改为空闲超时
+        if (client->TakeStarted() && timeoutMS_ > 0)
+        {
+            timer_->add(client->GetFd(), timeoutMS_, std::bind(&WebServer::OnDeadline_, this, client));
+        }
+        // 已有线程在处理这个连接，它放弃所有权时会看到这次唤醒
+        if (client->Acquire())
+        {
+            threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+        }
+    }
+}
+
+// 连接升级为流式连接
+void WebServer::StartStream_(HttpConn *client)
+{
+    // 定时器只能在反应堆线程中修改：唤醒它，由 DealWake_ 设置定时器并把连接交给线程池（OnOpen 不在反应堆线程执行）。
+    // EPOLLONESHOT 模式下事件已失效，之前也不使用所有权标志，之后 DealWake_ 取得所有权时一定成功
+    client->StartStream();
+    if (persistentEvents_ && !client->Release())
+    {
+        threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+    }
+}
+
+// 处理流式连接
+void WebServer::OnStream_(HttpConn *client)
+{
+    assert(client);
+    if (client->IsClose())
+    {
+        return;
+    }
+    if (!client->Stream())
+    {
+        CloseConn_(client);
+        return;
+    }
+    RearmStream_(client);
+}
+
+// 流式连接处理结束
+void WebServer::RearmStream_(HttpConn *client)
+{
+    if (!persistentEvents_)
+    {
+        // 先重新注册再放弃所有权：之后到达的事件要么看到所有权已放弃，要么被 Release 发现
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN | (client->HasOutput() ? EPOLLOUT : 0));
+    }
+    // 配额用完，或者处理期间来了事件/唤醒：保留所有权接着处理
+    if (client->IoBudgetHit() || !client->Release())
+    {
+        threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+    }
+}
+
+// 流式连接的定时器到期
+void WebServer::StreamDeadline_(HttpConn *client)
+{
+    // 连接正在被处理，稍后再检查（Acquire 留下的标记会让处理线程多处理一轮，没有副作用）
+    if (!client->Acquire())
+    {
+        timer_->add(client->GetFd(), DEADLINE_SLACK_MS, std::bind(&WebServer::OnDeadline_, this, client));
+        return;
+    }
+    auto deadline = client->PhaseSince() + std::chrono::milliseconds(timeoutMS_);
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - LoopClock::Now()).count();
+    // 排空中流式连接不会自己结束，直接关闭
+    if (!draining_ && left > DEADLINE_SLACK_MS)
+    {
+        timer_->add(client->GetFd(), left, std::bind(&WebServer::OnDeadline_, this, client));
+        if (!client->Release())
+        {
+            threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+        }
+        return;
+    }
+    // 空闲了一个超时：发 ping，再等一个超时
+    if (!draining_ && client->Heartbeat())
+    {
+        timer_->add(client->GetFd(), timeoutMS_, std::bind(&WebServer::OnDeadline_, this, client));
+        threadpool_->AddTask(std::bind(&WebServer::OnStream_, this, client));
+        return;
+    }
+    LOG_DEBUG("Client[%d] stream %s", client->GetFd(), draining_ ? "closed by drain" : "ping timeout");
+    CloseConn_(client);
 }
@@ -9,16 +9,31 @@
 #include <errno.h>		 // errno 变量
 #include <sys/socket.h>	 // socket 相关函数和结构体
 #include <netinet/in.h>	 // sockaddr_in 结构体
+#include <netinet/tcp.h> // TCP_DEFER_ACCEPT、TCP_FASTOPEN、TCP_INFO
 #include <arpa/inet.h>	 // inet_pton() 函数
+#include <signal.h>		 // sigprocmask() 函数
+#include <sys/signalfd.h> // signalfd() 函数
+#include <sys/eventfd.h> // eventfd() 函数
+#include <sys/wait.h>	 // waitpid() 函数
+#include <sys/stat.h>	 // mkdir() 函数
+#include <limits.h>	 // PATH_MAX
+#include <chrono>		 // 排空截止时间
 
 #include "epoller.h"			// 包含 epoller 类
 #include "../timer/heaptimer.h" // 包含 HeapTimer 类
 
 #include "../log/log.h"			 // 包含日志类
 #include "../pool/sqlconnpool.h" // 包含 SQL 连接池类
+#include "../pool/registerbatcher.h" // 包含注册组提交类
+#include "../pool/userfilter.h" // 包含用户名布隆过滤器
+#include "../store/mysqluserstore.h" // 包含 MySQL 用户存储
+#include "../store/mmapuserstore.h"	 // 包含嵌入式用户存储
 #include "../pool/threadpool.h"	 // 包含线程池类
 
 #include "../http/httpconn.h" // 包含 HTTP 连接类
+#include "../http/upload.h"   // 包含上传的请求体接收者
+#include "../http/websocket.h" // 包含 WebSocket 会话
+#include "../http/eventstream.h" // 包含 SSE 会话和广播器
 
 // WebServer 类的定义
 class WebServer
@@ -29,7 +44,11 @@ public:
 		int port, int trigMode, int timeoutMS,
 		int sqlPort, const char *sqlUser, const char *sqlPwd,
 		const char *dbName, int connPoolNum, int threadNum,
-		bool openLog, int logLevel, int logQueSize);
+		bool openLog, int logLevel, int logQueSize,
+		int connPoolMax = 0, bool sqlThreadAffine = false,
+		const char *userDb = nullptr, bool inlineFastPath = false,
+		int listenBacklog = 1024, int fastOpenQueue = 0,
+		int headerTimeoutMS = 10000, int bodyTimeoutMS = 30000);
 
 	// 析构函数，销毁 WebServer 对象
 	~WebServer();
@@ -37,6 +56,26 @@ public:
 	// 启动服务器
 	void Start();
 
+	/*信号：
+	SIGTERM/SIGINT：停止接受新连接，处理完已有请求（最多 DRAIN_TIMEOUT_MS）后退出；
+	SIGUSR2：热升级。fork 并 exec 当前可执行文件，通过 Unix 套接字（SCM_RIGHTS）把监听套接字交给新进程，
+	新进程初始化完成后回复确认，旧进程随即停止 accept 并排空退出。升级期间监听套接字一直存在，不会拒绝连接。*/
+	static const int DRAIN_TIMEOUT_MS = 30000;
+
+	// accept 统计
+	struct AcceptStats
+	{
+		uint64_t accepted;		  // 累计接受的连接数
+		uint64_t wakeups;		  // 监听套接字的就绪次数
+		uint64_t budgetExhausted; // 一次就绪用完 accept 配额、剩余连接留到下一轮的次数
+		uint64_t rejected;		  // 连接数已满被拒绝的连接数
+		uint32_t acceptQueue;	  // 当前全连接队列长度（TCP_INFO tcpi_unacked）
+		uint32_t backlog;		  // 生效的全连接队列上限（TCP_INFO tcpi_sacked）
+		uint64_t listenOverflows; // 全连接队列溢出次数（/proc/net/netstat ListenOverflows，全系统）
+		uint64_t listenDrops;	  // 监听套接字丢弃的 SYN 数（/proc/net/netstat ListenDrops，全系统）
+	};
+	AcceptStats GetAcceptStats() const;
+
 private:
 	// 初始化套接字
 	bool InitSocket_();
@@ -44,24 +83,73 @@ private:
 	// 初始化事件模式
 	void InitEventMode_(int trigMode);
 
+	// 注册路由：页面别名（"/login" -> "/login.html"）和登录/注册的处理函数
+	static void InitRoutes_();
+
 	// 添加客户端
 	void AddClient_(int fd, sockaddr_in addr);
 
 	// 处理监听事件
 	void DealListen_();
 
+	// 阻塞要处理的信号并创建 signalfd，必须在创建任何线程之前调用
+	static int CreateSignalFd_();
+
+	// 处理 signalfd 上的信号
+	void DealSignal_();
+
+	// 热升级：启动新进程并交出监听套接字
+	void Upgrade_();
+	static std::string ExePath_(); // 当前可执行文件的绝对路径，失败时为空
+
+	// 处理新进程的确认（或失败）
+	void DealHandoff_();
+
+	// 停止 accept，开始排空已有连接
+	void StartDrain_(const char *reason);
+
 	// 处理写事件
 	void DealWrite_(HttpConn *client);
 
+	// 持久注册模式下处理连接事件：先取得连接的所有权，再按连接状态决定读还是写
+	void DealEvent_(HttpConn *client, uint32_t events);
+
+	// 一次读/写处理结束：EPOLLONESHOT 模式下重新注册 events；持久注册模式下放弃所有权
+	void Rearm_(HttpConn *client, uint32_t events);
+
+	// 持久注册模式下，放弃所有权时发现处理期间又来了事件，把连接重新交给线程池
+	void Resume_(HttpConn *client);
+
+	// 处理 wakeFd_：其他线程向流式连接的发送队列追加了数据
+	void DealWake_();
+
+	// 101 响应发完：连接进入流式模式，之后两种事件模式都靠所有权标志避免并发处理，由 DealWake_ 开始处理
+	void StartStream_(HttpConn *client);
+
+	// 流式连接：读取并处理到达的帧，发送队列中的数据（在线程池中执行，持有所有权）
+	void OnStream_(HttpConn *client);
+
+	// 流式连接处理结束：EPOLLONESHOT 模式下重新注册（有没发完的数据时加上 EPOLLOUT），然后放弃所有权
+	void RearmStream_(HttpConn *client);
+
+	// 流式连接的定时器：空闲超过 timeoutMS_ 先发 ping，再过一个超时仍没有数据就关闭
+	void StreamDeadline_(HttpConn *client);
+
 	// 处理读事件
 	void DealRead_(HttpConn *client);
 
 	// 发送错误信息
-	void SendError_(int fd, const char *info);
+	void SendError_(int fd, const char *info, size_t len);
 
-	// 延长客户端连接时间
+	// 线程池过载时拒绝请求：直接回复预先生成的 503 并关闭连接
+	void ShedConn_(HttpConn *client);
+
+	// 延长客户端连接时间：只有空闲连接开始新请求、或响应有进展时才延长，接收请求期间不延长
 	void ExtentTime_(HttpConn *client);
 
+	// 定时器到期：按连接所处阶段的截止时间判断，接收请求超时回复 408 后关闭，没有到期则重新设置定时器
+	void OnDeadline_(HttpConn *client);
+
 	// 关闭客户端连接
 	void CloseConn_(HttpConn *client);
 
@@ -74,26 +162,95 @@ private:
 	// 处理客户端请求
 	void OnProcess(HttpConn *client);
 
+	// 快速路径：在反应堆线程读取并解析，命中缓存的 GET 直接响应，其余交给线程池
+	void OnReadInline_(HttpConn *client);
+
+	// 线程池中生成响应（请求已在反应堆线程解析）
+	void OnRespond_(HttpConn *client);
+
+	// 以上处理的各个步骤：返回 true 表示响应已发完、连接保持，由 Serve_ 接着读下一个请求
+	bool Read_(HttpConn *client);
+	bool Process_(HttpConn *client);
+	bool ReadInline_(HttpConn *client);
+	bool Write_(HttpConn *client);
+
+	// 循环处理同一个连接上的后续请求，每轮最多 TURN_REQUESTS 个、IO_BUDGET 字节，之后重新排队
+	void Serve_(HttpConn *client);
+
 	// 最大文件描述符数量
 	static const int MAX_FD = 65536;
 
+	// 监听套接字每次就绪最多 accept 的连接数，避免连接风暴时饿死已建立连接的读写事件
+	static const int ACCEPT_BATCH = 64;
+
+	// TCP_DEFER_ACCEPT 的等待时间（秒）：三次握手后客户端发来数据才唤醒 accept
+	static const int DEFER_ACCEPT_SEC = 1;
+
+	// 每轮（线程拿到连接到重新排队）最多读写的字节数，用完后连接重新排队，避免大上传/大下载或流水线独占线程
+	static const size_t IO_BUDGET = 256 * 1024;
+
+	// 每轮最多连续处理的请求数（流水线上的请求），用完后连接重新排队
+	static const int TURN_REQUESTS = 16;
+
+	// 准入控制：每个工作线程最多排队的任务数，以及 CoDel 的目标排队时延和观察窗口（毫秒）
+	static const int MAX_QUEUE_PER_THREAD = 256;
+	static const int QUEUE_TARGET_MS = 5;
+	static const int QUEUE_INTERVAL_MS = 100;
+
+	// 每个 IP 登录/注册的速率（次/秒）和突发量，超过时回复 429
+	static const int AUTH_RATE_PER_SEC = 5;
+	static const int AUTH_BURST = 10;
+	// 上传：每个 IP 的速率和突发量，一个上传请求最多的字节数，上传目录（工作目录下，资源目录之外）
+	static const int UPLOAD_RATE_PER_SEC = 1;
+	static const int UPLOAD_BURST = 5;
+	static const size_t UPLOAD_MAX_BYTES = 64 * 1024 * 1024;
+	static const char UPLOAD_DIR[];
+
+	// 过载时的响应，启动前生成，拒绝时直接 send，不分配内存也不解析请求
+	static const char SERVICE_UNAVAILABLE[];
+
+	// 定时器到期时离截止时间不到这么多毫秒也算超时（缓存时钟的误差），避免反复重新设置
+	static const int DEADLINE_SLACK_MS = 10;
+
 	// 设置文件描述符为非阻塞模式
 	static int SetFdNonblock(int fd);
 
 	int port_;		  // 服务器端口号
 	bool openLinger_; // 是否启用优雅关闭
-	int timeoutMS_;	  // 超时时间（毫秒）
+	int timeoutMS_;	  // 超时时间（毫秒）：长连接空闲、响应没有进展的最长时间
+	int headerTimeoutMS_; // 从连接建立（或上一个响应发完后收到数据）到收完请求头的最长时间
+	int bodyTimeoutMS_;	  // 收完请求头之后收完请求体的最长时间
 	bool isClose_;	  // 服务器是否关闭
+	bool inlineFastPath_; // 是否在反应堆线程直接处理命中缓存的请求
 	int listenFd_;	  // 监听套接字文件描述符
+	int listenBacklog_; // listen 的全连接队列长度（受 net.core.somaxconn 限制）
+	int fastOpenQueue_; // TCP Fast Open 队列长度，0 表示不启用
 	char *srcDir_;	  // 资源目录
 
 	uint32_t listenEvent_; // 监听事件类型
 	uint32_t connEvent_;   // 连接事件类型
+	bool persistentEvents_; // 连接只注册一次 EPOLLIN|EPOLLOUT（ET，不使用 EPOLLONESHOT），靠所有权标志避免并发处理
+
+	int signalFd_;	// 接收 SIGTERM/SIGINT/SIGUSR2，在创建线程池之前初始化
+	int wakeFd_;	// eventfd，HttpConn::Push 写入（HttpConn::wakeFd）
+	int handoffFd_; // 热升级时与新（旧）进程通信的 Unix 套接字，-1 表示没有
+	pid_t childPid_; // 热升级启动的新进程
+	std::string exePath_; // 启动时的可执行文件路径，热升级时 exec 这个路径上（可能已被替换的）文件
+	bool draining_;	// 是否正在排空
+	std::chrono::steady_clock::time_point drainDeadline_; // 排空截止时间
 
 	std::unique_ptr<HeapTimer> timer_;		  // 定时器
 	std::unique_ptr<ThreadPool> threadpool_;  // 线程池
 	std::unique_ptr<Epoller> epoller_;		  // epoll 实例
 	std::unordered_map<int, HttpConn> users_; // 客户端连接映射表
+	std::vector<std::pair<HttpConn *, uint64_t>> woken_; // DealWake_ 取出的连接，复用容量
+
+	// accept 计数，只在反应堆线程中修改
+	uint64_t acceptCount_ = 0;
+	uint64_t acceptWakeups_ = 0;
+	uint64_t acceptBudgetExhausted_ = 0;
+	uint64_t acceptRejected_ = 0;
+	uint64_t shedCount_ = 0; // 因过载被拒绝的请求数
 };
 
 #endif // WEB_SERVER_H
\ No newline at end of file
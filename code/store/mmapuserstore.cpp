@@ -0,0 +1,228 @@
+#include "mmapuserstore.h"
+
+#include <fcntl.h>	   // open
+#include <unistd.h>	   // close, ftruncate
+#include <sys/stat.h>  // fstat
+#include <sys/mman.h>  // mmap, munmap
+#include <string.h>
+#include <stdio.h>	   // rename
+#include <errno.h>
+
+static const char USER_MAGIC[8] = {'T', 'W', 'S', 'U', 'S', 'E', 'R', '1'};
+
+MmapUserStore::~MmapUserStore() {
+	Close();
+}
+
+uint64_t MmapUserStore::Hash_(const char* str, size_t len) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < len; i++) {
+		hash ^= static_cast<unsigned char>(str[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+size_t MmapUserStore::FileSize_(uint64_t capacity) {
+	return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+bool MmapUserStore::Map_(int fd, uint64_t capacity, bool init) {
+	size_t len = FileSize_(capacity);
+	if(init && ftruncate(fd, len) < 0) {
+		LOG_ERROR("MmapUserStore: ftruncate error!");
+		return false;
+	}
+	void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED) {
+		LOG_ERROR("MmapUserStore: mmap error!");
+		return false;
+	}
+	base_ = static_cast<char*>(base);
+	mapLen_ = len;
+	header_ = reinterpret_cast<Header*>(base_);
+	slots_ = reinterpret_cast<Slot*>(base_ + sizeof(Header));
+	if(init) {
+		// ftruncate 扩展出的部分全部为 0，即所有槽位为空
+		memcpy(header_->magic, USER_MAGIC, sizeof(USER_MAGIC));
+		header_->capacity = capacity;
+		header_->count = 0;
+	}
+	return true;
+}
+
+bool MmapUserStore::Open(const std::string& path, uint64_t initCapacity) {
+	assert(initCapacity > 0 && (initCapacity & (initCapacity - 1)) == 0); // 容量必须是 2 的幂
+	std::unique_lock<std::shared_timed_mutex> locker(mtx_);
+	path_ = path;
+	fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if(fd_ < 0) {
+		LOG_ERROR("MmapUserStore: open %s error!", path.c_str());
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd_, &st) < 0) {
+		LOG_ERROR("MmapUserStore: stat %s error!", path.c_str());
+		close(fd_);
+		fd_ = -1;
+		return false;
+	}
+	if(st.st_size == 0) {
+		return Map_(fd_, initCapacity, true);
+	}
+	// 已有文件：先读出头部确认格式和容量。容量用作探测的掩码，必须是非零的 2 的幂，
+	// 并且至少有一个空槽位，否则 Find_ 会探测错误的槽位或者一直循环；按文件大小比较，不计算 FileSize_ 以免溢出
+	Header header;
+	if(pread(fd_, &header, sizeof(header), 0) != sizeof(header)
+	   || memcmp(header.magic, USER_MAGIC, sizeof(USER_MAGIC)) != 0
+	   || header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0
+	   || header.count >= header.capacity
+	   || header.capacity > (static_cast<size_t>(st.st_size) - sizeof(Header)) / sizeof(Slot)) {
+		LOG_ERROR("MmapUserStore: %s is not a user store file!", path.c_str());
+		close(fd_);
+		fd_ = -1;
+		return false;
+	}
+	if(!Map_(fd_, header.capacity, false)) {
+		close(fd_);
+		fd_ = -1;
+		return false;
+	}
+	LOG_INFO("MmapUserStore: %s loaded, %d users", path.c_str(), (int)header_->count);
+	return true;
+}
+
+void MmapUserStore::Close() {
+	std::unique_lock<std::shared_timed_mutex> locker(mtx_);
+	if(base_) {
+		msync(base_, mapLen_, MS_SYNC);
+		munmap(base_, mapLen_);
+		base_ = nullptr;
+		header_ = nullptr;
+		slots_ = nullptr;
+	}
+	if(fd_ >= 0) {
+		close(fd_);
+		fd_ = -1;
+	}
+}
+
+// 线性探测：返回名字匹配的槽位，或者第一个空槽位
+MmapUserStore::Slot* MmapUserStore::Find_(const std::string& name, uint64_t hash) const {
+	uint64_t mask = header_->capacity - 1;
+	for(uint64_t i = hash & mask;; i = (i + 1) & mask) {
+		Slot* slot = &slots_[i];
+		if(!slot->used) {
+			return slot;
+		}
+		if(slot->hash == hash && slot->nameLen == name.size()
+		   && memcmp(slot->name, name.data(), name.size()) == 0) {
+			return slot;
+		}
+	}
+}
+
+bool MmapUserStore::Login(const std::string& name, const std::string& pwd) {
+	if(name.size() > MAX_NAME_LEN || pwd.size() > MAX_PWD_LEN) {
+		return false;
+	}
+	uint64_t hash = Hash_(name.data(), name.size());
+	std::shared_lock<std::shared_timed_mutex> locker(mtx_);
+	if(!slots_) {
+		return false;
+	}
+	const Slot* slot = Find_(name, hash);
+	if(!slot->used) {
+		return false;
+	}
+	if(slot->pwdLen != pwd.size() || memcmp(slot->pwd, pwd.data(), pwd.size()) != 0) {
+		LOG_INFO("pwd error!");
+		return false;
+	}
+	return true;
+}
+
+bool MmapUserStore::Register(const std::string& name, const std::string& pwd) {
+	if(name.size() > MAX_NAME_LEN || pwd.size() > MAX_PWD_LEN) {
+		return false;
+	}
+	uint64_t hash = Hash_(name.data(), name.size());
+	std::unique_lock<std::shared_timed_mutex> locker(mtx_);
+	if(!slots_) {
+		return false;
+	}
+	if((header_->count + 1) * 10 > header_->capacity * 7 && !Grow_()) {
+		return false;
+	}
+	Slot* slot = Find_(name, hash);
+	if(slot->used) {
+		LOG_INFO("user used!");
+		return false;
+	}
+	slot->hash = hash;
+	slot->nameLen = name.size();
+	slot->pwdLen = pwd.size();
+	memcpy(slot->name, name.data(), name.size());
+	memcpy(slot->pwd, pwd.data(), pwd.size());
+	slot->used = 1; // 最后置位，进程崩溃时不会留下半写的槽位
+	header_->count++;
+	return true;
+}
+
+uint64_t MmapUserStore::Count() {
+	std::shared_lock<std::shared_timed_mutex> locker(mtx_);
+	return header_ ? header_->count : 0;
+}
+
+// 调用方持有独占锁
+bool MmapUserStore::Grow_() {
+	uint64_t capacity = header_->capacity * 2;
+	std::string tmpPath = path_ + ".tmp";
+	int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(fd < 0) {
+		LOG_ERROR("MmapUserStore: open %s error!", tmpPath.c_str());
+		return false;
+	}
+	char* oldBase = base_;
+	size_t oldLen = mapLen_;
+	Slot* oldSlots = slots_;
+	uint64_t oldCapacity = header_->capacity;
+	if(!Map_(fd, capacity, true)) {
+		base_ = oldBase;
+		mapLen_ = oldLen;
+		header_ = reinterpret_cast<Header*>(base_);
+		slots_ = oldSlots;
+		close(fd);
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	// 在新表中重新插入所有用户
+	for(uint64_t i = 0; i < oldCapacity; i++) {
+		const Slot& old = oldSlots[i];
+		if(!old.used) {
+			continue;
+		}
+		std::string name(old.name, old.nameLen);
+		*Find_(name, old.hash) = old;
+		header_->count++;
+	}
+	// 先落盘再替换，任何时刻磁盘上都有一份完整的用户表
+	msync(base_, mapLen_, MS_SYNC);
+	if(rename(tmpPath.c_str(), path_.c_str()) < 0) {
+		// 新表不会成为正式的文件，继续使用旧表，这次注册失败
+		LOG_ERROR("MmapUserStore: rename %s error: %d", tmpPath.c_str(), errno);
+		munmap(base_, mapLen_);
+		base_ = oldBase;
+		mapLen_ = oldLen;
+		header_ = reinterpret_cast<Header*>(base_);
+		slots_ = oldSlots;
+		close(fd);
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	munmap(oldBase, oldLen);
+	close(fd_);
+	fd_ = fd;
+	LOG_INFO("MmapUserStore: grow to %d slots", (int)capacity);
+	return true;
+}
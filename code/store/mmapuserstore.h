@@ -0,0 +1,63 @@
+#ifndef MMAP_USERSTORE_H
+#define MMAP_USERSTORE_H
+
+#include <string>
+#include <shared_mutex>
+#include <stdint.h>
+#include "userstore.h"
+#include "../log/log.h"
+
+/*嵌入式后端：用户保存在一个 mmap(MAP_SHARED) 映射的开放寻址哈希表文件里，
+登录和注册都在进程内完成，没有网络往返，也不需要 mysqld，适合单机部署和压测。
+文件格式：Header + capacity 个定长 Slot，线性探测；装载率超过 0.7 时扩容为 2 倍并整体重建。
+读用共享锁，写用独占锁。*/
+class MmapUserStore : public UserStore
+{
+public:
+	static const size_t MAX_NAME_LEN = 63; // 与 user 表的列宽一致
+	static const size_t MAX_PWD_LEN = 63;
+
+	MmapUserStore() = default;
+	~MmapUserStore() override;
+
+	bool Open(const std::string &path, uint64_t initCapacity = 4096); // 打开或创建用户库文件
+	void Close();
+
+	bool Login(const std::string &name, const std::string &pwd) override;
+	bool Register(const std::string &name, const std::string &pwd) override;
+	uint64_t Count();
+
+private:
+	struct Header
+	{
+		char magic[8];		// "TWSUSER1"
+		uint64_t capacity;	// 槽位数，2 的幂
+		uint64_t count;		// 已使用的槽位数
+	};
+
+	struct Slot
+	{
+		uint64_t hash;
+		uint8_t used;
+		uint8_t nameLen;
+		uint8_t pwdLen;
+		char name[MAX_NAME_LEN];
+		char pwd[MAX_PWD_LEN];
+	};
+
+	static uint64_t Hash_(const char *str, size_t len); // FNV-1a，结果写入文件，必须跨进程稳定
+	static size_t FileSize_(uint64_t capacity);
+	bool Map_(int fd, uint64_t capacity, bool init); // 映射文件，init 为 true 时写入空表
+	Slot *Find_(const std::string &name, uint64_t hash) const; // 查找用户，找不到时返回应插入的空槽位
+	bool Grow_(); // 扩容为 2 倍，写入临时文件后原子替换
+
+	std::string path_;
+	int fd_ = -1;
+	char *base_ = nullptr;
+	size_t mapLen_ = 0;
+	Header *header_ = nullptr;
+	Slot *slots_ = nullptr;
+	std::shared_timed_mutex mtx_;
+};
+
+#endif // MMAP_USERSTORE_H
@@ -0,0 +1,69 @@
+#include "mysqluserstore.h"
+
+int MySqlUserStore::QueryUser_(const std::string& name, std::string* password) {
+	MYSQL* sql;
+	SqlConnRAII sqlConn(&sql, SqlConnPool::Instance()); // 函数返回时归还连接
+	if(!sql) {
+		// 在等待时间内没有拿到连接（数据库繁忙或不可用）
+		LOG_WARN("MySqlUserStore: no sql connection available");
+		return -1;
+	}
+	char escaped[2 * 64 + 1];
+	if(name.size() > 64) {
+		return 0; // 超过 username 列的长度，不可能存在
+	}
+	mysql_real_escape_string(sql, escaped, name.c_str(), name.size());
+	char order[256] = {0};
+	snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", escaped);
+	LOG_DEBUG("%s", order);
+	if(mysql_query(sql, order)) {
+		return -1;
+	}
+	MYSQL_RES* res = mysql_store_result(sql);
+	int found = 0;
+	if(MYSQL_ROW row = mysql_fetch_row(res)) {
+		LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
+		*password = row[1];
+		found = 1;
+	}
+	mysql_free_result(res);
+	return found;
+}
+
+bool MySqlUserStore::Login(const std::string& name, const std::string& pwd) {
+	// 布隆过滤器判定用户名一定不存在，直接失败，不访问数据库
+	if(!UserFilter::Instance()->MayContain(name)) {
+		LOG_DEBUG("UserFilter: unknown user %s", name.c_str());
+		return false;
+	}
+	std::string password;
+	if(QueryUser_(name, &password) != 1) {
+		return false;
+	}
+	if(pwd != password) {
+		LOG_INFO("pwd error!");
+		return false;
+	}
+	return true;
+}
+
+bool MySqlUserStore::Register(const std::string& name, const std::string& pwd) {
+	// 可能存在时先查询一次，已被使用就不必进入组提交；一定不存在时跳过 SELECT
+	if(UserFilter::Instance()->MayContain(name)) {
+		std::string password;
+		int found = QueryUser_(name, &password); // 查询结束时连接已归还，不会占着连接等待组提交
+		if(found != 0) {
+			if(found == 1) {
+				LOG_INFO("user used!");
+			}
+			return false;
+		}
+	}
+	LOG_DEBUG("regirster!");
+	// 交给组提交线程，与同一时间窗口内的其他注册合并成一个事务写入；用户名冲突时返回 false。
+	bool ok = RegisterBatcher::Instance()->Submit(name, pwd).get();
+	if(ok) {
+		UserFilter::Instance()->Add(name);
+	}
+	return ok;
+}
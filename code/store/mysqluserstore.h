@@ -0,0 +1,23 @@
+#ifndef MYSQL_USERSTORE_H
+#define MYSQL_USERSTORE_H
+
+#include <mysql/mysql.h>
+#include "userstore.h"
+#include "../pool/sqlconnpool.h"
+#include "../pool/registerbatcher.h"
+#include "../pool/userfilter.h"
+#include "../log/log.h"
+
+// MySQL 后端：查询走 SqlConnPool，注册走 RegisterBatcher，用户名不存在的情况由 UserFilter 短路
+class MySqlUserStore : public UserStore
+{
+public:
+	bool Login(const std::string &name, const std::string &pwd) override;
+	bool Register(const std::string &name, const std::string &pwd) override;
+
+private:
+	// 查询用户：0 不存在，1 存在，-1 数据库错误；存在时通过 password 返回密码
+	static int QueryUser_(const std::string &name, std::string *password);
+};
+
+#endif // MYSQL_USERSTORE_H
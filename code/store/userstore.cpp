@@ -0,0 +1,11 @@
+#include "userstore.h"
+
+std::unique_ptr<UserStore> UserStore::store_;
+
+UserStore* UserStore::Instance() {
+	return store_.get();
+}
+
+void UserStore::Install(std::unique_ptr<UserStore> store) {
+	store_ = std::move(store);
+}
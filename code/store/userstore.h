@@ -0,0 +1,26 @@
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <string>
+#include <memory>
+
+/*用户存储接口：登录校验和注册。
+HttpRequest 只依赖这个接口，具体后端在启动时由 WebServer 选择：
+MySqlUserStore —— 原来的 MySQL 实现（连接池 + 布隆过滤器 + 注册组提交）；
+MmapUserStore  —— 进程内的嵌入式实现，用户保存在 mmap 映射的哈希表文件中，不需要 mysqld。*/
+class UserStore
+{
+public:
+	virtual ~UserStore() = default;
+
+	virtual bool Login(const std::string &name, const std::string &pwd) = 0;	// 用户存在且密码正确
+	virtual bool Register(const std::string &name, const std::string &pwd) = 0; // 用户名未被使用且写入成功
+
+	static UserStore *Instance();							 // 当前使用的后端，未安装时返回 nullptr
+	static void Install(std::unique_ptr<UserStore> store); // 启动时安装后端，之后不再更换
+
+private:
+	static std::unique_ptr<UserStore> store_;
+};
+
+#endif // USERSTORE_H
@@ -10,14 +10,52 @@ void HeapTimer::SwapNode_(size_t i, size_t j) {
     ref_[heap_[j].id] = j;  // 更新节点 j 的索引
 }
 
+HeapTimer::HeapTimer() : timerFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)), armed_(TimeStamp::max()) {
+    heap_.reserve(64);  // 初始化堆的容量为64
+}
+
+HeapTimer::~HeapTimer() {
+    clear();  // 清空所有定时器
+    if (timerFd_ >= 0) {
+        close(timerFd_);
+    }
+}
+
+// 最早的到期时间比 timerfd 的设置更早时才调用 timerfd_settime；更晚时让 timerfd 提前触发一次即可
+void HeapTimer::ArmTimerFd_() {
+    if (timerFd_ < 0 || heap_.empty() || heap_.front().expires >= armed_) {
+        return;
+    }
+    armed_ = heap_.front().expires;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(armed_.time_since_epoch()).count();
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;  // 全 0 表示取消，至少设置 1ns
+    }
+    timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr);  // 绝对时间，已经过去的时间会立即触发
+}
+
+void HeapTimer::OnTimerFd() {
+    uint64_t expirations;
+    while (read(timerFd_, &expirations, sizeof(expirations)) > 0) {}  // 清除可读状态
+    // timerfd 按 CLOCK_MONOTONIC 触发，而缓存的 COARSE 时间可能还没走到设置的到期时间，
+    // 所以到期时间不晚于 timerfd 设置的定时器都算超时，否则 timerfd 会在同一个时间上反复触发
+    TimeStamp fired = armed_;
+    armed_ = TimeStamp::max();  // timerfd 已经触发，不再有设置
+    TimeStamp now = LoopClock::Now();
+    expire_(fired != TimeStamp::max() && fired > now ? fired : now);  // 处理所有已超时的定时器
+    ArmTimerFd_();  // 按新的堆顶重新设置
+}
+
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());  // 确保索引 i 合法
-    size_t parent = (i - 1) / 2;  // 计算父节点的索引
-    while (parent >= 0) {
+    while (i > 0) {  // 到达根节点为止（size_t 的 parent 永远 >= 0，不能用它判断）
+        size_t parent = (i - 1) / 2;  // 计算父节点的索引
         if (heap_[parent] > heap_[i]) {  // 如果父节点大于当前节点
             SwapNode_(i, parent);  // 交换当前节点和父节点
             i = parent;  // 更新当前节点索引为父节点索引
-            parent = (i - 1) / 2;  // 重新计算父节点索引
         } else {
             break;  // 如果父节点不大于当前节点，跳出循环
         }
@@ -64,15 +102,19 @@ void HeapTimer::del_(size_t index) {
 // 调整指定id的结点
 void HeapTimer::adjust(int id, int newExpires) {
     assert(!heap_.empty() && ref_.count(id));  // 确保堆不为空且 id 存在
-    heap_[ref_[id]].expires = Clock::now() + MS(newExpires);  // 更新超时时间
-    siftdown_(ref_[id], heap_.size());  // 向下调整堆
+    size_t i = ref_[id];
+    heap_[i].expires = LoopClock::Now() + MS(newExpires);  // 更新超时时间
+    if (!siftdown_(i, heap_.size())) {  // 超时时间可能变长也可能变短
+        siftup_(i);  // 调整堆
+    }
+    ArmTimerFd_();  // 超时时间变短成为堆顶时需要提前 timerfd
 }
 
 void HeapTimer::add(int id, int timeOut, const TimeoutCallBack& cb) {
     assert(id >= 0);  // 确保 id 合法
     if (ref_.count(id)) {
         int tmp = ref_[id];  // 获取 id 对应的索引
-        heap_[tmp].expires = Clock::now() + MS(timeOut);  // 更新超时时间
+        heap_[tmp].expires = LoopClock::Now() + MS(timeOut);  // 更新超时时间
         heap_[tmp].cb = cb;  // 更新回调函数
         if (!siftdown_(tmp, heap_.size())) {
             siftup_(tmp);  // 调整堆
@@ -80,9 +122,10 @@ void HeapTimer::add(int id, int timeOut, const TimeoutCallBack& cb) {
     } else {
         size_t n = heap_.size();  // 获取当前堆的大小
         ref_[id] = n;  // 将 id 映射到新的索引
-        heap_.push_back({id, Clock::now() + MS(timeOut), cb});  // 添加新节点
+        heap_.push_back({id, LoopClock::Now() + MS(timeOut), cb});  // 添加新节点
         siftup_(n);  // 向上调整堆
     }
+    ArmTimerFd_();  // 新定时器可能成为堆顶
 }
 
 // 删除指定id，并触发回调函数
@@ -92,23 +135,32 @@ void HeapTimer::doWork(int id) {
     }
     size_t i = ref_[id];  // 获取 id 对应的索引
     auto node = heap_[i];  // 获取节点
+    del_(i);  // 先删除节点，回调中可以为同一个 id 重新添加定时器
     node.cb();  // 触发回调函数
-    del_(i);  // 删除节点
 }
 
 void HeapTimer::tick() {
+    expire_(LoopClock::Now());
+}
+
+void HeapTimer::expire_(TimeStamp now) {
     /* 清除超时结点 */
     if (heap_.empty()) {
         return;  // 如果堆为空，直接返回
     }
+    // 先取出所有超时的节点再回调：回调可能为同一个 id 重新添加定时器，新节点留到下一次处理
+    std::vector<TimeoutCallBack> due;
     while (!heap_.empty()) {
         TimerNode node = heap_.front();  // 获取堆顶节点
-        if (std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) {
+        if (node.expires > now) {
             break;  // 如果堆顶节点未超时，跳出循环
         }
-        node.cb();  // 触发回调函数
+        due.push_back(std::move(node.cb));
         pop();  // 移除堆顶节点
     }
+    for (auto &cb : due) {
+        cb();  // 触发回调函数
+    }
 }
 
 void HeapTimer::pop() {
@@ -125,7 +177,7 @@ int HeapTimer::GetNextTick() {
     tick();  // 处理所有已超时的定时器
     size_t res = -1;  // 初始化返回值
     if (!heap_.empty()) {
-        res = std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count();  // 计算下一个定时器的超时时间
+        res = std::chrono::duration_cast<MS>(heap_.front().expires - LoopClock::Now()).count();  // 计算下一个定时器的超时时间
         if (res < 0) { res = 0; }  // 如果超时时间小于0，设置为0
     }
     return res;  // 返回下一个定时器的超时时间
@@ -9,10 +9,13 @@
 #include <functional>           // 包含函数对象和回调函数的定义
 #include <assert.h>             // 包含断言宏的定义，用于调试
 #include <chrono>               // 包含时间库的定义，用于处理时间点和时间段
+#include <sys/timerfd.h>        // 包含 timerfd 相关函数的定义
+#include <unistd.h>             // close() 函数
 #include "../log/log.h"         // 包含自定义日志库的定义
+#include "loopclock.h"          // 事件循环的缓存时钟
 
 typedef std::function<void()> TimeoutCallBack;  // 定义一个回调函数类型，表示超时后要执行的函数
-typedef std::chrono::high_resolution_clock Clock;  // 定义一个高分辨率时钟类型
+typedef std::chrono::steady_clock Clock;  // 单调时钟，与 LoopClock 一致，当前时间统一取 LoopClock::Now()
 typedef std::chrono::milliseconds MS;  // 定义一个表示毫秒的时间段类型
 typedef Clock::time_point TimeStamp;  // 定义一个时间点类型
 
@@ -28,10 +31,13 @@ struct TimerNode {
     }
 };
 
+/*定时器由 timerfd 驱动：timerfd 加入 epoll，到期时可读，事件循环调用 OnTimerFd() 处理超时的定时器，
+epoll_wait 本身不再需要超时参数。只在最早的到期时间提前时才重新设置 timerfd，
+到期时间推后（例如连接有活动时 adjust）不需要系统调用，timerfd 提前触发时只是 tick 一次后重新设置。*/
 class HeapTimer {
 public:
-    HeapTimer() { heap_.reserve(64); }  // 构造函数，初始化堆的容量为64
-    ~HeapTimer() { clear(); }  // 析构函数，清空所有定时器
+    HeapTimer();  // 构造函数，初始化堆的容量为64并创建 timerfd
+    ~HeapTimer();  // 析构函数，清空所有定时器并关闭 timerfd
     
     void adjust(int id, int newExpires);  // 调整定时器的超时时间
     void add(int id, int timeOut, const TimeoutCallBack& cb);  // 添加一个新的定时器
@@ -40,15 +46,21 @@ public:
     void tick();  // 处理所有已超时的定时器
     void pop();  // 移除堆顶的定时器
     int GetNextTick();  // 获取下一个定时器的超时时间
+    int GetFd() const { return timerFd_; }  // timerfd，加入 epoll 监听读事件
+    void OnTimerFd();  // timerfd 可读时调用：处理超时的定时器并重新设置 timerfd
 
 private:
     void del_(size_t i);  // 删除指定位置的定时器
     void siftup_(size_t i);  // 向上调整堆
     bool siftdown_(size_t i, size_t n);  // 向下调整堆
     void SwapNode_(size_t i, size_t j);  // 交换两个定时器节点的位置
+    void expire_(TimeStamp now);  // 处理到期时间不晚于 now 的定时器
+    void ArmTimerFd_();  // 堆顶的到期时间早于 timerfd 当前的设置时，重新设置 timerfd
 
     std::vector<TimerNode> heap_;  // 存储定时器节点的堆
     std::unordered_map<int, size_t> ref_;  // 存储定时器 ID 和堆中位置的映射，方便查找
+    int timerFd_;  // 定时器堆对应的 timerfd
+    TimeStamp armed_;  // timerfd 当前设置的到期时间，TimeStamp::max() 表示未设置
 };
 
 #endif //HEAP_TIMER_H
\ No newline at end of file
@@ -0,0 +1,22 @@
+#include "loopclock.h"
+
+std::atomic<int64_t> LoopClock::nowNs_(0);
+
+LoopClock::TimePoint LoopClock::Coarse() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return TimePoint(std::chrono::nanoseconds(static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec));
+}
+
+void LoopClock::Update() {
+    nowNs_.store(Coarse().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+LoopClock::TimePoint LoopClock::Now() {
+    int64_t ns = nowNs_.load(std::memory_order_relaxed);
+    if (ns == 0) {  // 事件循环还没开始（例如初始化阶段），先刷新一次
+        Update();
+        ns = nowNs_.load(std::memory_order_relaxed);
+    }
+    return TimePoint(std::chrono::nanoseconds(ns));
+}
@@ -0,0 +1,25 @@
+#ifndef LOOP_CLOCK_H
+#define LOOP_CLOCK_H
+
+#include <time.h>               // clock_gettime
+#include <atomic>               // 缓存的时间由反应堆线程写、其他线程读
+#include <chrono>               // 时间点类型
+
+/*事件循环的缓存时钟。
+反应堆线程在每次 epoll_wait 返回后调用 Update() 读取一次 CLOCK_MONOTONIC_COARSE，
+同一轮事件处理中的定时器、超时判断都使用这个时间，不再各自读取时钟。
+COARSE 时钟的精度是一个时钟节拍（通常 1~4ms），对连接超时这类毫秒级以上的判断足够。
+返回 steady_clock 的时间点：Linux 上 steady_clock 就是 CLOCK_MONOTONIC，两者起点相同。*/
+class LoopClock {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static void Update();       // 刷新缓存的时间，由反应堆线程在每次 epoll_wait 返回后调用
+    static TimePoint Now();     // 最近一次 Update 的时间
+    static TimePoint Coarse();  // 直接读取 CLOCK_MONOTONIC_COARSE，不经过缓存
+
+private:
+    static std::atomic<int64_t> nowNs_;  // 缓存的时间（纳秒），0 表示还没有刷新过
+};
+
+#endif //LOOP_CLOCK_H
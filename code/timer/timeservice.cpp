@@ -0,0 +1,49 @@
+#include "timeservice.h"
+
+TimeService::Snapshot TimeService::slots_[TimeService::SLOTS];
+int TimeService::next_ = 0;
+std::atomic<const TimeService::Snapshot*> TimeService::current_(nullptr);
+std::atomic<bool> TimeService::updating_(false);
+
+void TimeService::Update() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    const Snapshot* cur = current_.load(std::memory_order_acquire);
+    if (cur && cur->sec == ts.tv_sec) {
+        return;
+    }
+    if (updating_.exchange(true, std::memory_order_acquire)) {
+        return;  // 其他线程正在刷新
+    }
+    cur = current_.load(std::memory_order_acquire);
+    if (!cur || cur->sec != ts.tv_sec) {
+        if (!cur) {
+            tzset();  // localtime_r 不会自己读取时区
+        }
+        Snapshot* s = &slots_[next_];
+        next_ = (next_ + 1) % SLOTS;
+        struct tm tm;
+        gmtime_r(&ts.tv_sec, &tm);
+        strftime(s->httpDate, sizeof(s->httpDate), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        localtime_r(&ts.tv_sec, &tm);
+        strftime(s->logTime, sizeof(s->logTime), "%Y-%m-%d %H:%M:%S", &tm);
+        s->year = tm.tm_year + 1900;
+        s->mon = tm.tm_mon + 1;
+        s->mday = tm.tm_mday;
+        s->sec = ts.tv_sec;
+        current_.store(s, std::memory_order_release);
+    }
+    updating_.store(false, std::memory_order_release);
+}
+
+const TimeService::Snapshot* TimeService::Now() {
+    const Snapshot* cur = current_.load(std::memory_order_acquire);
+    if (!cur) {  // 事件循环还没开始（例如初始化阶段、测试），先刷新一次
+        Update();
+        cur = current_.load(std::memory_order_acquire);
+        while (!cur) {  // 另一个线程正在做第一次刷新
+            cur = current_.load(std::memory_order_acquire);
+        }
+    }
+    return cur;
+}
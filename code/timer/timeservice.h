@@ -0,0 +1,40 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <time.h>               // clock_gettime, gmtime_r, localtime_r
+#include <atomic>               // 当前快照的指针由刷新的线程发布、所有线程读
+
+/*进程内共享的墙上时间。
+HTTP 的 Date 和日志的时间戳只精确到秒，没有必要每次都调用 time + gmtime_r + strftime。
+Update() 读取一次 CLOCK_REALTIME_COARSE，秒数变化时才重新格式化，把结果写入环形数组中的下一个槽，
+再通过原子指针发布；读者拿到的指针指向已经写好的字符串，直接复制即可，不调用任何库函数。
+槽有 SLOTS 个、每秒最多换一个，读者拿到指针之后即使被挂起几十秒，内容也不会被覆盖。
+反应堆线程在每次 epoll_wait 返回后调用 Update()（和 LoopClock 一起），Log::write 每行也调用一次，
+其他线程只读。*/
+class TimeService {
+public:
+    struct Snapshot {
+        time_t sec;             // 格式化时的秒数
+        int year, mon, mday;    // 本地日期，日志按天切换文件
+        char httpDate[30];      // "Sun, 06 Nov 1994 08:49:37 GMT"，29 个字符
+        char logTime[20];       // 本地时间 "1994-11-06 16:49:37"，19 个字符
+    };
+
+    static const size_t HTTP_DATE_LEN = 29;
+    static const size_t LOG_TIME_LEN = 19;
+
+    static void Update();               // 秒数变化时生成新的快照，多个线程同时调用时只有一个生效
+    static const Snapshot* Now();       // 最近一次的快照，还没有刷新过时先刷新一次
+    static const char* HttpDate() { return Now()->httpDate; }
+    static const char* LogTime() { return Now()->logTime; }
+
+private:
+    static const int SLOTS = 64;
+
+    static Snapshot slots_[SLOTS];
+    static int next_;                           // 下一个要写的槽，只在持有 updating_ 时访问
+    static std::atomic<const Snapshot*> current_;
+    static std::atomic<bool> updating_;
+};
+
+#endif //TIME_SERVICE_H
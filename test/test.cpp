@@ -1,5 +1,11 @@
 #include "../code/log/log.h"
 #include "../code/pool/threadpool.h"
+#include "../code/pool/sqlconnpool.h"
+#include "../code/store/mmapuserstore.h"
+#include "../code/server/epoller.h"
+#include "../code/http/httpscan.h"
+#include <algorithm>
+#include <sys/socket.h>
 #include <features.h>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
@@ -45,7 +51,204 @@ void TestThreadPool() {
     getchar();
 }
 
+// 准入控制：队列满或排队时延持续超过目标值时 Admit() 返回 false
+void TestThreadPoolAdmission() {
+    ThreadPool threadpool(1);
+    threadpool.SetAdmission(8, 5, 20);
+    std::atomic<int> done(0);
+    for(int i = 0; i < 9; i++) { // 工作线程最多取走一个，队列中至少剩 8 个
+        threadpool.AddTask([&done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            done++;
+        });
+    }
+    assert(!threadpool.Admit()); // 队列已满
+    while(done < 9) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(threadpool.QueueSize() == 0);
+    assert(threadpool.Admit()); // 队列排空后恢复
+    printf("ThreadPool admission ok\n");
+}
+
+// 比较共享连接池与线程独占连接的获取/归还开销（需要本地 MySQL）
+void BenchSqlConnPool() {
+    const int threadCnt = 8, loops = 200000;
+    SqlConnPool* pool = SqlConnPool::Instance();
+    pool->Init("localhost", 3306, "root", "123456", "webserver", 12, 24);
+    for(int affine = 0; affine < 2; affine++) {
+        pool->SetThreadAffine(affine ? threadCnt : 0);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for(int i = 0; i < threadCnt; i++) {
+            threads.emplace_back([pool, loops]() {
+                for(int j = 0; j < loops; j++) {
+                    MYSQL* sql;
+                    SqlConnRAII conn(&sql, pool);
+                    assert(sql);
+                }
+            });
+        }
+        for(auto& t : threads) {
+            t.join();
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        printf("%s: %d threads x %d acquire/release in %ld ms\n",
+               affine ? "thread-affine" : "shared pool", threadCnt, loops, (long)ms);
+    }
+    pool->SetThreadAffine(0);
+}
+
+// 嵌入式用户存储的注册/登录吞吐（不需要 MySQL）
+void BenchUserStore() {
+    const int users = 100000;
+    unlink("./bench_users.db");
+    MmapUserStore store;
+    // 被测的调用不能写在 assert 中：定义了 NDEBUG 时它们不会执行
+    bool ok = store.Open("./bench_users.db", 1024);
+    assert(ok);
+    auto start = std::chrono::steady_clock::now();
+    int registered = 0, loggedIn = 0;
+    for(int i = 0; i < users; i++) {
+        registered += store.Register("user" + std::to_string(i), "pwd" + std::to_string(i));
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for(int i = 0; i < users; i++) {
+        loggedIn += store.Login("user" + std::to_string(i), "pwd" + std::to_string(i));
+    }
+    auto end = std::chrono::steady_clock::now();
+    assert(registered == users && loggedIn == users);
+    ok = store.Register("user0", "x");
+    assert(!ok);
+    ok = store.Login("user0", "x");
+    assert(!ok);
+    ok = store.Login("nobody", "x");
+    assert(!ok);
+    (void)ok;
+    printf("MmapUserStore: %d registers in %ld ms, %d logins in %ld ms\n",
+           users, (long)std::chrono::duration_cast<std::chrono::milliseconds>(mid - start).count(),
+           users, (long)std::chrono::duration_cast<std::chrono::milliseconds>(end - mid).count());
+    store.Close();
+    unlink("./bench_users.db");
+}
+
+// 比较 EPOLLONESHOT 每次重新注册与持久注册（ET）下的 epoll_ctl 次数
+void BenchEpollRearm() {
+    const int CONNS = 64, ROUNDS = 2000;
+    const char* names[] = {"oneshot", "persistent"};
+    const uint32_t masks[] = {EPOLLIN | EPOLLONESHOT | EPOLLRDHUP,
+                              EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP};
+    for(int m = 0; m < 2; m++) {
+        Epoller epoller;
+        int fds[CONNS][2];
+        for(int i = 0; i < CONNS; i++) {
+            socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds[i]);
+            epoller.AddFd(fds[i][0], masks[m]);
+        }
+        uint64_t ctlBefore = epoller.GetCtlCount();
+        auto begin = std::chrono::steady_clock::now();
+        char c = 'x';
+        long handled = 0;
+        for(int r = 0; r < ROUNDS; r++) {
+            for(int i = 0; i < CONNS; i++) {
+                ssize_t n = write(fds[i][1], &c, 1);
+                (void)n;
+            }
+            int cnt = epoller.Wait(-1);
+            for(int i = 0; i < cnt; i++) {
+                if(!(epoller.GetEvents(i) & EPOLLIN)) {
+                    continue; // 持久注册下的可写通知
+                }
+                int fd = epoller.GetEventFd(i);
+                while(read(fd, &c, 1) > 0) {}
+                epoller.ModFd(fd, masks[m]); // 处理完后“重新注册”
+                handled++;
+            }
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        printf("%-10s: %ld events, epoll_ctl %llu, skipped %llu, %lld ms\n", names[m], handled,
+               (unsigned long long)(epoller.GetCtlCount() - ctlBefore),
+               (unsigned long long)epoller.GetCtlSkipped(), (long long)ms);
+        for(int i = 0; i < CONNS; i++) {
+            close(fds[i][0]);
+            close(fds[i][1]);
+        }
+    }
+}
+
+// 请求解析用到的扫描：各级实现（标量、SSE4.2、AVX2）的吞吐，以及原来按字节 std::search 查找 "\r\n"
+void BenchHttpScan() {
+    const int ROUNDS = 2000;
+    std::string head = "GET /picture.html HTTP/1.1\r\n";
+    for(int i = 0; i < 16; i++) {
+        head += "X-Header-" + std::to_string(i) + ": " + std::string(40 + i * 3, 'v') + "\r\n";
+    }
+    head += "\r\n";
+    std::string form;
+    for(int i = 0; form.size() < 64 * 1024; i++) {
+        form += "field" + std::to_string(i) + "=some+value%20with%2Fescapes+and+text&";
+    }
+    auto mbps = [](size_t bytes, std::chrono::steady_clock::duration d) {
+        double s = std::chrono::duration<double>(d).count();
+        return s > 0 ? bytes / s / (1024 * 1024) : 0.0;
+    };
+    const char CRLF[] = "\r\n";
+    size_t lines = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for(int r = 0; r < ROUNDS; r++) {
+        const char* p = head.data(), *end = p + head.size();
+        while((p = std::search(p, end, CRLF, CRLF + 2)) != end) {
+            p += 2;
+            lines++;
+        }
+    }
+    printf("%-8s: crlf %8.0f MB/s (%zu lines)\n", "search", mbps(head.size() * ROUNDS, std::chrono::steady_clock::now() - begin),
+           lines / ROUNDS); // 打印结果，定义了 NDEBUG 时循环也不会被优化掉
+    for(int level = HttpScan::SCALAR; level <= HttpScan::Detect(); level++) {
+        HttpScan::Use(static_cast<HttpScan::Level>(level));
+        size_t found = 0, clean = 0, pairs = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < ROUNDS; r++) {
+            const char* p = head.data(), *end = p + head.size();
+            while((p = HttpScan::FindCrlf(p, end)) != end) {
+                p += 2;
+                found++;
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for(int r = 0; r < ROUNDS; r++) {
+            const char* p = head.data(), *end = p + head.size();
+            while(p < end) {
+                const char* eol = HttpScan::FindCrlf(p, end);
+                const char* colon = HttpScan::SkipToken(p, eol);
+                clean += HttpScan::FindCtl(colon, eol) == eol; // 不能写在 assert 中，定义了 NDEBUG 时不会执行
+                p = eol + 2;
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        std::string buf;
+        for(int r = 0; r < ROUNDS / 20; r++) {
+            buf.assign(form);
+            HttpScan::ParseForm(&buf[0], buf.size(), [&pairs](const char*, size_t, const char*, size_t) { pairs++; });
+        }
+        auto t3 = std::chrono::steady_clock::now();
+        assert(found == lines && clean == lines);
+        (void)clean;
+        printf("%-8s: crlf %8.0f MB/s, header validate %8.0f MB/s, form decode %8.0f MB/s (%zu pairs)\n",
+               HttpScan::Name(static_cast<HttpScan::Level>(level)),
+               mbps(head.size() * ROUNDS, t1 - t0), mbps(head.size() * ROUNDS, t2 - t1),
+               mbps(form.size() * (ROUNDS / 20), t3 - t2), pairs / (ROUNDS / 20));
+    }
+    HttpScan::Use(HttpScan::Detect());
+}
+
 int main() {
     TestLog();
     TestThreadPool();
+    TestThreadPoolAdmission();
+    BenchSqlConnPool();
+    BenchUserStore();
+    BenchEpollRearm();
+    BenchHttpScan();
 }
\ No newline at end of file
@@ -0,0 +1,808 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "../code/http/httprequest.h"
+#include "../code/http/httpresponse.h"
+#include "../code/http/httpconn.h"
+#include "../code/http/websocket.h"
+#include "../code/http/eventstream.h"
+#include "../code/http/upload.h"
+
+// 统计 operator new 的调用次数，用于检查稳定状态下处理请求不分配内存。
+// 替换的是整个程序的 operator new，所以这个文件不放在 code/ 下，只链接进单元测试；其他线程也可能分配，计数用原子变量
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+// 通过 parse 提交一个表单，返回解析后的请求
+static bool ParseForm(HttpRequest &request, const std::string &body)
+{
+  Buffer buff;
+  buff.Append("POST /form HTTP/1.1\r\n"
+              "Content-Type: application/x-www-form-urlencoded\r\n"
+              "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+  request.Init();
+  return request.parse(buff) && request.IsFinished();
+}
+
+TEST(HttpRequestTest, ParseFromUrlencodedTest)
+{
+  HttpRequest request;
+
+  // Test case 1: Empty body
+  ASSERT_TRUE(ParseForm(request, ""));
+  EXPECT_EQ(request.GetPost("key"), "");
+
+  // Test case 2: Single key-value pair
+  ASSERT_TRUE(ParseForm(request, "key=value"));
+  EXPECT_EQ(request.GetPost("key"), "value");
+
+  // Test case 3: Multiple key-value pairs
+  ASSERT_TRUE(ParseForm(request, "key1=value1&key2=value2&key3=value3"));
+  EXPECT_EQ(request.GetPost("key1"), "value1");
+  EXPECT_EQ(request.GetPost("key2"), "value2");
+  EXPECT_EQ(request.GetPost("key3"), "value3");
+
+  // Test case 4: Key-value pairs with special characters
+  ASSERT_TRUE(ParseForm(request, "key%20with%20spaces=value%20with%20spaces"));
+  EXPECT_EQ(request.GetPost("key with spaces"), "value with spaces");
+
+  // Test case 4b: '+' decodes to a space, an encoded '+' stays literal
+  ASSERT_TRUE(ParseForm(request, "key+with+plus=a+b%2Bc"));
+  EXPECT_EQ(request.GetPost("key with plus"), "a b+c");
+
+  // Test case 5: Key-value pairs with URL-encoded characters
+  ASSERT_TRUE(ParseForm(request, "key%3Dencoded=value%26encoded"));
+  EXPECT_EQ(request.GetPost("key=encoded"), "value&encoded");
+
+  // Test case 6: Invalid escapes are kept, empty pairs are skipped
+  ASSERT_TRUE(ParseForm(request, "a=100%&&b=%zz%4&c&d=x=y"));
+  EXPECT_EQ(request.GetPost("a"), "100%");
+  EXPECT_EQ(request.GetPost("b"), "%zz%4");
+  EXPECT_EQ(request.GetPost("c"), "");
+  EXPECT_EQ(request.GetPost("d"), "x=y");
+}
+
+TEST(HttpRequestTest, ScanKernelsAgreeTest)
+{
+  // 每个长度和位置都覆盖向量实现的整块部分和标量尾部
+  std::string text(100, 'a');
+  for (int level = HttpScan::SCALAR; level <= HttpScan::Detect(); level++)
+  {
+    ASSERT_TRUE(HttpScan::Use(static_cast<HttpScan::Level>(level)));
+    for (size_t pos = 0; pos < text.size(); pos++)
+    {
+      std::string s = text;
+      s[pos] = '\r';
+      const char *end = s.data() + s.size();
+      EXPECT_EQ(HttpScan::FindChar(s.data(), end, '\r'), s.data() + pos);
+      EXPECT_EQ(HttpScan::FindCrlf(s.data(), end), end);
+      EXPECT_EQ(HttpScan::SkipToken(s.data(), end), s.data() + pos);
+      EXPECT_EQ(HttpScan::FindCtl(s.data(), end), s.data() + pos);
+      s[pos] = '&';
+      EXPECT_EQ(HttpScan::FindFormSpecial(s.data(), end), s.data() + pos);
+      s[pos] = '\t';
+      EXPECT_EQ(HttpScan::FindCtl(s.data(), end), end);
+      s[pos] = '\xc3'; // 非 ASCII 可以出现在值中，不能出现在 token 中
+      EXPECT_EQ(HttpScan::FindCtl(s.data(), end), end);
+      EXPECT_EQ(HttpScan::SkipToken(s.data(), end), s.data() + pos);
+    }
+    // 解除掩码：各个长度都与逐字节异或一致
+    const unsigned char key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    for (size_t len = 0; len <= text.size(); len++)
+    {
+      std::string s = text.substr(0, len), expect = s;
+      for (size_t i = 0; i < len; i++)
+      {
+        expect[i] ^= key[i % 4];
+      }
+      HttpScan::Unmask(&s[0], len, key);
+      EXPECT_EQ(s, expect);
+    }
+  }
+  HttpScan::Use(HttpScan::Detect());
+}
+
+TEST(HttpRequestTest, ParseHeaderTest)
+{
+  HttpRequest request;
+  Buffer buff;
+  buff.Append("GET /index.html HTTP/1.1\r\nHost:  example.com \r\nX-Empty:\r\n\r\n");
+  ASSERT_TRUE(request.parse(buff));
+  ASSERT_TRUE(request.IsFinished());
+  EXPECT_EQ(request.method(), "GET");
+  EXPECT_EQ(request.version(), "1.1");
+  EXPECT_EQ(request.GetHeader("Host"), "example.com");
+  EXPECT_EQ(request.GetHeader("X-Empty"), "");
+  EXPECT_EQ(request.GetHeader("host"), "example.com"); // 名称不区分大小写
+  EXPECT_TRUE(request.Header(HeaderTable::HOST) == "example.com");
+  EXPECT_FALSE(request.Header(HeaderTable::COOKIE));
+
+  for (const char *bad : {"GET /a HTTP/1.1\r\nBad Name: x\r\n\r\n",
+                          "GET /a HTTP/1.1\r\nName : x\r\n\r\n",
+                          "GET /a HTTP/1.1\r\nName: a\x01z\r\n\r\n",
+                          "GET  /a HTTP/1.1\r\n\r\n",
+                          "GET /a FTP/1.1\r\n\r\n",
+                          "GET /../readme.md HTTP/1.1\r\n\r\n",
+                          "GET /upload/../../code/main.cpp HTTP/1.1\r\n\r\n",
+                          "GET .. HTTP/1.1\r\n\r\n",
+                          "POST /a HTTP/1.1\r\nContent-Length: 1\r\ncontent-length: 2\r\n\r\n",
+                          "POST /a HTTP/1.1\r\nContent-Length: 1x\r\n\r\n"})
+  {
+    request.Init();
+    buff.RetrieveAll();
+    buff.Append(bad);
+    EXPECT_FALSE(request.parse(buff)) << bad;
+    EXPECT_EQ(request.ErrorCode(), 400) << bad;
+  }
+}
+
+// 按顺序把各段交给同一个请求解析，模拟分几次读到；返回最后一次 parse 的结果
+static bool ParseParts(HttpRequest &request, std::initializer_list<std::string> parts)
+{
+  Buffer buff;
+  bool ok = true;
+  request.Init();
+  for (const std::string &part : parts)
+  {
+    buff.Append(part);
+    ok = request.parse(buff);
+    if (!ok)
+    {
+      break;
+    }
+  }
+  return ok;
+}
+
+TEST(HttpRequestTest, ParseBodyTest)
+{
+  const std::string head = "POST /form HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\n";
+  const std::string chunked = head + "Transfer-Encoding: chunked\r\n\r\n";
+  HttpRequest request;
+
+  // 块大小行带扩展（";" 或空格之后的内容忽略），尾部字段被忽略
+  ASSERT_TRUE(ParseParts(request, {chunked + "4;name=value\r\nkey=\r\n6 ;x\r\nvalue1\r\n0\r\nX-Trailer: t\r\n\r\n"}));
+  EXPECT_TRUE(request.IsFinished());
+  EXPECT_EQ(request.GetPost("key"), "value1");
+
+  // 块大小行、块结尾、最后的空行中的 CRLF 都被拆到两次读取中
+  ASSERT_TRUE(ParseParts(request, {chunked + "4\r", "\nkey=\r", "\n6\r\nvalue2\r\n0\r", "\n\r", "\n"}));
+  EXPECT_TRUE(request.IsFinished());
+  EXPECT_EQ(request.GetPost("key"), "value2");
+
+  // 只收到一部分时继续等待
+  ASSERT_TRUE(ParseParts(request, {chunked + "a\r\nkey=", "val"}));
+  EXPECT_FALSE(request.IsFinished());
+
+  // 块大小不是十六进制数字、块数据后面不是 CRLF
+  for (const std::string &bad : {chunked + "x\r\n", chunked + "4x\r\n", chunked + "1\r\nab\r\n"})
+  {
+    EXPECT_FALSE(ParseParts(request, {bad})) << bad;
+    EXPECT_EQ(request.ErrorCode(), 400) << bad;
+  }
+
+  // Transfer-Encoding 和 Content-Length 同时出现（不论顺序）、不支持的编码：拒绝
+  for (const std::string &bad : {head + "Transfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n",
+                                 head + "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\nkey=1",
+                                 head + "Transfer-Encoding: gzip, chunked\r\n\r\n"})
+  {
+    EXPECT_FALSE(ParseParts(request, {bad})) << bad;
+    EXPECT_EQ(request.ErrorCode(), 400) << bad;
+  }
+
+  // 请求体上限：Content-Length 在接收之前拒绝；chunked 累计超过上限时在块大小行拒绝
+  size_t maxBody = HttpRequest::maxBodyBytes;
+  HttpRequest::maxBodyBytes = 16;
+  ASSERT_TRUE(ParseParts(request, {head + "Content-Length: 16\r\n\r\nkey=0123456789ab"}));
+  EXPECT_TRUE(request.IsFinished());
+  EXPECT_FALSE(ParseParts(request, {head + "Content-Length: 17\r\n\r\n"}));
+  EXPECT_EQ(request.ErrorCode(), 413);
+  ASSERT_TRUE(ParseParts(request, {chunked + "8\r\nkey=0123\r\n8\r\n456789ab\r\n0\r\n\r\n"}));
+  EXPECT_TRUE(request.IsFinished());
+  EXPECT_FALSE(ParseParts(request, {chunked + "8\r\nkey=0123\r\n", "9\r\n"}));
+  EXPECT_EQ(request.ErrorCode(), 413);
+  EXPECT_FALSE(ParseParts(request, {chunked + "fffffffffffffffffffff\r\n"})); // 不会溢出成一个小的长度
+  EXPECT_EQ(request.ErrorCode(), 413);
+  HttpRequest::maxBodyBytes = maxBody;
+
+  // 尾部字段计入请求头的大小限制：完整的一行或者还没收完的一行超过上限都回复 431
+  const std::string trailer = "X-Trailer: " + std::string(HttpRequest::maxHeaderBytes, 't');
+  EXPECT_FALSE(ParseParts(request, {chunked + "0\r\n" + trailer + "\r\n\r\n"}));
+  EXPECT_EQ(request.ErrorCode(), 431);
+  EXPECT_FALSE(ParseParts(request, {chunked + "0\r\n", trailer}));
+  EXPECT_EQ(request.ErrorCode(), 431);
+  // 过长的块大小行不是尾部字段：400
+  EXPECT_FALSE(ParseParts(request, {chunked + "1;" + std::string(HttpRequest::maxHeaderBytes, 'e')}));
+  EXPECT_EQ(request.ErrorCode(), 400);
+}
+
+static std::string ReadFile(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// 目录中的文件名（不含 "." 和 ".."），按名称排序
+static std::vector<std::string> ListDir(const std::string &dir)
+{
+  std::vector<std::string> names;
+  DIR *d = opendir(dir.c_str());
+  for (dirent *e; d && (e = readdir(d));)
+  {
+    if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
+    {
+      names.push_back(e->d_name);
+    }
+  }
+  if (d)
+  {
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+TEST(HttpRequestTest, UploadTest)
+{
+  char tmp[] = "/tmp/webserver-test-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp), nullptr);
+  const std::string dir = std::string(tmp) + "/";
+  std::string savedDir = UploadSink::dir;
+  UploadSink::dir = dir;
+
+  EXPECT_EQ(MultipartSink::Boundary("multipart/form-data; boundary=\"XyZ\"; charset=utf-8"), "XyZ");
+  EXPECT_EQ(MultipartSink::Boundary("text/plain; boundary=XyZ"), "");
+
+  // 文件内容中有分隔符的前缀；在每个位置把请求体分成两段，分隔符被拆开时也要得到同样的结果
+  const std::string content = "line1\r\n--Xy\r\n-\r\n--XyA\r";
+  const std::string body = "--XyZ\r\n"
+                           "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+                           "hello\r\n"
+                           "--XyZ\r\n"
+                           "Content-Disposition: form-data; name=\"f\"; filename=\"../a.txt\"\r\n"
+                           "Content-Type: text/plain\r\n\r\n" +
+                           content + "\r\n--XyZ--\r\n";
+  for (size_t split = 0; split <= body.size(); split++)
+  {
+    MultipartSink sink("XyZ");
+    ASSERT_TRUE(sink.Write(body.data(), split)) << split;
+    ASSERT_TRUE(sink.Write(body.data() + split, body.size() - split)) << split;
+    ASSERT_TRUE(sink.Finish()) << split;
+    EXPECT_EQ(sink.Fields().at("title"), "hello") << split;
+    ASSERT_EQ(sink.Files().size(), 1u) << split;
+    const UploadSink::File &file = sink.Files()[0];
+    EXPECT_EQ(file.field, "f");
+    EXPECT_EQ(file.name, "../a.txt");
+    EXPECT_EQ(file.path, dir + "a.txt"); // 路径部分被去掉
+    EXPECT_EQ(file.size, content.size());
+    EXPECT_EQ(ReadFile(file.path), content) << split;
+    unlink(file.path.c_str());
+  }
+  EXPECT_TRUE(ListDir(dir).empty()); // 临时文件都改名了
+
+  // 普通字段的总大小超过上限：413，没有收完的文件被删除
+  {
+    MultipartSink sink("XyZ");
+    std::string big = "--XyZ\r\nContent-Disposition: form-data; name=\"f\"; filename=\"b.txt\"\r\n\r\n"
+                      "partial file\r\n--XyZ\r\nContent-Disposition: form-data; name=\"v\"\r\n\r\n" +
+                      std::string(MultipartSink::MAX_FIELD_BYTES, 'v');
+    ASSERT_TRUE(sink.Write(big.data(), big.size()));
+    EXPECT_FALSE(sink.Write("v", 1));
+    EXPECT_EQ(sink.ErrorCode(), 413);
+    EXPECT_EQ(ListDir(dir), std::vector<std::string>{"b.txt"}); // 第一个文件已经收完
+  }
+  {
+    MultipartSink sink("XyZ");
+    std::string open = "--XyZ\r\nContent-Disposition: form-data; name=\"f\"; filename=\"c.txt\"\r\n\r\nabc";
+    ASSERT_TRUE(sink.Write(open.data(), open.size()));
+    EXPECT_FALSE(sink.Finish()); // 没有结束分隔符
+    EXPECT_EQ(sink.ErrorCode(), 400);
+  }
+  EXPECT_EQ(ListDir(dir), std::vector<std::string>{"b.txt"}); // 析构时删除临时文件
+
+  // 同名文件已存在时加序号，不覆盖
+  for (const char *expect : {"b-1.txt", "b-2.txt"})
+  {
+    FileSink sink("b.txt");
+    ASSERT_TRUE(sink.Write("new", 3));
+    ASSERT_TRUE(sink.Finish());
+    ASSERT_EQ(sink.Files().size(), 1u);
+    EXPECT_EQ(sink.Files()[0].path, dir + expect);
+    EXPECT_EQ(ReadFile(sink.Files()[0].path), "new");
+  }
+  EXPECT_EQ(ReadFile(dir + "b.txt"), "partial file");
+  {
+    FileSink sink(".hidden");
+    ASSERT_TRUE(sink.Write("x", 1));
+    ASSERT_TRUE(sink.Finish());
+    EXPECT_EQ(sink.Files()[0].path, dir + "hidden");
+  }
+  EXPECT_EQ(ListDir(dir), (std::vector<std::string>{"b-1.txt", "b-2.txt", "b.txt", "hidden"}));
+
+  for (const std::string &name : ListDir(dir))
+  {
+    unlink((dir + name).c_str());
+  }
+  rmdir(tmp);
+  UploadSink::dir = savedDir;
+}
+
+TEST(HttpRequestTest, HeaderTableTest)
+{
+  for (int f = 0; f < HeaderTable::FIELD_COUNT; f++)
+  {
+    std::string name = HeaderTable::Name(static_cast<HeaderTable::Field>(f));
+    EXPECT_EQ(HeaderTable::Lookup(name.data(), name.size()), f);
+    for (char &c : name)
+    {
+      c = toupper(c);
+    }
+    EXPECT_EQ(HeaderTable::Lookup(name.data(), name.size()), f);
+  }
+  EXPECT_EQ(HeaderTable::Lookup("Hostx", 5), HeaderTable::UNKNOWN);
+  EXPECT_EQ(HeaderTable::Lookup("", 0), HeaderTable::UNKNOWN);
+
+  HeaderTable table;
+  EXPECT_TRUE(table.Add("X-A", 3, "1", 1));
+  EXPECT_TRUE(table.Add("Accept", 6, "text/html", 9));
+  EXPECT_TRUE(table.Add("Accept", 6, "*/*", 3)); // 以最后一个为准
+  EXPECT_TRUE(table.Get("x-a", 3) == "1");
+  EXPECT_TRUE(table.Get(HeaderTable::ACCEPT) == "*/*");
+  EXPECT_EQ(table.Count(), 2u);
+  table.Clear();
+  EXPECT_FALSE(table.Get("X-A", 3));
+  EXPECT_EQ(table.Count(), 0u);
+}
+
+TEST(HttpRequestTest, SteadyStateAllocationTest)
+{
+  char dir[] = "/tmp/webserver-test-XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string srcDir = dir;
+  FILE *fp = fopen((srcDir + "/index.html").c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("<html>hello</html>", fp);
+  fclose(fp);
+
+  // 键和值超过 string 的内联缓冲区，表单解析会用到 arena
+  const std::string form = "username=alice&a_rather_long_field_name=short&comment=a+value+longer+than+sixteen+bytes";
+  const std::string requests[] = {
+      "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+      "User-Agent: test/1.0\r\nX-Custom-Header: some value\r\n\r\n",
+      "POST /form HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+      "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+          std::to_string(form.size()) + "\r\n\r\n" + form,
+  };
+
+  HttpRequest request;
+  HttpResponse response;
+  Buffer in, out;
+  bool ok = true;
+  size_t before = 0;
+  for (int i = 0; i < 200; i++)
+  {
+    if (i == 20)
+    {
+      before = allocations; // 前几轮用于各个缓冲区增长到需要的容量
+    }
+    const std::string &req = requests[i % 2];
+    request.Init();
+    in.Append(req.data(), req.size());
+    ok = ok && request.parse(in) && request.IsFinished();
+    if (i % 2)
+    {
+      ok = ok && request.GetPost("a_rather_long_field_name") == "short"; // 返回的 string 不超过内联缓冲区
+      request.path() = "/index.html";
+    }
+    response.Init(srcDir, request.path(), request.IsKeepAlive(), 200);
+    out.RetrieveAll();
+    response.MakeResponse(out);
+    ok = ok && response.Code() == 200 && response.IsCached();
+    response.UnmapFile();
+  }
+  size_t count = allocations - before;
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(count, 0u);
+
+  unlink((srcDir + "/index.html").c_str());
+  rmdir(dir);
+}
+
+// 按发送顺序拼接响应：Head()、写缓冲区、Tail()
+static std::string Assemble(const HttpResponse &response, const Buffer &buff)
+{
+  size_t headLen = 0, tailLen = 0;
+  const char *head = response.Head(&headLen);
+  const char *tail = response.Tail(&tailLen);
+  return std::string(head, headLen) + std::string(buff.Peek(), buff.ReadableBytes()) + std::string(tail, tailLen);
+}
+
+TEST(HttpRequestTest, CachedResponseTemplateTest)
+{
+  char dir[] = "/tmp/webserver-test-XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string srcDir = dir, path = "/page.html";
+  FILE *fp = fopen((srcDir + path).c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("<html>cached</html>", fp);
+  fclose(fp);
+
+  HttpResponse response;
+  Buffer buff;
+  response.Init(srcDir, path, true, 200);
+  response.MakeResponse(buff);
+  ASSERT_TRUE(response.IsCached());
+  std::string full = Assemble(response, buff);
+  // 可变的 Date、Connection 插在状态行之后，其余来自模板，文件内容紧接在空行之后
+  std::string date = std::string("Date: ") + TimeService::HttpDate() + "\r\n";
+  EXPECT_EQ(date.size(), 6 + TimeService::HTTP_DATE_LEN + 2);
+  EXPECT_EQ(full.find("HTTP/1.1 200 OK\r\n" + date + "Connection: keep-alive\r\n"), 0u);
+  EXPECT_NE(full.find("Content-type: text/html\r\n"), std::string::npos);
+  EXPECT_NE(full.find("Content-length: 19\r\n"), std::string::npos);
+  EXPECT_NE(full.find("Cache-Control: no-cache\r\n"), std::string::npos);
+  EXPECT_EQ(full.substr(full.size() - 23), "\r\n\r\n<html>cached</html>");
+
+  size_t pos = full.find("ETag: ");
+  ASSERT_NE(pos, std::string::npos);
+  std::string etag = full.substr(pos + 6, full.find("\r\n", pos) - pos - 6);
+  pos = full.find("Last-Modified: ");
+  ASSERT_NE(pos, std::string::npos);
+  std::string lastModified = full.substr(pos + 15, full.find("\r\n", pos) - pos - 15);
+
+  // 校验器匹配时回复 304，没有内容
+  std::string list = "\"other\", W/" + etag;
+  HeaderTable::View ifNoneMatch{list.data(), list.size()};
+  HeaderTable::View ifModifiedSince{lastModified.data(), lastModified.size()};
+  const HeaderTable::View none;
+  struct
+  {
+    HeaderTable::View inm, ims;
+    int code;
+  } cases[] = {{ifNoneMatch, none, 304}, {none, ifModifiedSince, 304}, {none, none, 200}};
+  for (const auto &c : cases)
+  {
+    buff.RetrieveAll();
+    response.Init(srcDir, path, false, 200);
+    response.SetConditional(c.inm, c.ims);
+    response.MakeResponse(buff);
+    EXPECT_EQ(response.Code(), c.code);
+    full = Assemble(response, buff);
+    if (c.code == 304)
+    {
+      EXPECT_EQ(full.find("HTTP/1.1 304 Not Modified\r\nDate: "), 0u);
+      EXPECT_NE(full.find("Connection: close\r\n"), std::string::npos);
+      EXPECT_NE(full.find("ETag: " + etag + "\r\n"), std::string::npos);
+      EXPECT_EQ(full.substr(full.size() - 4), "\r\n\r\n");
+    }
+  }
+
+  unlink((srcDir + path).c_str());
+  rmdir(dir);
+}
+
+TEST(HttpRequestTest, ErrorPageTest)
+{
+  char dir[] = "/tmp/webserver-test-XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string srcDir = dir;
+  FILE *fp = fopen((srcDir + "/404.html").c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("<html>missing</html>", fp);
+  fclose(fp);
+  HttpResponse::LoadErrorPages(srcDir);
+  unlink((srcDir + "/404.html").c_str()); // 之后回复错误不再读文件
+
+  // 404：状态行 | Date、Connection | 预先生成的页面
+  HttpResponse response;
+  Buffer buff;
+  std::string path = "/no-such-file";
+  response.Init(srcDir, path, true);
+  response.MakeResponse(buff);
+  EXPECT_EQ(response.Code(), 404);
+  std::string full = Assemble(response, buff);
+  EXPECT_EQ(full.find("HTTP/1.1 404 Not Found\r\nDate: "), 0u);
+  EXPECT_NE(full.find("Connection: keep-alive\r\n"), std::string::npos);
+  EXPECT_NE(full.find("Content-length: 20\r\n"), std::string::npos);
+  EXPECT_EQ(full.substr(full.size() - 24), "\r\n\r\n<html>missing</html>");
+
+  // 没有路由的路径只允许 GET/HEAD/POST，其他方法回复 405 和 Allow；没有 405.html 时使用内置页面
+  HttpRequest request;
+  Buffer in;
+  in.Append("DELETE /index.html HTTP/1.1\r\nHost: a\r\n\r\n");
+  EXPECT_FALSE(request.parse(in));
+  EXPECT_EQ(request.ErrorCode(), 405);
+  buff.RetrieveAll();
+  response.Init(srcDir, request.path(), false, request.ErrorCode());
+  response.SetAllowed(request.Allowed());
+  response.MakeResponse(buff);
+  EXPECT_EQ(response.Code(), 405);
+  full = Assemble(response, buff);
+  EXPECT_EQ(full.find("HTTP/1.1 405 Method Not Allowed\r\nDate: "), 0u);
+  EXPECT_NE(full.find("Connection: close\r\nAllow: GET, HEAD, POST\r\n"), std::string::npos);
+  EXPECT_NE(full.find("405 : Method Not Allowed"), std::string::npos);
+
+  // 处理函数返回的其他错误使用 error.html（这里是内置页面）
+  buff.RetrieveAll();
+  response.Init(srcDir, path, false, 500);
+  response.MakeResponse(buff);
+  EXPECT_EQ(Assemble(response, buff).find("HTTP/1.1 500 Internal Server Error\r\n"), 0u);
+
+  rmdir(dir);
+}
+
+// 客户端发出的帧：带掩码
+static std::string ClientFrame(int opcode, const std::string &payload, bool fin = true)
+{
+  const unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+  std::string frame(1, static_cast<char>((fin ? 0x80 : 0) | opcode));
+  if (payload.size() < 126)
+  {
+    frame += static_cast<char>(0x80 | payload.size());
+  }
+  else
+  {
+    frame += static_cast<char>(0x80 | 126);
+    frame += static_cast<char>(payload.size() >> 8);
+    frame += static_cast<char>(payload.size() & 0xff);
+  }
+  frame.append(reinterpret_cast<const char *>(key), 4);
+  for (size_t i = 0; i < payload.size(); i++)
+  {
+    frame += static_cast<char>(payload[i] ^ key[i % 4]);
+  }
+  return frame;
+}
+
+// 把收到的消息原样发回
+class EchoHandler : public WebSocketHandler
+{
+public:
+  void OnMessage(WebSocket &ws, WebSocket::Opcode opcode, const std::string &message) override
+  {
+    ws.Send(WebSocket::Encode(opcode, message.data(), message.size()));
+  }
+};
+
+static std::string Drain(int fd)
+{
+  std::string out;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+  {
+    out.append(buf, n);
+  }
+  return out;
+}
+
+TEST(HttpRequestTest, WebSocketTest)
+{
+  // RFC 6455 1.3 中的例子
+  const char key[] = "dGhlIHNhbXBsZSBub25jZQ==";
+  EXPECT_EQ(WebSocket::AcceptKey(key, sizeof(key) - 1), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+  EXPECT_EQ(*WebSocket::Encode(WebSocket::TEXT, "hi", 2), std::string("\x81\x02hi", 4));
+  EXPECT_EQ(WebSocket::Encode(WebSocket::BINARY, std::string(300, 'x').data(), 300)->substr(0, 4),
+            std::string("\x82\x7e\x01\x2c", 4));
+
+  Router::Instance()->AddWebSocket("/echo", std::make_shared<EchoHandler>());
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  HttpConn::isET = true;
+  HttpConn conn;
+  conn.init(sv[0], sockaddr_in());
+  std::string upgrade = std::string("GET /echo HTTP/1.1\r\nHost: a\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                    "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: ") + key + "\r\n\r\n";
+  ASSERT_EQ(write(sv[1], upgrade.data(), upgrade.size()), static_cast<ssize_t>(upgrade.size()));
+  int err = 0;
+  conn.read(&err);
+  ASSERT_TRUE(conn.process());
+  conn.write(&err);
+  std::string head = Drain(sv[1]);
+  EXPECT_EQ(head.find("HTTP/1.1 101 Switching Protocols\r\n"), 0u);
+  EXPECT_NE(head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"), std::string::npos);
+  ASSERT_TRUE(conn.IsStreamPending());
+  conn.StartStream();
+
+  // 分片的消息中间插入 ping，逐字节到达
+  std::string in = ClientFrame(WebSocket::TEXT, "frag-", false) + ClientFrame(WebSocket::PING, "p") +
+                   ClientFrame(WebSocket::CONTINUATION, std::string(200, 'm'));
+  for (char c : in)
+  {
+    ASSERT_EQ(write(sv[1], &c, 1), 1);
+    ASSERT_TRUE(conn.Stream());
+  }
+  std::string out = Drain(sv[1]);
+  EXPECT_EQ(out.substr(0, 3), std::string("\x8a\x01p", 3)); // pong
+  EXPECT_EQ(out.substr(3), *WebSocket::Encode(WebSocket::TEXT, ("frag-" + std::string(200, 'm')).data(), 205));
+
+  // 不合法的 UTF-8：以 1007 关闭，关闭帧发出后断开
+  in = ClientFrame(WebSocket::TEXT, "\xc3\x28");
+  ASSERT_EQ(write(sv[1], in.data(), in.size()), static_cast<ssize_t>(in.size()));
+  EXPECT_FALSE(conn.Stream());
+  EXPECT_EQ(Drain(sv[1]), std::string("\x88\x02\x03\xef", 4));
+  std::vector<std::pair<HttpConn *, uint64_t>> woken;
+  HttpConn::TakeWoken(&woken); // 没有 wakeFd 时唤醒只记在列表中
+  EXPECT_FALSE(woken.empty());
+  conn.Close();
+  close(sv[1]);
+}
+
+// 订阅两个主题："tick" 只保留最新的，"log" 积压时丢弃
+class TickHandler : public EventStreamHandler
+{
+public:
+  void OnOpen(EventStream &stream) override
+  {
+    current = &stream;
+    lastEventId = stream.LastEventId();
+    events.Subscribe("tick", &stream, EventStream::COALESCE);
+    events.Subscribe("log", &stream);
+  }
+  void OnClose(EventStream &stream) override { closed = true; }
+
+  EventBroadcaster events;
+  EventStream *current = nullptr;
+  std::string lastEventId;
+  bool closed = false;
+};
+
+TEST(HttpRequestTest, EventStreamTest)
+{
+  EXPECT_EQ(*EventStream::Format("a\r\nb\nc", "tick", "7"), "event: tick\nid: 7\ndata: a\ndata: b\ndata: c\n\n");
+  EXPECT_EQ(*EventStream::Format("x", "bad\ndata: y"), "event: bad\ndata: x\n\n"); // 字段值中的换行被截断
+
+  auto handler = std::make_shared<TickHandler>();
+  Router::Instance()->AddEventStream("/sse", handler);
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  HttpConn::isET = true;
+  HttpConn conn;
+  conn.init(sv[0], sockaddr_in());
+  std::string get = "GET /sse HTTP/1.1\r\nHost: a\r\nLast-Event-ID: 41\r\n\r\n";
+  ASSERT_EQ(write(sv[1], get.data(), get.size()), static_cast<ssize_t>(get.size()));
+  int err = 0;
+  conn.read(&err);
+  ASSERT_TRUE(conn.process());
+  conn.write(&err);
+  std::string head = Drain(sv[1]);
+  EXPECT_EQ(head.find("HTTP/1.1 200 OK\r\n"), 0u);
+  EXPECT_NE(head.find("Content-Type: text/event-stream\r\n"), std::string::npos);
+  EXPECT_EQ(head.find("Content-Length"), std::string::npos);
+  ASSERT_TRUE(conn.IsStreamPending());
+  conn.StartStream();
+  ASSERT_TRUE(conn.Stream());
+  EXPECT_EQ(handler->lastEventId, "41");
+  EXPECT_EQ(handler->events.Subscribers("tick"), 1u);
+
+  // 连接处理之前的多次发布：tick 合并成最新的一个，log 按顺序排队，超过上限的被丢弃
+  size_t lossy = HttpConn::lossyQueueBytes;
+  HttpConn::lossyQueueBytes = 64;
+  EventStream::Event log = EventStream::Format("0123456789");
+  EXPECT_EQ(handler->events.Publish("tick", "1"), 1u);
+  EXPECT_EQ(handler->events.Publish("log", log), 1u);
+  EXPECT_EQ(handler->events.Publish("tick", "2"), 1u);
+  EXPECT_EQ(handler->events.Publish("log", log), 1u);
+  EXPECT_EQ(handler->events.Publish("log", log), 1u);
+  EXPECT_EQ(handler->events.Publish("log", log), 0u);
+  EXPECT_EQ(handler->events.Publish("none", "x"), 0u);
+  ASSERT_TRUE(conn.Stream());
+  EXPECT_EQ(Drain(sv[1]), "data: 2\n\n" + *log + *log + *log);
+  HttpConn::lossyQueueBytes = lossy;
+
+  // 客户端发来的数据被丢弃；空闲时的探测是注释行，不需要回应
+  ASSERT_EQ(write(sv[1], "x", 1), 1);
+  ASSERT_TRUE(conn.Heartbeat());
+  ASSERT_TRUE(conn.Stream());
+  EXPECT_EQ(Drain(sv[1]), ": ping\n\n");
+  EXPECT_TRUE(conn.Heartbeat());
+
+  // Close 之后发完队列中的事件再断开；连接关闭时自动取消订阅
+  EXPECT_EQ(handler->events.Publish("log", "last"), 1u);
+  handler->current->Close();
+  EXPECT_FALSE(handler->current->Send("late"));
+  EXPECT_FALSE(conn.Stream());
+  EXPECT_EQ(Drain(sv[1]), ": ping\n\ndata: last\n\n");
+  conn.Close();
+  EXPECT_TRUE(handler->closed);
+  EXPECT_EQ(handler->events.Subscribers("tick"), 0u);
+  EXPECT_EQ(handler->events.Publish("log", "gone"), 0u);
+  close(sv[1]);
+}
+
+// 通过连接处理一个请求，返回写出的全部响应
+static std::string Exchange(HttpConn &conn, int peer, const std::string &request)
+{
+  int err = 0;
+  if (write(peer, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+  {
+    return "";
+  }
+  conn.read(&err); // ET 模式下读到 EAGAIN 为止
+  if (!conn.process())
+  {
+    return "";
+  }
+  conn.write(&err);
+  return Drain(peer);
+}
+
+TEST(HttpRequestTest, HeadResponseTest)
+{
+  char dir[] = "/tmp/webserver-test-XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string srcDir = dir;
+  FILE *fp = fopen((srcDir + "/small.html").c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("<html>small</html>", fp);
+  fclose(fp);
+  fp = fopen((srcDir + "/large.txt").c_str(), "w"); // 超过缓存上限，走 mmap
+  ASSERT_NE(fp, nullptr);
+  fputs(std::string(100000, 'x').c_str(), fp);
+  fclose(fp);
+  HttpResponse::LoadErrorPages(srcDir); // 没有 404.html，使用内置页面
+
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  const char *savedSrcDir = HttpConn::srcDir;
+  HttpConn::srcDir = dir;
+  HttpConn::isET = true;
+  HttpConn conn;
+  conn.init(sv[0], sockaddr_in());
+
+  // 响应头与 GET 相同（包括 Content-length），空行之后没有内容；连接保持，下一个响应不受影响
+  std::string get = Exchange(conn, sv[1], "GET /small.html HTTP/1.1\r\nConnection: keep-alive\r\n\r\n");
+  EXPECT_EQ(get.substr(get.size() - 22), "\r\n\r\n<html>small</html>");
+  struct
+  {
+    const char *path;
+    const char *status;
+    const char *length;
+  } cases[] = {{"/small.html", "HTTP/1.1 200 OK\r\n", "Content-length: 18\r\n"},
+               {"/large.txt", "HTTP/1.1 200 OK\r\n", "Content-length: 100000\r\n"},
+               {"/missing", "HTTP/1.1 404 Not Found\r\n", "Content-length: "}};
+  for (const auto &c : cases)
+  {
+    std::string head = Exchange(conn, sv[1], std::string("HEAD ") + c.path + " HTTP/1.1\r\nConnection: keep-alive\r\n\r\n");
+    EXPECT_EQ(head.find(c.status), 0u) << c.path;
+    EXPECT_NE(head.find(c.length), std::string::npos) << c.path;
+    EXPECT_EQ(head.find("\r\n\r\n"), head.size() - 4) << c.path;
+  }
+  EXPECT_EQ(Exchange(conn, sv[1], "GET /small.html HTTP/1.1\r\nConnection: keep-alive\r\n\r\n").substr(get.size() - 22),
+            "\r\n\r\n<html>small</html>");
+
+  conn.Close();
+  close(sv[1]);
+  HttpConn::srcDir = savedSrcDir;
+  unlink((srcDir + "/small.html").c_str());
+  unlink((srcDir + "/large.txt").c_str());
+  rmdir(dir);
+}